@@ -228,6 +228,36 @@ public static class GenExtensions
             );
     }
 
+    /// <summary>
+    /// 返回 [Memcpy] 结构体成员的定长字节数( 数字, bool, 枚举. 不支持的类型抛异常 )
+    /// </summary>
+    public static int _GetSize_Memcpy(this Type t)
+    {
+        if (t.IsEnum) t = t.GetEnumUnderlyingType();
+        if (t.Namespace == nameof(System))
+        {
+            switch (t.Name)
+            {
+                case "Byte":
+                case "SByte":
+                case "Boolean":
+                    return 1;
+                case "UInt16":
+                case "Int16":
+                    return 2;
+                case "UInt32":
+                case "Int32":
+                case "Single":
+                    return 4;
+                case "UInt64":
+                case "Int64":
+                case "Double":
+                    return 8;
+            }
+        }
+        throw new Exception("unsupported [Memcpy] field type: " + t.FullName);
+    }
+
     /// <summary>
     /// 返回 t 是否为数据库中的可空类型
     /// </summary>
@@ -550,6 +580,21 @@ public static class GenExtensions
         }
     }
 
+    /// <summary>
+    /// 获取成员的 CPP 类型声明( 处理 [View] 标记 )
+    /// </summary>
+    public static string _GetFieldTypeDecl_Cpp(this FieldInfo f, string templateName)
+    {
+        if (f._Has<TemplateLibrary.View>())
+        {
+            var t = f.FieldType;
+            if (t._IsString()) return "xx::StringView";
+            if (t.Namespace == nameof(TemplateLibrary) && t.Name == "BBuffer") return "xx::BytesView";
+            throw new Exception("[View] only supports string or BBuffer: " + f.DeclaringType.FullName + "." + f.Name);
+        }
+        return f.FieldType._GetTypeDecl_Cpp(templateName);
+    }
+
     public static string CutLast(this string s, int n = 1)
     {
         return s.Substring(0, s.Length - n);
@@ -133,6 +133,33 @@ namespace TemplateLibrary
     }
 
 
+    /// <summary>
+    /// 标记结构体以定长原始内存格式( little endian, 按 C 自然对齐补 0 )序列化. List 中的该类结构体将整块拷贝.
+    /// 成员只能是 定长数值 / bool / 枚举 ( 不可含 string, List, 类, 结构体 )
+    /// </summary>
+    [System.AttributeUsage(System.AttributeTargets.Struct)]
+    public class Memcpy : System.Attribute
+    {
+    }
+
+    /// <summary>
+    /// 标记类为树形包( 数据中不存在共享 / 循环引用 ). 以其为根收发时不做引用去重, 省掉每个对象的字典操作.
+    /// 收发两端都用生成物注册即可自动一致
+    /// </summary>
+    [System.AttributeUsage(System.AttributeTargets.Class)]
+    public class Tree : System.Attribute
+    {
+    }
+
+    /// <summary>
+    /// 针对 string, BBuffer 类型成员, c++ 生成为 xx::StringView / xx::BytesView.
+    /// 反序列化时直接引用接收缓冲区, 不创建对象不复制, 只在 OnReceivePackage 期间有效. 线上格式不变
+    /// </summary>
+    [System.AttributeUsage(System.AttributeTargets.Field)]
+    public class View : System.Attribute
+    {
+    }
+
     /// <summary>
     /// 针对指针类型成员, 于构造函数中创建默认实例
     /// </summary>
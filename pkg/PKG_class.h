@@ -48,6 +48,7 @@ namespace Client_Server
         virtual void ToStringCore(xx::String &str) const override;
         virtual void ToBBuffer(xx::BBuffer &bb) const override;
         virtual int FromBBuffer(xx::BBuffer &bb) override;
+        virtual uint64_t CalcBBufferSize() const override;
     };
     // 一个回应( 当前限定为 service 与 db 间 ), 通常携带一个请求发过来的流水号. 这是基类
     struct Response : xx::MPObject
@@ -63,6 +64,7 @@ namespace Client_Server
         virtual void ToStringCore(xx::String &str) const override;
         virtual void ToBBuffer(xx::BBuffer &bb) const override;
         virtual int FromBBuffer(xx::BBuffer &bb) override;
+        virtual uint64_t CalcBBufferSize() const override;
     };
     // 一个请求( 当前限定为 service 与 db 间 ), 通常携带一个流水号. 这是基类
     struct Request : xx::MPObject
@@ -78,6 +80,7 @@ namespace Client_Server
         virtual void ToStringCore(xx::String &str) const override;
         virtual void ToBBuffer(xx::BBuffer &bb) const override;
         virtual int FromBBuffer(xx::BBuffer &bb) override;
+        virtual uint64_t CalcBBufferSize() const override;
     };
     struct Property_long : PKG::Property
     {
@@ -92,6 +95,7 @@ namespace Client_Server
         virtual void ToStringCore(xx::String &str) const override;
         virtual void ToBBuffer(xx::BBuffer &bb) const override;
         virtual int FromBBuffer(xx::BBuffer &bb) override;
+        virtual uint64_t CalcBBufferSize() const override;
     };
     struct Property_double : PKG::Property
     {
@@ -106,6 +110,7 @@ namespace Client_Server
         virtual void ToStringCore(xx::String &str) const override;
         virtual void ToBBuffer(xx::BBuffer &bb) const override;
         virtual int FromBBuffer(xx::BBuffer &bb) override;
+        virtual uint64_t CalcBBufferSize() const override;
     };
     struct Property_string : PKG::Property
     {
@@ -120,6 +125,7 @@ namespace Client_Server
         virtual void ToStringCore(xx::String &str) const override;
         virtual void ToBBuffer(xx::BBuffer &bb) const override;
         virtual int FromBBuffer(xx::BBuffer &bb) override;
+        virtual uint64_t CalcBBufferSize() const override;
     };
     struct Properties : PKG::Property
     {
@@ -134,6 +140,7 @@ namespace Client_Server
         virtual void ToStringCore(xx::String &str) const override;
         virtual void ToBBuffer(xx::BBuffer &bb) const override;
         virtual int FromBBuffer(xx::BBuffer &bb) override;
+        virtual uint64_t CalcBBufferSize() const override;
     };
     struct UserInfo : xx::MPObject
     {
@@ -149,6 +156,7 @@ namespace Client_Server
         virtual void ToStringCore(xx::String &str) const override;
         virtual void ToBBuffer(xx::BBuffer &bb) const override;
         virtual int FromBBuffer(xx::BBuffer &bb) override;
+        virtual uint64_t CalcBBufferSize() const override;
     };
 namespace Server_Client
 {
@@ -167,6 +175,7 @@ namespace Server_Client
         virtual void ToStringCore(xx::String &str) const override;
         virtual void ToBBuffer(xx::BBuffer &bb) const override;
         virtual int FromBBuffer(xx::BBuffer &bb) override;
+        virtual uint64_t CalcBBufferSize() const override;
     };
     // 进入失败, 返回错误信息
     struct JoinFail : PKG::Response
@@ -182,6 +191,7 @@ namespace Server_Client
         virtual void ToStringCore(xx::String &str) const override;
         virtual void ToBBuffer(xx::BBuffer &bb) const override;
         virtual int FromBBuffer(xx::BBuffer &bb) override;
+        virtual uint64_t CalcBBufferSize() const override;
     };
     // 推送文字消息
     struct PushJoin : xx::MPObject
@@ -197,6 +207,7 @@ namespace Server_Client
         virtual void ToStringCore(xx::String &str) const override;
         virtual void ToBBuffer(xx::BBuffer &bb) const override;
         virtual int FromBBuffer(xx::BBuffer &bb) override;
+        virtual uint64_t CalcBBufferSize() const override;
     };
     // 推送文字消息
     struct PushMessage : xx::MPObject
@@ -213,6 +224,7 @@ namespace Server_Client
         virtual void ToStringCore(xx::String &str) const override;
         virtual void ToBBuffer(xx::BBuffer &bb) const override;
         virtual int FromBBuffer(xx::BBuffer &bb) override;
+        virtual uint64_t CalcBBufferSize() const override;
     };
     // 推送退出消息
     struct PushLogout : xx::MPObject
@@ -230,6 +242,7 @@ namespace Server_Client
         virtual void ToStringCore(xx::String &str) const override;
         virtual void ToBBuffer(xx::BBuffer &bb) const override;
         virtual int FromBBuffer(xx::BBuffer &bb) override;
+        virtual uint64_t CalcBBufferSize() const override;
     };
 }
 namespace Client_Server
@@ -249,6 +262,7 @@ namespace Client_Server
         virtual void ToStringCore(xx::String &str) const override;
         virtual void ToBBuffer(xx::BBuffer &bb) const override;
         virtual int FromBBuffer(xx::BBuffer &bb) override;
+        virtual uint64_t CalcBBufferSize() const override;
     };
     // 发消息
     struct Message : xx::MPObject
@@ -264,6 +278,7 @@ namespace Client_Server
         virtual void ToStringCore(xx::String &str) const override;
         virtual void ToBBuffer(xx::BBuffer &bb) const override;
         virtual int FromBBuffer(xx::BBuffer &bb) override;
+        virtual uint64_t CalcBBufferSize() const override;
     };
     // 主动退出
     struct Logout : xx::MPObject
@@ -278,6 +293,7 @@ namespace Client_Server
         virtual void ToStringCore(xx::String &str) const override;
         virtual void ToBBuffer(xx::BBuffer &bb) const override;
         virtual int FromBBuffer(xx::BBuffer &bb) override;
+        virtual uint64_t CalcBBufferSize() const override;
     };
 }
 	inline Request::Request()
@@ -326,6 +342,13 @@ namespace Client_Server
         return rtv;
     }
 
+    inline uint64_t Request::CalcBBufferSize() const
+    {
+        uint64_t siz = 0;
+        siz += xx::BBuffer::CalcWriteSize(this->serial);
+        return siz;
+    }
+
 	inline Response::Response()
 	{
 	}
@@ -372,6 +395,13 @@ namespace Client_Server
         return rtv;
     }
 
+    inline uint64_t Response::CalcBBufferSize() const
+    {
+        uint64_t siz = 0;
+        siz += xx::BBuffer::CalcWriteSize(this->requestSerial);
+        return siz;
+    }
+
 	inline Property::Property()
 	{
 	}
@@ -421,6 +451,13 @@ namespace Client_Server
         return rtv;
     }
 
+    inline uint64_t Property::CalcBBufferSize() const
+    {
+        uint64_t siz = 0;
+        siz += xx::BBuffer::CalcWriteSize(this->name);
+        return siz;
+    }
+
 	inline Property_long::Property_long()
         : PKG::Property()
 	{
@@ -471,6 +508,13 @@ namespace Client_Server
         return rtv;
     }
 
+    inline uint64_t Property_long::CalcBBufferSize() const
+    {
+        uint64_t siz = this->BaseType::CalcBBufferSize();
+        siz += xx::BBuffer::CalcWriteSize(this->value);
+        return siz;
+    }
+
 	inline Property_double::Property_double()
         : PKG::Property()
 	{
@@ -521,6 +565,13 @@ namespace Client_Server
         return rtv;
     }
 
+    inline uint64_t Property_double::CalcBBufferSize() const
+    {
+        uint64_t siz = this->BaseType::CalcBBufferSize();
+        siz += xx::BBuffer::CalcWriteSize(this->value);
+        return siz;
+    }
+
 	inline Property_string::Property_string()
         : PKG::Property()
 	{
@@ -574,6 +625,13 @@ namespace Client_Server
         return rtv;
     }
 
+    inline uint64_t Property_string::CalcBBufferSize() const
+    {
+        uint64_t siz = this->BaseType::CalcBBufferSize();
+        siz += xx::BBuffer::CalcWriteSize(this->value);
+        return siz;
+    }
+
 	inline Properties::Properties()
         : PKG::Property()
 	{
@@ -627,6 +685,13 @@ namespace Client_Server
         return rtv;
     }
 
+    inline uint64_t Properties::CalcBBufferSize() const
+    {
+        uint64_t siz = this->BaseType::CalcBBufferSize();
+        siz += xx::BBuffer::CalcWriteSize(this->value);
+        return siz;
+    }
+
 	inline UserInfo::UserInfo()
 	{
 	}
@@ -680,6 +745,14 @@ namespace Client_Server
         return rtv;
     }
 
+    inline uint64_t UserInfo::CalcBBufferSize() const
+    {
+        uint64_t siz = 0;
+        siz += xx::BBuffer::CalcWriteSize(this->id);
+        siz += xx::BBuffer::CalcWriteSize(this->props);
+        return siz;
+    }
+
 namespace Server_Client
 {
 	inline JoinSuccess::JoinSuccess()
@@ -740,6 +813,14 @@ namespace Server_Client
         return rtv;
     }
 
+    inline uint64_t JoinSuccess::CalcBBufferSize() const
+    {
+        uint64_t siz = this->BaseType::CalcBBufferSize();
+        siz += xx::BBuffer::CalcWriteSize(this->self);
+        siz += xx::BBuffer::CalcWriteSize(this->users);
+        return siz;
+    }
+
 	inline JoinFail::JoinFail()
         : PKG::Response()
 	{
@@ -793,6 +874,13 @@ namespace Server_Client
         return rtv;
     }
 
+    inline uint64_t JoinFail::CalcBBufferSize() const
+    {
+        uint64_t siz = this->BaseType::CalcBBufferSize();
+        siz += xx::BBuffer::CalcWriteSize(this->reason);
+        return siz;
+    }
+
 	inline PushJoin::PushJoin()
 	{
 	}
@@ -839,6 +927,13 @@ namespace Server_Client
         return rtv;
     }
 
+    inline uint64_t PushJoin::CalcBBufferSize() const
+    {
+        uint64_t siz = 0;
+        siz += xx::BBuffer::CalcWriteSize(this->id);
+        return siz;
+    }
+
 	inline PushMessage::PushMessage()
 	{
 	}
@@ -892,6 +987,14 @@ namespace Server_Client
         return rtv;
     }
 
+    inline uint64_t PushMessage::CalcBBufferSize() const
+    {
+        uint64_t siz = 0;
+        siz += xx::BBuffer::CalcWriteSize(this->id);
+        siz += xx::BBuffer::CalcWriteSize(this->text);
+        return siz;
+    }
+
 	inline PushLogout::PushLogout()
 	{
 	}
@@ -945,6 +1048,14 @@ namespace Server_Client
         return rtv;
     }
 
+    inline uint64_t PushLogout::CalcBBufferSize() const
+    {
+        uint64_t siz = 0;
+        siz += xx::BBuffer::CalcWriteSize(this->id);
+        siz += xx::BBuffer::CalcWriteSize(this->reason);
+        return siz;
+    }
+
 }
 namespace Client_Server
 {
@@ -1008,6 +1119,14 @@ namespace Client_Server
         return rtv;
     }
 
+    inline uint64_t Join::CalcBBufferSize() const
+    {
+        uint64_t siz = this->BaseType::CalcBBufferSize();
+        siz += xx::BBuffer::CalcWriteSize(this->username);
+        siz += xx::BBuffer::CalcWriteSize(this->password);
+        return siz;
+    }
+
 	inline Message::Message()
 	{
 	}
@@ -1057,6 +1176,13 @@ namespace Client_Server
         return rtv;
     }
 
+    inline uint64_t Message::CalcBBufferSize() const
+    {
+        uint64_t siz = 0;
+        siz += xx::BBuffer::CalcWriteSize(this->text);
+        return siz;
+    }
+
 	inline Logout::Logout()
 	{
 	}
@@ -1098,6 +1224,12 @@ namespace Client_Server
         return rtv;
     }
 
+    inline uint64_t Logout::CalcBBufferSize() const
+    {
+        uint64_t siz = 0;
+        return siz;
+    }
+
 }
 }
 namespace xx
@@ -1147,5 +1279,6 @@ namespace PKG
 	    xx::MemPool::Register<PKG::Client_Server::Join, PKG::Request>();
 	    xx::MemPool::Register<PKG::Client_Server::Message, xx::MPObject>();
 	    xx::MemPool::Register<PKG::Client_Server::Logout, xx::MPObject>();
+	    xx::MemPool::BuildTypeRanges();
 	}
 }
@@ -181,12 +181,12 @@ namespace " + c.Namespace + @"
             foreach (var f in fs)
             {
                 var ft = f.FieldType;
-                var ftn = ft._GetTypeDecl_Cpp(templateName);
+                var ftn = f._GetFieldTypeDecl_Cpp(templateName);
                 sb.Append(f._GetDesc_Cpp(8) + @"
         " + (f.IsStatic ? "constexpr " : "") + ftn + " " + f.Name);
 
                 var v = f.GetValue(f.IsStatic ? null : o);
-                var dv = v._GetDefaultValueDecl_Cpp(templateName);
+                var dv = f._Has<TemplateLibrary.View>() ? "" : v._GetDefaultValueDecl_Cpp(templateName);
                 if (dv != "")
                 {
                     sb.Append(" = " + dv + ";");
@@ -208,6 +208,7 @@ namespace " + c.Namespace + @"
         virtual void ToStringCore(xx::String &str) const override;
         virtual void ToBBuffer(xx::BBuffer &bb) const override;
         virtual int FromBBuffer(xx::BBuffer &bb) override;
+        virtual uint64_t CalcBBufferSize() const override;
     };");   // class }
 
             // namespace }
@@ -251,7 +252,7 @@ namespace " + c.Namespace + @"
             foreach (var f in fs)
             {
                 var ft = f.FieldType;
-                if (ft.IsClass && f._Has<TemplateLibrary.CreateInstance>())
+                if (ft.IsClass && f._Has<TemplateLibrary.CreateInstance>() && !f._Has<TemplateLibrary.View>())
                 {
                     sb.Append(@"
         mempool().CreateTo(" + f.Name + ");");
@@ -304,7 +305,7 @@ namespace " + c.Namespace + @"
             foreach (var f in fs)
             {
                 var ft = f.FieldType;
-                if (ft.IsClass)
+                if (ft.IsClass && !f._Has<TemplateLibrary.View>())
                 {
                     sb.Append(@"
         mempool().SafeRelease(" + f.Name + ");");
@@ -354,7 +355,7 @@ namespace " + c.Namespace + @"
                 if (f._Has<TemplateLibrary.NotSerialize>())
                 {
                     sb.Append(@"
-        bb.WriteDefaultValue<" + f.FieldType._GetTypeDecl_Cpp(templateName) + ">();");
+        bb.WriteDefaultValue<" + f._GetFieldTypeDecl_Cpp(templateName) + ">();");
                 }
                 else if (f._Has<TemplateLibrary.CustomSerialize>())
                 {
@@ -394,6 +395,32 @@ namespace " + c.Namespace + @"
             sb.Append(@"
         return rtv;
     }
+
+    inline uint64_t " + c.Name + @"::CalcBBufferSize() const
+    {
+        uint64_t siz = " + (c._HasBaseType() ? "this->BaseType::CalcBBufferSize()" : "0") + @";");
+            fs = c._GetFields();
+            foreach (var f in fs)
+            {
+                if (f._Has<TemplateLibrary.NotSerialize>())
+                {
+                    sb.Append(@"
+        siz += xx::BBuffer::CalcWriteSize(" + f._GetFieldTypeDecl_Cpp(templateName) + "());");
+                }
+                else if (f._Has<TemplateLibrary.CustomSerialize>())
+                {
+                    sb.Append(@"
+        siz += xx::BBufferSizeUnknown;");
+                }
+                else
+                {
+                    sb.Append(@"
+        siz += xx::BBuffer::CalcWriteSize(this->" + f.Name + ");");
+                }
+            }
+            sb.Append(@"
+        return siz;
+    }
 ");
 
             // namespace }
@@ -418,45 +445,58 @@ namespace xx
             var ctn = c._GetTypeDecl_Cpp(templateName);
             var fs = c._GetFields();
 
-            sb.Append(@"
+            if (c._Has<TemplateLibrary.Memcpy>())
+            {
+                sb.Append(@"
+	template<>
+	struct BytesMemcpy<" + ctn + @", void>
+	{
+		static const bool value = true;
+	};");
+            }
+            else
+            {
+                sb.Append(@"
 	template<>
 	struct BytesFunc<" + ctn + @", void>
 	{
 		static inline uint32_t Calc(" + ctn + @" const &in)
 		{
 			return BBCalc(");
-            foreach (var f in fs)
-            {
-                sb.Append((f == fs[0] ? "" : ", ") + "in." + f.Name);
-            }
-            sb.Append(@");
+                foreach (var f in fs)
+                {
+                    sb.Append((f == fs[0] ? "" : ", ") + "in." + f.Name);
+                }
+                sb.Append(@");
 		}
 		static inline uint32_t WriteTo(char *dstBuf, " + ctn + @" const &in)
 		{
 			return BBWriteTo(dstBuf");
-            foreach (var f in fs)
-            {
-                if (f._Has<TemplateLibrary.NotSerialize>())
+                foreach (var f in fs)
                 {
-                    // todo: write 默认值
+                    if (f._Has<TemplateLibrary.NotSerialize>())
+                    {
+                        // todo: write 默认值
+                    }
+                    else
+                    {
+                        sb.Append(@", " + "in." + f.Name);
+                    }
                 }
-                else
-                {
-                    sb.Append(@", " + "in." + f.Name);
-                }
-            }
-            sb.Append(@");
+                sb.Append(@");
 		}
 		static inline int ReadFrom(char const *srcBuf, uint32_t const &dataLen, uint32_t &offset, " + ctn + @" &out)
 		{
 			return BBReadFrom(srcBuf, dataLen, offset");
-            foreach (var f in fs)
-            {
-                sb.Append(@", " + "out." + f.Name);
-            }
-            sb.Append(@");
+                foreach (var f in fs)
+                {
+                    sb.Append(@", " + "out." + f.Name);
+                }
+                sb.Append(@");
 		}
-	};
+	};");
+            }
+            sb.Append(@"
 	template<>
 	struct StrFunc<" + ctn + @", void>
 	{
@@ -522,6 +562,12 @@ namespace xx
             sb.Append(@"
 	template<> struct TypeId<" + ctn + @"> { static const uint16_t value = " + typeId + @"; };");
         }
+        foreach (var kv in types)
+        {
+            if (!kv.Key._Has<TemplateLibrary.Tree>()) continue;
+            sb.Append(@"
+	template<> struct NoPtrDedup<" + kv.Key._GetTypeDecl_Cpp(templateName).CutLast() + @"> { static const bool value = true; };");
+        }
 
 
         sb.Append(@"
@@ -541,6 +587,7 @@ namespace " + templateName + @"
 	    xx::MemPool::Register<" + ctn + @", " + btn + @">();");
         }
         sb.Append(@"
+	    xx::MemPool::BuildTypeRanges();
 	}
 }
 ");
@@ -8,6 +8,60 @@ using System.Text;
 
 public static class GenCS_Class
 {
+    /// <summary>
+    /// 生成 [Memcpy] 结构体的序列化代码: 按 C 自然对齐排布并补 0, 与 c++ 端直接 memcpy 的内存布局一致
+    /// </summary>
+    static void GenMemcpy(StringBuilder sb, List<FieldInfo> fs, bool isWrite)
+    {
+        int offset = 0, maxAlign = 1;
+        foreach (var f in fs)
+        {
+            var ft = f.FieldType;
+            var siz = ft._GetSize_Memcpy();
+            var pad = (siz - offset % siz) % siz;
+            if (pad > 0)
+            {
+                sb.Append(isWrite ? @"
+            bb.WritePadding(" + pad + ");" : @"
+            bb.offset += " + pad + ";");
+            }
+            offset += pad + siz;
+            if (siz > maxAlign) maxAlign = siz;
+
+            if (ft == typeof(float))
+            {
+                sb.Append(isWrite ? @"
+            bb.Write(this." + f.Name + ");" : @"
+            bb.Read(ref this." + f.Name + ");");
+            }
+            else if (ft == typeof(double))
+            {
+                sb.Append(isWrite ? @"
+            bb.WriteFixed(this." + f.Name + ");" : @"
+            bb.ReadFixed(ref this." + f.Name + ");");
+            }
+            else if (ft == typeof(bool))
+            {
+                sb.Append(isWrite ? @"
+            bb.WriteFixed(this." + f.Name + " ? 1UL : 0UL, 1);" : @"
+            this." + f.Name + " = bb.ReadFixed(1) != 0;");
+            }
+            else
+            {
+                sb.Append(isWrite ? @"
+            bb.WriteFixed((ulong)this." + f.Name + ", " + siz + ");" : @"
+            this." + f.Name + " = (" + ft._GetTypeDecl_Csharp() + ")bb.ReadFixed(" + siz + ");");
+            }
+        }
+        var tail = (maxAlign - offset % maxAlign) % maxAlign;
+        if (tail > 0)
+        {
+            sb.Append(isWrite ? @"
+            bb.WritePadding(" + tail + ");" : @"
+            bb.offset += " + tail + ";");
+        }
+    }
+
     public static void Gen(Assembly asm, string outDir, string templateName)
     {
         var sb = new StringBuilder();
@@ -135,6 +189,11 @@ namespace " + c.Namespace + @"
             base.ToBBuffer(bb);");
             }
             fs = c._GetFields();
+            if (c._Has<TemplateLibrary.Memcpy>())
+            {
+                GenMemcpy(sb, fs, true);
+                fs = new List<FieldInfo>();
+            }
             foreach (var f in fs)
             {
                 var ft = f.FieldType;
@@ -176,6 +235,11 @@ namespace " + c.Namespace + @"
             base.FromBBuffer(bb);");
             }
             fs = c._GetFields();
+            if (c._Has<TemplateLibrary.Memcpy>())
+            {
+                GenMemcpy(sb, fs, false);
+                fs = new List<FieldInfo>();
+            }
             foreach (var f in fs)
             {
                 var ft = f.FieldType;
@@ -272,7 +336,7 @@ namespace " + c.Namespace + @"
             typeId = (ushort)kv.Value;
 
             sb.Append(@"
-            BBuffer.Register<" + ct._GetTypeDecl_Csharp() + @">(" + typeId++ + ");");
+            BBuffer.Register<" + ct._GetTypeDecl_Csharp() + @">(" + typeId++ + (ct._Has<TemplateLibrary.Tree>() ? ", true" : "") + ");");
         }
 
         sb.Append(@"
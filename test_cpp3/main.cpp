@@ -0,0 +1,672 @@
+﻿#define XX_MEMPOOL_THREAD_SAFE
+#include "xx_mempool.h"
+#include "xx_bbuffer.h"
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+// MemPool 行为测试. 返回值为失败项数
+
+int errors = 0;
+inline void Check(bool ok, char const* what)
+{
+	if (ok) return;
+	++errors;
+	std::cout << "FAILED: " << what << std::endl;
+}
+
+// 数 stack 中的内存块( 非 debug 模式下 PtrStack 不带 count )
+inline size_t StackLen(xx::MemPool::PtrStack const& s)
+{
+	size_t n = 0;
+	for (auto p = s.header; p; p = *(void**)((char*)p + sizeof(xx::MemHeader_VersionNumber))) ++n;
+	return n;
+}
+
+struct Foo : xx::MPObject
+{
+	int* dtorCount;
+	Foo(int* dtorCount) : dtorCount(dtorCount) {}
+	~Foo() { ++*dtorCount; }
+};
+// 析构时记下 id, 并 Release 所持有的 child
+struct Node : xx::MPObject
+{
+	int id;
+	std::vector<int>* log;
+	Node* child = nullptr;
+	Node(int id, std::vector<int>* log) : id(id), log(log) {}
+	~Node()
+	{
+		log->push_back(id);
+		if (child) mempool().Release(child);
+	}
+};
+// 可序列化, 带 Reset 的回收测试类型
+struct Item : xx::MPObject
+{
+	inline static int ctors = 0, dtors = 0, resets = 0;
+	int v = 0;
+	Item() { ++ctors; }
+	Item(int v) : v(v) { ++ctors; }
+	Item(xx::BBuffer* bb) { ++ctors; if (int r = bb->Read(v)) throw r; }
+	~Item() { ++dtors; }
+	void Reset() { ++resets; v = 0; }
+	virtual void ToBBuffer(xx::BBuffer& bb) const override { bb.Write(v); }
+	virtual int FromBBuffer(xx::BBuffer& bb) override { return bb.Read(v); }
+};
+
+// 不带 Reset 的回收测试类型: 回收时 原地析构 + 默认构造
+struct Plain : xx::MPObject
+{
+	inline static int ctors = 0, dtors = 0;
+	int v = 0;
+	Plain() { ++ctors; }
+	~Plain() { ++dtors; }
+};
+
+// 继承深度为 depth 的 IsBaseOf 测试类型( 父子关系只登记于 pids, 不必真的继承 )
+template<int depth>
+struct Level : xx::MPObject
+{
+	Level() {}
+	Level(xx::BBuffer*) {}
+};
+const int maxDepth = 16;
+
+// 共享对象测试类型. SharedMsg 按类型共享
+struct Msg : xx::MPObject
+{
+	std::atomic<int>* dtorCount;
+	Msg(std::atomic<int>* dtorCount) : dtorCount(dtorCount) {}
+	~Msg() { if (dtorCount) ++*dtorCount; }
+};
+struct SharedMsg : Msg
+{
+	using Msg::Msg;
+	SharedMsg() : Msg(nullptr) {}
+};
+
+namespace xx
+{
+	template<> struct SharedType<SharedMsg> { static const bool value = true; };
+	template<int depth> struct TypeId<Level<depth>> { static const uint16_t value = 200 + depth; };
+	template<> struct TypeId<Foo> { static const uint16_t value = 100; };
+	template<> struct TypeId<Node> { static const uint16_t value = 101; };
+	template<> struct TypeId<Item> { static const uint16_t value = 102; };
+	template<> struct TypeId<Plain> { static const uint16_t value = 103; };
+	template<> struct TypeId<Msg> { static const uint16_t value = 104; };
+	template<> struct TypeId<SharedMsg> { static const uint16_t value = 105; };
+}
+
+// 非所属线程 Free / Release: 内存块进归还链表, 版本号已清 0, 所属线程取回后复用
+void TestCrossThreadFree()
+{
+	xx::MemPool mp;
+	const size_t n = 1000;
+	std::vector<void*> bufs;
+	for (size_t i = 0; i < n; ++i) bufs.push_back(mp.Alloc(40));
+	auto idx = ((xx::MemHeader_VersionNumber*)bufs[0] - 1)->ptrStackIndex();
+
+	int dtorCount = 0;
+	xx::MPtr<Foo> foo = mp.Create<Foo>(&dtorCount);
+	auto fooIdx = foo->memHeader().ptrStackIndex();
+	auto stackLen = StackLen(mp.ptrstacks[idx]);
+
+	std::thread t([&]
+	{
+		for (auto p : bufs) mp.Free(p);
+		mp.Release(foo.pointer);
+	});
+	t.join();
+
+	Check(dtorCount == 1, "Release from another thread runs the destructor");
+	Check(!foo, "MPtr is invalid after a cross-thread Release");
+	for (auto p : bufs) Check(((xx::MemHeader_VersionNumber*)p - 1)->versionNumber == 0, "version is cleared before the block is returned");
+	Check(StackLen(mp.ptrstacks[idx]) == stackLen, "cross-thread Free does not touch the owner stack");
+	Check(mp.returns[idx].load() != nullptr, "cross-thread Free pushes to the return list");
+
+	mp.DrainReturns();
+	Check(mp.returns[idx].load() == nullptr && mp.returns[fooIdx].load() == nullptr, "DrainReturns empties the return lists");
+	Check(StackLen(mp.ptrstacks[idx]) == stackLen + n + (fooIdx == idx), "DrainReturns moves every returned block to the stack");
+
+	// 取回的块应被再次分配出去, 而非重新 malloc
+	std::vector<void*> again;
+	for (size_t i = 0; i < n; ++i) again.push_back(mp.Alloc(40));
+	size_t reused = 0;
+	for (auto p : again) reused += std::find(bufs.begin(), bufs.end(), p) != bufs.end();
+	Check(reused == n, "drained blocks are reused by Alloc");
+	for (auto p : again) mp.Free(p);
+}
+
+// 多线程并发归还, 所属线程在 stack 取空时由 PopBlock 自动取回
+void TestConcurrentReturns()
+{
+	xx::MemPool mp;
+	const size_t numThreads = 4, perThread = 10000;
+	std::vector<std::vector<void*>> bufs(numThreads);
+	for (auto& v : bufs) for (size_t i = 0; i < perThread; ++i) v.push_back(mp.Alloc(100));
+	auto idx = ((xx::MemHeader_VersionNumber*)bufs[0][0] - 1)->ptrStackIndex();
+	Check(StackLen(mp.ptrstacks[idx]) == 0, "stack is empty before the returns");
+
+	std::vector<std::thread> ts;
+	for (auto& v : bufs) ts.emplace_back([&mp, &v] { for (auto p : v) mp.Free(p); });
+	for (auto& t : ts) t.join();
+
+	size_t listLen = 0;
+	for (auto p = mp.returns[idx].load(); p; p = *(void**)((char*)p + sizeof(xx::MemHeader_VersionNumber))) ++listLen;
+	Check(listLen == numThreads * perThread, "no block is lost by concurrent pushes");
+
+	// stack 为空, 第一次 Alloc 即取回整条链表
+	auto p = mp.Alloc(100);
+	Check(mp.returns[idx].load() == nullptr, "PopBlock drains the return list on a stack miss");
+	Check(StackLen(mp.ptrstacks[idx]) == numThreads * perThread - 1, "PopBlock serves the miss from the drained blocks");
+	mp.Free(p);
+}
+
+// Trim: 归还所有缓存块. span 分级只归还空 span, 仍有在用块的 span 保留
+void TestTrim()
+{
+	xx::MemPool mp;
+	std::vector<void*> smalls, larges;
+	smalls.push_back(mp.Alloc(100));
+	auto idx = ((xx::MemHeader_VersionNumber*)smalls[0] - 1)->ptrStackIndex();
+	auto& sc = mp.spanClasses[idx];
+	for (size_t i = 1; i < sc.blocksPerSpan * 3; ++i) smalls.push_back(mp.Alloc(100));	// 切满 3 个 span
+	for (int i = 0; i < 20; ++i) larges.push_back(mp.Alloc(512 * 1024));				// 超过 spanMaxBlockSize, 直接 malloc
+	auto keep = smalls.back();
+	smalls.pop_back();
+	for (auto p : smalls) mp.Free(p);
+	for (auto p : larges) mp.Free(p);
+	Check(mp.CachedBytes() >= 10 * 1024 * 1024, "freed blocks are cached");
+	Check(mp.numSpans == 3, "the small blocks fill three spans");
+
+	Check(mp.Trim() >= 10 * 1024 * 1024 + 2 * sc.spanSize, "Trim reports the released bytes");
+	Check(mp.numSpans == 1, "Trim releases every span except the one with a live block");
+	Check(sc.cached == sc.blocksPerSpan - 1 && mp.CachedBytes() == sc.cached * xx::MemPool::CalcClassSize(idx), "only blocks of the live span stay cached");
+	Check(mp.Trim() == 0, "a second Trim has nothing to release");
+
+	// Trim 之后照常分配
+	auto p = mp.Alloc(512 * 1024);
+	memset(p, 1, 512 * 1024);
+	mp.Free(p);
+	mp.Free(keep);
+}
+
+// TrimTick: 超预算时按衰减后的高水位回收. 每周期都在用的工作集不回收
+void TestTrimTick()
+{
+	xx::MemPool mp;
+	size_t siz = 1000 + sizeof(xx::MemHeader_VersionNumber);
+	auto& sc = mp.spanClasses[xx::MemPool::CalcIndex(siz)];
+	const size_t burst = sc.blocksPerSpan * 20, working = sc.blocksPerSpan / 2;
+	mp.trimBudgetBytes = sc.spanSize * 2;
+	mp.trimDecayPercent = 50;
+	mp.spanRetainBytes = (size_t)-1;											// Free 时不归还空 span, 只看 TrimTick
+
+	std::vector<void*> bufs;
+	for (size_t i = 0; i < burst; ++i) bufs.push_back(mp.Alloc(1000));
+	for (auto p : bufs) mp.Free(p);
+	bufs.clear();
+
+	// 首个周期的用量为整个突发, 不回收
+	Check(mp.TrimTick() == 0 && sc.keepCached == burst, "the first tick keeps the burst just used");
+
+	// 此后每个周期只用 working 块, 保留量逐周期减半, 直至不超预算
+	size_t last = mp.CachedBytes(), ticks = 0;
+	while (mp.CachedBytes() > mp.trimBudgetBytes && ticks < 20)
+	{
+		for (size_t i = 0; i < working; ++i) bufs.push_back(mp.Alloc(1000));
+		for (auto p : bufs) mp.Free(p);
+		bufs.clear();
+		auto keep = sc.keepCached / 2;
+		mp.TrimTick();
+		++ticks;
+		Check(sc.keepCached == (keep > working ? keep : working), "the kept count decays by trimDecayPercent per tick");
+		Check(mp.CachedBytes() < last && sc.cached + sc.blocksPerSpan > sc.keepCached, "each tick releases the cache above the kept count");
+		last = mp.CachedBytes();
+	}
+	Check(ticks >= 3 && ticks < 20, "the cache decays below the budget over several ticks");
+
+	// 工作集仍在缓存中( span 整体回收, 可能多回收不足一个 span 的块 )
+	Check(sc.keepCached >= working && sc.cached + sc.blocksPerSpan >= working, "the working set stays cached");
+
+	// 不超预算后不再回收
+	Check(mp.TrimTick() == 0 && mp.CachedBytes() == last, "no trimming while under budget");
+}
+
+// 大块内存: 直接映射, Realloc 就地扩容( Linux 为 mremap ), Free 即归还系统
+void TestLargeBlocks()
+{
+	xx::MemPool mp;
+	const size_t siz = 2 * 1024 * 1024;
+	auto p = (char*)mp.Alloc(siz);
+	auto h = (xx::MemHeader_VersionNumber*)p - 1;
+	Check(h->ptrStackIndex() == xx::MemPool::largeIndex, "blocks above largeAllocSize are marked large");
+	Check(mp.numLarges == 1 && mp.numLargeBytes == xx::MemPool::CalcLargeMapSize(siz + sizeof(xx::MemHeader_VersionNumber)), "large counters track the mapping");
+	auto usable = xx::MemPool::CalcUsableSize(siz);
+	Check(usable >= siz && usable < siz + 4096, "usable size is rounded up to the page");
+	for (size_t i = 0; i < usable; ++i) p[i] = char(i * 7);
+
+	// 在可用长度以内不搬家
+	Check(mp.Realloc(p, usable) == p, "Realloc within the usable size keeps the block");
+
+	// 扩容后内容不变, 映射长度随之更新
+	const size_t bigSiz = 64 * 1024 * 1024;
+	auto np = (char*)mp.Realloc(p, bigSiz);
+	size_t bad = 0;
+	for (size_t i = 0; i < usable; ++i) bad += np[i] != char(i * 7);
+	Check(np && !bad, "Realloc of a large block keeps its content");
+	Check(mp.numLarges == 1 && mp.numLargeBytes == xx::MemPool::CalcLargeMapSize(bigSiz + sizeof(xx::MemHeader_VersionNumber)), "Realloc updates numLargeBytes");
+	memset(np + usable, 1, bigSiz - usable);
+	Check(mp.CachedBytes() == 0, "large blocks never enter the free lists");
+	mp.Free(np);
+	Check(mp.numLarges == 0 && mp.numLargeBytes == 0 && mp.CachedBytes() == 0, "Free unmaps the large block");
+
+	// 小块扩成大块
+	auto sp = (char*)mp.Alloc(1000);
+	for (int i = 0; i < 1000; ++i) sp[i] = char(i);
+	sp = (char*)mp.Realloc(sp, siz);
+	bad = 0;
+	for (int i = 0; i < 1000; ++i) bad += sp[i] != char(i);
+	Check(!bad && mp.numLarges == 1, "Realloc of a small block into a large one copies the content");
+	mp.Free(sp);
+
+	// List 跨过 largeAllocSize 持续扩容
+	auto list = mp.Create<xx::List<int>>();
+	for (int i = 0; i < 4 * 1024 * 1024; ++i) list->Add(i);
+	bad = 0;
+	for (int i = 0; i < 4 * 1024 * 1024; ++i) bad += list->At(i) != i;
+	Check(!bad && mp.numLarges == 1, "a List growing past largeAllocSize keeps its items");
+	mp.Release(list);
+	Check(mp.numLarges == 0, "releasing the List unmaps its buffer");
+
+	// 其他线程 Free 大块: 直接归还系统, 计数不乱
+	std::vector<void*> bufs;
+	for (int i = 0; i < 100; ++i) bufs.push_back(mp.Alloc(siz));
+	std::thread t([&] { for (auto p : bufs) mp.Free(p); });
+	for (int i = 0; i < 100; ++i) mp.Free(mp.Alloc(siz * 2));
+	t.join();
+	Check(mp.numLarges == 0 && mp.numLargeBytes == 0, "large counters stay consistent across threads");
+}
+
+// ArenaScope: scope 内的分配不进 stack, 结束时按创建顺序析构仍存活的对象并退回切块位置
+void TestArenaScope()
+{
+	xx::MemPool mp;
+	std::vector<int> log;
+	void* firstBlock;
+	auto cached = mp.CachedBytes();
+	{
+		xx::ArenaScope scope(mp);
+		auto mark = mp.arenaCur;
+		auto n1 = mp.Create<Node>(1, &log);
+		firstBlock = n1;
+		auto n2 = mp.Create<Node>(2, &log);
+		auto n3 = mp.Create<Node>(3, &log);
+		auto n4 = mp.Create<Node>(4, &log);
+		Check(n1->memHeader().ptrStackIndex() == xx::MemPool::arenaIndex, "objects created in scope come from the arena");
+		Check(mp.arenaCur > mark, "Create bumps the arena pointer");
+
+		// 正常 Release 依然立即析构, 但不回收内存
+		mp.Release(n2);
+		Check(log.size() == 1 && log[0] == 2 && mp.CachedBytes() == cached, "Release in scope runs the destructor without recycling");
+
+		// 引用计数不为 0 的也会在 scope 结束时析构
+		n3->AddRef();
+
+		// 先创建的子对象被父对象持有: scope 结束时子对象先被析构, 父对象析构中的 Release 应被忽略
+		auto child = mp.Create<Node>(5, &log);
+		auto parent = mp.Create<Node>(6, &log);
+		parent->child = child;
+		(void)n4;
+
+		// Alloc 的块: 最后切出的块就地扩容
+		auto buf = mp.Alloc(100);
+		Check(((xx::MemHeader_VersionNumber*)buf - 1)->ptrStackIndex() == xx::MemPool::arenaIndex, "Alloc in scope comes from the arena");
+		Check(mp.Realloc(buf, 1000) == buf, "Realloc grows the last arena block in place");
+		memset(buf, 1, 1000);
+		mp.Free(buf);
+		Check(mp.CachedBytes() == cached, "Free in scope does not recycle");
+
+		// 嵌套 scope 只回收自己的对象
+		{
+			xx::ArenaScope inner(mp);
+			mp.Create<Node>(7, &log);
+			mp.Create<Node>(8, &log);
+		}
+		Check(log.size() == 3 && log[1] == 7 && log[2] == 8, "an inner scope destroys only its own objects");
+		Check(n1->versionNumber() && n3->versionNumber(), "outer objects survive the inner scope");
+		log.clear();
+	}
+	Check((log == std::vector<int>{ 1, 3, 4, 5, 6 }), "scope end destroys live objects once each, in creation order");
+
+	// 再次进入 scope 从同一位置开始切块
+	{
+		xx::ArenaScope scope(mp);
+		auto n = mp.Create<Node>(9, &log);
+		Check(n == firstBlock, "scope end rewinds the bump pointer");
+	}
+
+	// scope 结束后恢复正常分配
+	auto n = mp.Create<Node>(10, &log);
+	Check(n->memHeader().ptrStackIndex() < xx::MemPool::arenaIndex, "Create goes back to the free lists after the scope");
+	mp.Release(n);
+	Check(mp.CachedBytes() > cached, "Release after the scope recycles the block");
+}
+
+// 按 typeId 的回收链表: Release 到 0 时重置挂起, 无参 Create 与反序列化优先取用
+void TestRecycle()
+{
+	xx::MemPool mp;
+	mp.EnableRecycle<Item>(2);
+	mp.EnableRecycle<Plain>(8);
+
+	auto a = mp.Create<Item>(1);
+	xx::MPtr<Item> oldPtr = a;
+	mp.Release(a);
+	Check(Item::dtors == 0 && Item::resets == 1 && mp.recyclers[xx::TypeId<Item>::value].count == 1, "Release parks the object after Reset instead of destroying it");
+	Check(!oldPtr, "parked objects invalidate MPtr");
+
+	auto b = mp.Create<Item>();
+	Check(b == a && b->v == 0 && b->refCount() == 1 && Item::ctors == 1, "Create<T>() takes the parked object without constructing");
+	xx::MPtr<Item> newPtr = b;
+	Check(newPtr && !oldPtr, "a reused object gets a fresh version");
+
+	// 带参 Create 不取回收链表
+	mp.Release(b);
+	auto c = mp.Create<Item>(3);
+	Check(c != a && c->v == 3 && Item::ctors == 2, "Create with arguments constructs a new object");
+
+	// 超出 capacity 的直接析构
+	auto d = mp.Create<Item>(4), e = mp.Create<Item>(5);
+	mp.Release(c);
+	mp.Release(d);
+	mp.Release(e);
+	Check(mp.recyclers[xx::TypeId<Item>::value].count == 2 && Item::dtors == 2, "objects beyond the capacity are destroyed");
+
+	// 反序列化的 creator 取回收链表中的对象, 用 FromBBuffer 填充
+	xx::MemPool::Register<Item, xx::MPObject>();
+	auto bb = mp.Create<xx::BBuffer>();
+	auto src = mp.Create<Item>(42);
+	bb->WriteRoot(src);
+	Item* dst = nullptr;
+	auto ctors = Item::ctors;
+	Check(bb->ReadRoot(dst) == 0 && dst && dst->v == 42, "ReadRoot succeeds");
+	Check(Item::ctors == ctors && mp.recyclers[xx::TypeId<Item>::value].count == 1, "deserialization reuses a parked object");
+	mp.Release(dst);
+	mp.Release(src);
+
+	// 没有 Reset 的类型: 原地析构 + 默认构造
+	auto pl = mp.Create<Plain>();
+	pl->v = 7;
+	mp.Release(pl);
+	Check(Plain::dtors == 1 && Plain::ctors == 2, "types without Reset are destroyed and default-constructed in place");
+	auto pl2 = mp.Create<Plain>();
+	Check(pl2 == pl && pl2->v == 0 && Plain::ctors == 2, "the rebuilt object is handed out again");
+
+	// 其他线程 Release 的对象不回收
+	std::thread t([&] { mp.Release(pl2); });
+	t.join();
+	Check(Plain::dtors == 2 && mp.recyclers[xx::TypeId<Plain>::value].count == 0, "Release from a foreign thread destroys the object");
+	mp.DrainReturns();
+
+	// arena scope 中不取也不存
+	{
+		xx::ArenaScope scope(mp);
+		auto ai = mp.Create<Item>();
+		Check(ai->memHeader().ptrStackIndex() == xx::MemPool::arenaIndex, "Create in an arena scope ignores the recycle list");
+		mp.Release(ai);
+		Check(mp.recyclers[xx::TypeId<Item>::value].count == 2, "arena objects are never parked");
+	}
+
+	// Trim 析构所有挂起的对象
+	auto dtors = Item::dtors;
+	mp.Release(bb);
+	mp.Trim();
+	Check(Item::dtors == dtors + 2 && mp.recyclers[xx::TypeId<Item>::value].count == 0, "Trim destroys parked objects");
+}
+
+// 共享对象: 多线程同时 AddRef / Release, 最后一个 Release 的线程析构, 内存回到所属 MemPool
+void TestShared()
+{
+	xx::MemPool mp;
+	std::atomic<int> dtors{ 0 };
+	const int numThreads = 4, rounds = 100000;
+
+	auto plain = mp.Create<Msg>(&dtors);
+	Check(!plain->IsShared(), "objects are not shared by default");
+	mp.Release(plain);
+	Check(dtors == 1, "a non-shared object is destroyed by its only Release");
+	dtors = 0;
+
+	// 并发 加持 / 减持 后计数不变
+	auto m = mp.Create<Msg>(&dtors);
+	xx::MemPool::Share(m);
+	Check(m->IsShared(), "Share sets the shared flag");
+	std::vector<std::thread> ts;
+	for (int i = 0; i < numThreads; ++i) ts.emplace_back([m]
+	{
+		for (int j = 0; j < rounds; ++j)
+		{
+			m->AddRef();
+			m->mempool().Release(m);
+		}
+	});
+	for (auto& t : ts) t.join();
+	ts.clear();
+	Check((m->refCount() & ~xx::MemHeader_MPObject::sharedFlag) == 1 && dtors == 0, "concurrent AddRef/Release keep the count");
+
+	// 各线程与所属线程抢最后一次 Release: 恰好析构一次
+	auto idx = m->memHeader().ptrStackIndex();
+	auto stackLen = StackLen(mp.ptrstacks[idx]);
+	for (int i = 0; i < numThreads; ++i) m->AddRef();
+	for (int i = 0; i < numThreads; ++i) ts.emplace_back([m] { m->mempool().Release(m); });
+	mp.Release(m);
+	for (auto& t : ts) t.join();
+	ts.clear();
+	Check(dtors == 1, "the last Release destroys a shared object exactly once");
+	mp.DrainReturns();
+	Check(StackLen(mp.ptrstacks[idx]) == stackLen + 1, "the block goes back to the owner pool");
+
+	// SharedType: Create 出来即为共享对象, 回收链表取出的也是
+	auto sm = mp.Create<SharedMsg>(&dtors);
+	Check(sm->IsShared() && (sm->refCount() & ~xx::MemHeader_MPObject::sharedFlag) == 1, "SharedType objects are created shared");
+	sm->AddRef();
+	std::thread([sm] { sm->mempool().Release(sm); }).join();
+	Check(dtors == 1, "a shared object survives a foreign Release while still held");
+	mp.Release(sm);
+	Check(dtors == 2, "the owner's final Release destroys it");
+
+	mp.EnableRecycle<SharedMsg>(1);
+	auto r1 = mp.Create<SharedMsg>();
+	mp.Release(r1);
+	auto r2 = mp.Create<SharedMsg>();
+	Check(r2 == r1 && r2->IsShared(), "reused SharedType objects are shared again");
+	mp.Release(r2);
+
+	// arena 对象不共享
+	{
+		xx::ArenaScope scope(mp);
+		auto am = mp.Create<SharedMsg>(&dtors);
+		Check(!am->IsShared(), "arena objects are never shared");
+	}
+	mp.EnableRecycle<SharedMsg>(0);
+}
+
+// 句柄表: 对象死亡后旧句柄失效, 槽位 FIFO 复用且代数递增
+void TestHandles()
+{
+	xx::MemPool mp;
+	auto gen = [](uint32_t h) { return h >> xx::MemPool::handleIndexBits; };
+	auto slot = [](uint32_t h) { return h & xx::MemPool::handleIndexMask; };
+
+	auto a = mp.Create<Item>(1);
+	auto h1 = mp.MakeHandle(a);
+	Check(h1 && gen(h1) && mp.MakeHandle(a) == h1, "MakeHandle returns one non-zero handle per object");
+	Check(mp.FromHandle(h1) == a && mp.FromHandle<Item>(h1) == a, "FromHandle resolves a live object");
+	Check(mp.FromHandle<Foo>(h1) == nullptr && mp.FromHandle<xx::MPObject>(h1) == a, "FromHandle<T> checks the cached typeId");
+
+	// 持有句柄不影响引用计数语义
+	a->AddRef();
+	mp.Release(a);
+	Check(mp.FromHandle(h1) == a && (a->refCount() & xx::MemHeader_MPObject::refCountMask) == 1, "a handle survives a non-final Release");
+	mp.Release(a);
+	Check(mp.FromHandle(h1) == nullptr && mp.numHandles == 0, "the final Release invalidates the handle");
+
+	// 同一槽位再次分配时代数 +1, 旧句柄依然无效
+	auto b = mp.Create<Item>(2);
+	auto h2 = mp.MakeHandle(b);
+	Check(slot(h2) == slot(h1) && gen(h2) == gen(h1) + 1, "a reused slot gets the next generation");
+	Check(mp.FromHandle(h1) == nullptr && mp.FromHandle(h2) == b, "only the newest handle of a slot resolves");
+
+	// 空闲槽位按 FIFO 复用
+	auto c = mp.Create<Item>(3), d = mp.Create<Item>(4);
+	auto hc = mp.MakeHandle(c), hd = mp.MakeHandle(d);
+	mp.Release(b);
+	mp.Release(d);
+	mp.Release(c);
+	auto e = mp.Create<Item>(5), f = mp.Create<Item>(6);
+	auto he = mp.MakeHandle(e), hf = mp.MakeHandle(f);
+	Check(slot(he) == slot(h2) && slot(hf) == slot(hd) && slot(hc) != slot(hf), "free slots are reused first in, first out");
+	mp.Release(e);
+	mp.Release(f);
+
+	// 代数回绕时跳过 0, 句柄永不为 0. 先占住其余空闲槽位, 令循环一直命中同一槽位
+	auto g1 = mp.Create<Item>(7), g2 = mp.Create<Item>(8);
+	mp.MakeHandle(g1);
+	mp.MakeHandle(g2);
+	uint32_t last = 0, wraps = 0;
+	bool sameSlot = true, stepOk = true;
+	for (int i = 0; i < (1 << (32 - xx::MemPool::handleIndexBits)) + 10; ++i)
+	{
+		auto o = mp.Create<Item>(i);
+		auto h = mp.MakeHandle(o);
+		if (last)
+		{
+			sameSlot &= slot(h) == slot(last);
+			if (gen(h) == 1) ++wraps;
+			else stepOk &= gen(h) == gen(last) + 1;
+		}
+		stepOk &= h != 0 && gen(h) != 0;
+		last = h;
+		mp.Release(o);
+	}
+	Check(sameSlot && stepOk && wraps == 1, "generations count up and wrap around without producing 0");
+	mp.Release(g1);
+	mp.Release(g2);
+
+	// 大量句柄: 句柄表与地址表扩容后依然正确
+	std::vector<Item*> items;
+	std::vector<xx::Handle<Item>> hs;
+	for (int i = 0; i < 100000; ++i)
+	{
+		items.push_back(mp.Create<Item>(i));
+		hs.emplace_back(mp, items.back());
+	}
+	for (size_t i = 0; i < items.size(); i += 2) mp.Release(items[i]);
+	size_t bad = 0;
+	for (size_t i = 0; i < hs.size(); ++i)
+	{
+		auto p = hs[i].Ensure(mp);
+		bad += (i & 1) ? (p != items[i] || p->v != (int)i) : (p != nullptr);
+	}
+	Check(!bad && mp.numHandles == 50000, "100k handles resolve correctly after half the objects die");
+
+	// Handle 按 uint32 变长序列化
+	auto bb = mp.Create<xx::BBuffer>();
+	auto bb2 = mp.Create<xx::BBuffer>();
+	bb->Write(hs[1]);
+	bb2->Write(hs[1].value);
+	xx::Handle<Item> rh;
+	Check(bb->dataLen == bb2->dataLen && !memcmp(bb->buf, bb2->buf, bb->dataLen), "Handle is written as a varint uint32");
+	Check(bb->Read(rh) == 0 && rh == hs[1], "Handle round-trips through BBuffer");
+	mp.Release(bb);
+	mp.Release(bb2);
+	for (size_t i = 1; i < items.size(); i += 2) mp.Release(items[i]);
+	Check(mp.numHandles == 0, "all handles are gone with their objects");
+}
+
+// 沿父类型链逐级比对( 即改用 DFS 区间编号之前的 IsBaseOf ), 作为对照
+inline bool IsBaseOfWalk(uint32_t baseTypeId, uint32_t typeId)
+{
+	auto& ps = xx::MemPool::pids();
+	for (; typeId != baseTypeId; typeId = ps[typeId])
+	{
+		if (!typeId || typeId == ps[typeId]) return false;
+	}
+	return true;
+}
+
+template<int depth>
+void RegisterLevels()
+{
+	if constexpr (depth == 0)
+	{
+		xx::MemPool::Register<Level<0>, xx::MPObject>();
+	}
+	else
+	{
+		RegisterLevels<depth - 1>();
+		xx::MemPool::Register<Level<depth>, Level<depth - 1>>();
+	}
+}
+
+// IsBaseOf: 与逐级比对的结果逐一核对( 含未注册的 typeId 和 0 ), 并对比耗时
+void TestIsBaseOf()
+{
+	xx::MemPool mp;
+	xx::Stopwatch sw;
+
+	// 注册 maxDepth + 1 个类型. typeRanges 只在首次 IsBaseOf 时重建一次
+	RegisterLevels<maxDepth>();
+	Check(xx::MemPool::typeRangesDirty(), "Register only marks typeRanges dirty");
+	Check((xx::MemPool::IsBaseOf<Level<0>, Level<1>>()), "IsBaseOf sees a new registration");
+	Check(!xx::MemPool::typeRangesDirty(), "the first IsBaseOf rebuilds typeRanges");
+	mp.Cout("Register x ", maxDepth + 1, " + first IsBaseOf: ", sw.micros(), " us\n");
+
+	// 对照: 每次 Register 都重建( 改为延迟重建之前的做法 )
+	for (int i = 0; i <= maxDepth; ++i) xx::MemPool::BuildTypeRanges();
+	mp.Cout("BuildTypeRanges x ", maxDepth + 1, ": ", sw.micros(), " us\n");
+
+	size_t bad = 0;
+	for (uint32_t b = 0; b < 230; ++b)
+	{
+		for (uint32_t t = 0; t < 230; ++t)
+		{
+			bad += xx::MemPool::IsBaseOf(b, t) != IsBaseOfWalk(b, t);
+		}
+	}
+	Check(!bad, "IsBaseOf matches the parent-chain walk");
+
+	// 耗时对比. typeId 经 volatile 读取, 防止调用被提到循环外
+	const int count = 20000000;
+	const uint32_t baseTypeId = xx::TypeId<Level<0>>::value;
+	for (int depth = 1; depth <= maxDepth; depth *= 2)
+	{
+		volatile uint32_t typeId = baseTypeId + depth;
+		int64_t n = 0;
+		sw.Reset();
+		for (int i = 0; i < count; ++i) n += IsBaseOfWalk(baseTypeId, typeId);
+		auto walkMS = sw();
+		for (int i = 0; i < count; ++i) n += xx::MemPool::IsBaseOf(baseTypeId, typeId);
+		auto rangeMS = sw();
+		mp.Cout("IsBaseOf depth ", depth, ": walk ", walkMS, " ms, range ", rangeMS, " ms ( ", n, " )\n");
+	}
+}
+
+int main()
+{
+	TestCrossThreadFree();
+	TestConcurrentReturns();
+	TestTrim();
+	TestTrimTick();
+	TestLargeBlocks();
+	TestArenaScope();
+	TestRecycle();
+	TestShared();
+	TestHandles();
+	TestIsBaseOf();
+	std::cout << (errors ? "FAILED" : "ok") << std::endl;
+	return errors;
+}
@@ -0,0 +1,1239 @@
+﻿#include "xx_mempool.h"
+#include "xx_bbuffer.h"
+#include "xx_bbqueue.h"
+#include "pkg/PKG_class.h"
+#include <iostream>
+#include <vector>
+#include <random>
+#include <memory>
+#include <algorithm>
+
+// 序列化行为测试与耗时对比. 返回值为失败项数
+
+// 以原始内存方式序列化的 POD 结构体
+struct Vec
+{
+	float x, y;
+	int32_t n;
+	uint8_t f;
+};
+namespace xx
+{
+	template<> struct BytesMemcpy<Vec> { static const bool value = true; };
+}
+
+// BBQueue::PopTo 弹出的一段数据( 同 uv_buf_t / iovec )
+struct IoVec
+{
+	char* base;
+	uint32_t len;
+};
+namespace xx
+{
+	template<> struct BufMaker<IoVec, void>
+	{
+		static IoVec Make(char* buf, uint32_t len) { return IoVec{ buf, len }; }
+	};
+}
+
+int errors = 0;
+inline void Check(bool ok, char const* what)
+{
+	if (ok) return;
+	++errors;
+	std::cout << "FAILED: " << what << std::endl;
+}
+
+
+/***********************************************************************************/
+// 整数数组批量变长读写( SIMD 整块 + 逐个快速路径 ) 与 逐个 VarWrite7 / VarRead7
+// 定义 XX_NO_SIMD 编译可测不带 SSE2 / AVX2 的部分
+/***********************************************************************************/
+
+// 各种编码长度混合的随机整数( 单字节, 两三字节, 负数, 单个高位, 满位 )
+template<typename T>
+T RandomVarInt(std::mt19937_64& rnd)
+{
+	auto r = rnd();
+	switch (r % 6)
+	{
+	case 0: return (T)(r >> 58);
+	case 1: return (T)((int64_t)(r >> 40) - (1 << 23));
+	case 2: return (T)(1ULL << (rnd() % 64));
+	case 3: return (T)(-(int64_t)(rnd() % 200));
+	case 4: return (T)rnd();
+	default: return (T)(r % 128);
+	}
+}
+
+template<typename T>
+void TestVarInts(xx::MemPool& mp)
+{
+	std::mt19937_64 rnd(123);
+	xx::BBuffer_v bb1(mp), bb2(mp);
+	std::vector<T> vs, rs1, rs2;
+	int diffBytes = 0, diffReads = 0;
+	for (int round = 0; round < 3000; ++round)
+	{
+		uint32_t len = rnd() % 400;
+		bool small = rnd() % 3 == 0;		// 全为单字节值时走 16 个一块的整块编解码
+		vs.resize(len);
+		for (auto& v : vs) v = small ? (T)(rnd() % 60) : RandomVarInt<T>(rnd);
+
+		bb1->Clear();
+		bb2->Clear();
+		for (auto& v : vs) bb1->Write(v);
+		bb2->WriteVarInts(vs.data(), len);
+		if (bb1->dataLen != bb2->dataLen || memcmp(bb1->buf, bb2->buf, bb1->dataLen))
+		{
+			++diffBytes;
+			continue;
+		}
+
+		// 截断 或 篡改( 令某值变长 / 溢出 )后, 两种读法的返回值, offset, 已读出的值 均须一致
+		auto dataLen = bb1->dataLen;
+		if (rnd() % 4 == 0) dataLen = (uint32_t)(rnd() % (dataLen + 1));
+		if (rnd() % 5 == 0 && dataLen) bb1->buf[rnd() % dataLen] |= 0x80;
+		bb1->dataLen = dataLen;
+		rs1.assign(len, 0);
+		rs2.assign(len, 0);
+		int e1 = 0;
+		uint32_t n = 0;
+		bb1->offset = 0;
+		for (; n < len; ++n)
+		{
+			if ((e1 = bb1->Read(rs1[n]))) break;
+		}
+		auto offset1 = bb1->offset;
+		bb1->offset = 0;
+		int e2 = bb1->ReadVarInts(rs2.data(), len);
+		diffReads += e1 != e2 || offset1 != bb1->offset || memcmp(rs1.data(), rs2.data(), n * sizeof(T));
+	}
+	Check(!diffBytes, "WriteVarInts matches per-element Write byte for byte");
+	Check(!diffReads, "ReadVarInts matches per-element Read on intact, truncated and corrupted input");
+
+	// List<T> 走批量读写
+	xx::List_v<T> l1(mp), l2(mp);
+	for (int i = 0; i < 1000; ++i) l1->Add(RandomVarInt<T>(rnd));
+	bb1->Clear();
+	bb1->WriteRoot(l1);
+	bb1->offset = 0;
+	Check(!l2->FromBBuffer(*bb1) && l2->dataLen == l1->dataLen && !memcmp(l1->buf, l2->buf, l1->dataLen * sizeof(T)), "List<T> round-trips through the batch path");
+	bb1->dataLen = 3;
+	bb1->offset = 0;
+	Check(l2->FromBBuffer(*bb1) != 0, "a truncated List<T> fails to read");
+}
+
+template<typename T>
+void BenchVarInts(xx::MemPool& mp, char const* name, bool small)
+{
+	const int count = 20000;
+	std::mt19937_64 rnd(123);
+	std::vector<T> vs(1000), rs(1000);
+	for (auto& v : vs) v = small ? (T)(rnd() % 100) : RandomVarInt<T>(rnd);
+	xx::BBuffer_v bb(mp);
+	xx::Stopwatch sw;
+	for (int i = 0; i < count; ++i)
+	{
+		bb->Clear();
+		for (auto& v : vs) bb->Write(v);
+	}
+	auto writeMS = sw();
+	for (int i = 0; i < count; ++i)
+	{
+		bb->offset = 0;
+		for (auto& r : rs) bb->Read(r);
+	}
+	auto readMS = sw();
+	for (int i = 0; i < count; ++i)
+	{
+		bb->Clear();
+		bb->WriteVarInts(vs.data(), (uint32_t)vs.size());
+	}
+	auto batchWriteMS = sw();
+	for (int i = 0; i < count; ++i)
+	{
+		bb->offset = 0;
+		bb->ReadVarInts(rs.data(), (uint32_t)rs.size());
+	}
+	auto batchReadMS = sw();
+	mp.Cout(name, (small ? " small" : " mixed"), " x 1000 x ", count, ": write ", writeMS, " ms, read ", readMS
+		, " ms | batch write ", batchWriteMS, " ms, read ", batchReadMS, " ms\n");
+}
+
+
+/***********************************************************************************/
+// memcpy 线格式: BytesMemcpy 结构体 与 List<float> / List<BytesMemcpy> 整块 memcpy
+/***********************************************************************************/
+
+void TestMemcpyWire(xx::MemPool& mp)
+{
+	xx::BBuffer_v bb(mp);
+
+	// 单个值: 定长 sizeof(T), 即内存映像
+	Vec v{ 1.5f, -2.25f, -7, 200 };
+	bb->Write(v);
+	Check(bb->dataLen == sizeof(Vec) && !memcmp(bb->buf, &v, sizeof(Vec)), "a BytesMemcpy value is written as its memory image");
+	Vec rv{};
+	Check(bb->Read(rv) == 0 && !memcmp(&rv, &v, sizeof(Vec)) && bb->offset == sizeof(Vec), "a BytesMemcpy value reads back");
+	bb->offset = 1;
+	Check(bb->Read(rv) != 0, "a truncated BytesMemcpy value fails to read");
+
+	// List<Vec>: 长度 + 一整块
+	xx::List_v<Vec> vs(mp), rvs(mp);
+	for (int i = 0; i < 1000; ++i) vs->Add(Vec{ i * 0.5f, -i * 0.25f, i - 500, (uint8_t)i });
+	bb->Clear();
+	bb->Write(vs);
+	uint32_t prefix = 2;												// 1000 的变长编码
+	Check(bb->dataLen == prefix + vs->dataLen * sizeof(Vec) && !memcmp(bb->buf + prefix, vs->buf, vs->dataLen * sizeof(Vec)), "List<BytesMemcpy> is a length plus one memcpy block");
+	bb->offset = 0;
+	Check(bb->Read(rvs) == 0 && rvs->dataLen == vs->dataLen && !memcmp(rvs->buf, vs->buf, vs->dataLen * sizeof(Vec)), "List<BytesMemcpy> reads back");
+
+	// List<float>: 每个元素 4 字节( 以前只复制了 dataLen 字节 )
+	xx::List_v<float> fs(mp), rfs(mp);
+	for (int i = 0; i < 100; ++i) fs->Add(i * 1.25f - 3);
+	bb->Clear();
+	bb->Write(fs);
+	Check(bb->dataLen == 1 + 100 * sizeof(float) && !memcmp(bb->buf + 1, fs->buf, 100 * sizeof(float)), "List<float> writes 4 bytes per item");
+	bb->offset = 0;
+	Check(bb->Read(rfs) == 0 && rfs->dataLen == 100 && !memcmp(rfs->buf, fs->buf, 100 * sizeof(float)), "List<float> reads back every item");
+
+	// 1 字节元素的格式不变
+	xx::List_v<uint8_t> bs(mp);
+	for (int i = 0; i < 10; ++i) bs->Add((uint8_t)i);
+	bb->Clear();
+	bb->Write(bs);
+	Check(bb->dataLen == 11 && bb->buf[0] == 10 && !memcmp(bb->buf + 1, bs->buf, 10), "List<uint8_t> keeps one byte per item");
+
+	// 越界: 截断 或 长度超大( len * sizeof(T) 不应回绕 )
+	bb->Clear();
+	bb->Write(vs);
+	bb->dataLen -= 1;
+	bb->offset = 0;
+	Check(bb->Read(rvs) != 0, "a truncated List<BytesMemcpy> fails to read");
+	bb->Clear();
+	bb->Write((uint32_t)(0xFFFFFFFFu / sizeof(Vec) + 1));
+	bb->Write(v);
+	bb->offset = 0;
+	Check(bb->Read(rvs) != 0, "a List length whose byte size overflows 32 bits is rejected");
+}
+
+
+/***********************************************************************************/
+// StringView / BytesView: 指向读缓冲, 不分配; 回引; 越界
+/***********************************************************************************/
+
+inline bool InBuf(xx::BBuffer_v const& bb, char const* p)
+{
+	return p >= bb->buf && p < bb->buf + bb->dataLen;
+}
+
+void TestViews(xx::MemPool& mp)
+{
+	xx::BBuffer_v bb(mp);
+	auto s = mp.Create<xx::String>("hello");
+	auto b = mp.Create<xx::BBuffer>();
+	b->Write((uint32_t)12345);
+	b->Write((int8_t)-1);
+
+	// 写 String* / BBuffer* 读视图: 数据就在读缓冲里
+	bb->BeginWrite();
+	bb->Write(s);
+	bb->Write(b);
+	bb->Write((xx::String*)nullptr);
+	bb->EndWrite();
+	xx::StringView sv, nv;
+	xx::BytesView bv;
+	bb->BeginRead();
+	auto r = bb->Read(sv);
+	if (!r) r = bb->Read(bv);
+	if (!r) r = bb->Read(nv);
+	bb->EndRead();
+	Check(!r && bb->offset == bb->dataLen, "String* / BBuffer* / nullptr read back as views");
+	Check(sv && sv.dataLen == 5 && !memcmp(sv.buf, "hello", 5) && InBuf(bb, sv.buf), "a StringView points into the read buffer");
+	Check(bv && bv.dataLen == b->dataLen && !memcmp(bv.buf, b->buf, b->dataLen) && InBuf(bb, bv.buf), "a BytesView points into the read buffer");
+	Check(!nv && !nv.buf && !nv.dataLen, "a null pointer reads back as an empty view");
+
+	// 视图写出与 String* 写出线格式相同
+	xx::BBuffer_v bb2(mp);
+	bb2->BeginWrite();
+	bb2->Write(sv);
+	bb2->Write(bv);
+	bb2->Write(nv);
+	bb2->EndWrite();
+	Check(bb2->dataLen == bb->dataLen && !memcmp(bb2->buf, bb->buf, bb->dataLen), "writing views produces the same bytes as writing the objects");
+
+	// Materialize: 复制数据, 源缓冲变化 / 释放后仍有效
+	auto ms = sv.Materialize(mp);
+	auto mb = bv.Materialize(mp);
+	Check(nv.Materialize(mp) == nullptr, "materializing an empty view yields nullptr");
+	memset(bb->buf, 0, bb->dataLen);
+	bb->Clear();
+	bb->Reserve(bb->bufLen * 4);
+	Check(ms && ms->dataLen == 5 && !memcmp(ms->buf, "hello", 5) && ms->buf != sv.buf, "a materialized String owns a copy of the view data");
+	Check(mb && mb->dataLen == b->dataLen && !memcmp(mb->buf, b->buf, b->dataLen), "a materialized BBuffer owns a copy of the view data");
+	ms->Release();
+	mb->Release();
+
+	// 回引: 先读 String* 再读视图 -> 视图指向该对象; 视图回引视图 -> 重新定位到同一段数据
+	bb->Clear();
+	bb->BeginWrite();
+	bb->Write(s);
+	bb->Write(s);
+	bb->Write(s);
+	bb->EndWrite();
+	bb->offset = 0;
+	xx::String* rs = nullptr;
+	xx::StringView v1, v2;
+	bb->BeginRead();
+	r = bb->Read(rs);
+	if (!r) r = bb->Read(v1);
+	if (!r) r = bb->Read(v2);
+	bb->EndRead();
+	Check(!r && rs && v1.buf == rs->buf && v2.buf == rs->buf && v1.dataLen == 5, "a view may reference an earlier String*");
+	if (rs) rs->Release();
+	bb->offset = 0;
+	bb->BeginRead();
+	r = bb->Read(v1);
+	if (!r) r = bb->Read(v2);
+	bb->EndRead();
+	Check(!r && InBuf(bb, v1.buf) && v2.buf == v1.buf && v2.dataLen == 5, "a view may reference an earlier view");
+
+	// 之后出现的 String* 不可引用视图读出的数据
+	bb->offset = 0;
+	rs = nullptr;
+	bb->BeginRead();
+	r = bb->Read(v1);
+	if (!r) r = bb->Read(rs);
+	bb->EndRead();
+	Check(r == -4, "a String* referencing view data is rejected");
+	if (rs) rs->Release();
+
+	// 类型不符
+	bb->offset = 0;
+	bb->BeginRead();
+	r = bb->Read(bv);
+	bb->EndRead();
+	Check(r == -2, "a BytesView rejects a String on the wire");
+
+	// 越界: 截断 / 长度接近 4G( 不应回绕 ) / readLengthLimit / 向前的回引
+	bb->Clear();
+	bb->WriteRoot(s);
+	for (uint32_t len = 1; len < bb->dataLen; ++len)
+	{
+		xx::BBuffer_v t(mp);
+		t->WriteBuf(bb->buf, len);
+		t->BeginRead();
+		r = t->Read(v1);
+		t->EndRead();
+		if (!r) break;
+	}
+	Check(r != 0, "every truncation of a view fails to read");
+
+	bb->Clear();
+	bb->WritePods((uint16_t)xx::TypeId<xx::String>::value);
+	bb->WritePods(bb->dataLen);											// 自身偏移: 数据紧随其后
+	bb->WritePods((uint32_t)0xFFFFFFF0u);
+	bb->WriteBuf("abcdefgh", 8);
+	bb->offset = 0;
+	bb->BeginRead();
+	r = bb->Read(v1);
+	bb->EndRead();
+	Check(r == -2 && bb->offset <= bb->dataLen, "a length near 4G does not wrap the bounds check");
+
+	bb->Clear();
+	bb->WriteRoot(s);
+	bb->offset = 0;
+	bb->readLengthLimit = 4;
+	bb->BeginRead();
+	r = bb->Read(v1);
+	bb->EndRead();
+	bb->readLengthLimit = 0;
+	Check(r == -1, "readLengthLimit applies to views");
+
+	bb->Clear();
+	bb->WritePods((uint16_t)xx::TypeId<xx::String>::value);
+	bb->WritePods((uint32_t)100);
+	bb->offset = 0;
+	bb->BeginRead();
+	r = bb->Read(v1);
+	bb->EndRead();
+	Check(r == -4, "a view referencing a forward offset is rejected");
+
+	// ToString
+	xx::String_v str(mp);
+	str->Append(xx::StringView(s), " ", xx::StringView());
+	Check(str->dataLen == 11 && !memcmp(str->buf, "\"hello\" nil", 11), "StringView ToString quotes the text and prints nil for empty");
+
+	s->Release();
+	b->Release();
+}
+
+
+/***********************************************************************************/
+// WriteRoot / ReadRoot: 指针去重 与 不去重
+/***********************************************************************************/
+
+PKG::UserInfo* MakeUser(xx::MemPool& mp, int i)
+{
+	auto u = mp.Create<PKG::UserInfo>();
+	u->id = i;
+	mp.CreateTo(u->props);
+	auto p1 = mp.Create<PKG::Property_long>();
+	mp.CreateTo(p1->name, "level");
+	p1->value = i * 3;
+	u->props->Add(p1);
+	auto p2 = mp.Create<PKG::Property_string>();
+	mp.CreateTo(p2->name, "nick");
+	mp.CreateTo(p2->value, "player_name");
+	u->props->Add(p2);
+	auto p3 = mp.Create<PKG::Property_double>();
+	mp.CreateTo(p3->name, "score");
+	p3->value = i * 1.5;
+	u->props->Add(p3);
+	return u;
+}
+
+// 带 n 个用户的 JoinSuccess( 树形, 无共享引用 )
+PKG::Server_Client::JoinSuccess* MakeJoinSuccess(xx::MemPool& mp, int n)
+{
+	auto o = mp.Create<PKG::Server_Client::JoinSuccess>();
+	o->requestSerial = 9;
+	o->self = MakeUser(mp, 0);
+	mp.CreateTo(o->users);
+	for (int i = 1; i <= n; ++i) o->users->Add(MakeUser(mp, i));
+	return o;
+}
+
+// 以 ToString 的结果比较两个对象
+bool SameContent(xx::MemPool& mp, xx::MPObject const* a, xx::MPObject const* b)
+{
+	if (!a || !b) return a == b;
+	xx::String_v sa(mp), sb(mp);
+	a->ToString(*sa);
+	b->ToString(*sb);
+	return sa->dataLen == sb->dataLen && !memcmp(sa->buf, sb->buf, sa->dataLen);
+}
+
+void TestDedup(xx::MemPool& mp)
+{
+	xx::BBuffer_v bb(mp);
+	auto js = MakeJoinSuccess(mp, 20);
+
+	// 树形数据两种模式都应原样读回. 不去重的少写每个指针的 offset
+	uint32_t lens[2];
+	for (int dedup = 0; dedup < 2; ++dedup)
+	{
+		bb->Clear();
+		bb->offset = 0;
+		bb->WriteRoot(js, dedup != 0);
+		lens[dedup] = bb->dataLen;
+		PKG::Server_Client::JoinSuccess* r = nullptr;
+		Check(!bb->ReadRoot(r, dedup != 0) && bb->offset == bb->dataLen && SameContent(mp, js, r)
+			, dedup ? "a tree reads back unchanged with dedup" : "a tree reads back unchanged without dedup");
+		mp.SafeRelease(r);
+	}
+	Check(lens[0] < lens[1], "the no-dedup encoding is smaller");
+	bb->Clear();
+	bb->WriteRoot(js);
+	Check(bb->dataLen == lens[xx::MemPool::noPtrDedups()[js->typeId()] ? 0 : 1], "WriteRoot picks the mode from the root type");
+
+	// 共享引用只有去重模式能保留
+	js->users->Add(js->self);
+	bb->Clear();
+	bb->offset = 0;
+	bb->WriteRoot(js, true);
+	PKG::Server_Client::JoinSuccess* r = nullptr;
+	Check(!bb->ReadRoot(r, true) && r && r->users->Top() == r->self && SameContent(mp, js, r), "a shared reference keeps its identity with dedup");
+	mp.SafeRelease(r);
+	js->users->Pop();
+
+	// 不去重的数据被截断时须读失败而不是越界
+	bb->Clear();
+	bb->WriteRoot(js, false);
+	auto fullLen = bb->dataLen;
+	int succeeded = 0;
+	for (uint32_t len = 0; len < fullLen; ++len)
+	{
+		bb->dataLen = len;
+		bb->offset = 0;
+		r = nullptr;
+		if (!bb->ReadRoot(r, false)) ++succeeded;
+		mp.SafeRelease(r);
+	}
+	Check(!succeeded, "every truncation of a no-dedup package fails to read");
+
+	mp.Release(js);
+}
+
+// 不去重写入的长度上限与预留: 新 BBuffer 一次预留到位, 预留与否写出的数据都相同
+void TestPreSize(xx::MemPool& mp)
+{
+	auto js = MakeJoinSuccess(mp, 20);
+	xx::BBuffer_v checked(mp);
+	checked->WriteRoot(js, false);										// 记下 lastRootLen
+	checked->Reserve(checked->dataLen * 4);
+	checked->Clear();
+	checked->WriteRoot(js, false);										// 空间足够: 跳过预算, 逐个检查
+
+	xx::BBuffer_v fresh(mp);
+	auto bound = xx::BBuffer::CalcWriteSize(js);
+	fresh->WriteRoot(js, false);
+	Check(bound >= fresh->dataLen && fresh->bufLen >= bound && fresh->bufLen < bound * 2, "a fresh buffer is reserved once from the bound");
+	Check(fresh->dataLen == checked->dataLen && !memcmp(fresh->buf, checked->buf, fresh->dataLen), "pre-sized and checked writes produce the same bytes");
+
+	PKG::Server_Client::JoinSuccess* r = nullptr;
+	fresh->offset = 0;
+	Check(!fresh->ReadRoot(r, false) && SameContent(mp, js, r), "a pre-sized package reads back");
+	mp.SafeRelease(r);
+
+	// 写在已有数据之后, 不影响之前的数据
+	xx::BBuffer_v bb(mp);
+	bb->Write((uint32_t)123456789);
+	bb->WriteRoot(js, false);
+	Check(bb->dataLen == 4 + fresh->dataLen && !memcmp(bb->buf + 4, fresh->buf, fresh->dataLen), "a root appended after other data is written intact");
+
+	// 空指针 与 空容器
+	js->users->Clear();
+	mp.SafeRelease(js->self);
+	Check(xx::BBuffer::CalcWriteSize(js) < xx::BBufferSizeUnknown && xx::BBuffer::CalcWriteSize((PKG::Server_Client::JoinSuccess*)nullptr) == 1, "the bound covers nullptr fields and empty lists");
+	mp.Release(js);
+}
+
+void BenchDedup(xx::MemPool& mp)
+{
+	const int count = 20000;
+	xx::BBuffer_v bb(mp);
+	auto js = MakeJoinSuccess(mp, 20);
+	xx::Stopwatch sw;
+	for (int dedup = 1; dedup >= 0; --dedup)
+	{
+		sw.Reset();
+		for (int i = 0; i < count; ++i)
+		{
+			bb->Clear();
+			bb->WriteRoot(js, dedup != 0);
+		}
+		auto writeMS = sw();
+		for (int i = 0; i < count; ++i)
+		{
+			bb->offset = 0;
+			PKG::Server_Client::JoinSuccess* r = nullptr;
+			bb->ReadRoot(r, dedup != 0);
+			mp.SafeRelease(r);
+		}
+		auto readMS = sw();
+		mp.Cout("JoinSuccess x ", count, (dedup ? " dedup: write " : " no dedup: write "), writeMS, " ms, read ", readMS, " ms, ", bb->dataLen, " bytes\n");
+	}
+	mp.Release(js);
+}
+
+// 写包: 每轮新建 BBuffer 与 复用 BBuffer, 去重 与 不去重
+void BenchWritePackage(xx::MemPool& mp, int n, int count)
+{
+	auto js = MakeJoinSuccess(mp, n);
+	xx::BBuffer_v bb(mp);
+	xx::Stopwatch sw;
+	int64_t ms[2][2];
+	for (int dedup = 1; dedup >= 0; --dedup)
+	{
+		sw.Reset();
+		for (int i = 0; i < count; ++i)
+		{
+			xx::BBuffer_v fresh(mp);
+			fresh->BeginWritePackage<uint32_t>();
+			fresh->WriteRoot(js, dedup != 0);
+			fresh->EndWritePackage<uint32_t>();
+		}
+		ms[dedup][0] = sw();
+		for (int i = 0; i < count; ++i)
+		{
+			bb->Clear();
+			bb->BeginWritePackage<uint32_t>();
+			bb->WriteRoot(js, dedup != 0);
+			bb->EndWritePackage<uint32_t>();
+		}
+		ms[dedup][1] = sw();
+	}
+	mp.Cout("WritePackage JoinSuccess ", n, " users x ", count, ": dedup fresh ", ms[1][0], " ms, reused ", ms[1][1]
+		, " ms | no dedup fresh ", ms[0][0], " ms, reused ", ms[0][1], " ms\n");
+	mp.Release(js);
+}
+
+
+/***********************************************************************************/
+// 所有叶子 PKG 类型: 两种模式往返 与 吞吐
+/***********************************************************************************/
+
+// 每个叶子 PKG 类型一个对象( 均为树形 )
+std::vector<std::pair<char const*, xx::MPObject*>> MakeAllTypes(xx::MemPool& mp)
+{
+	std::vector<std::pair<char const*, xx::MPObject*>> os;
+	{
+		auto o = mp.Create<PKG::Property_long>();
+		mp.CreateTo(o->name, "n");
+		o->value = 123456789;
+		os.emplace_back("Property_long", o);
+	}
+	{
+		auto o = mp.Create<PKG::Property_double>();
+		mp.CreateTo(o->name, "n");
+		o->value = 1.25;
+		os.emplace_back("Property_double", o);
+	}
+	{
+		auto o = mp.Create<PKG::Property_string>();
+		mp.CreateTo(o->name, "n");
+		mp.CreateTo(o->value, "value");
+		os.emplace_back("Property_string", o);
+	}
+	{
+		auto o = mp.Create<PKG::Properties>();
+		mp.CreateTo(o->name, "n");
+		mp.CreateTo(o->value);
+		for (int i = 0; i < 4; ++i)
+		{
+			auto p = mp.Create<PKG::Property_long>();
+			mp.CreateTo(p->name, "k");
+			p->value = i;
+			o->value->Add(p);
+		}
+		os.emplace_back("Properties", o);
+	}
+	os.emplace_back("UserInfo", MakeUser(mp, 7));
+	{
+		auto o = MakeJoinSuccess(mp, 10);
+		os.emplace_back("JoinSuccess", o);
+	}
+	{
+		auto o = mp.Create<PKG::Server_Client::JoinFail>();
+		o->requestSerial = 9;
+		mp.CreateTo(o->reason, "bad password");
+		os.emplace_back("JoinFail", o);
+	}
+	{
+		auto o = mp.Create<PKG::Server_Client::PushJoin>();
+		o->id = 42;
+		os.emplace_back("PushJoin", o);
+	}
+	{
+		auto o = mp.Create<PKG::Server_Client::PushMessage>();
+		o->id = 42;
+		mp.CreateTo(o->text, "hello world");
+		os.emplace_back("PushMessage", o);
+	}
+	{
+		auto o = mp.Create<PKG::Server_Client::PushLogout>();
+		o->id = 42;
+		mp.CreateTo(o->reason, "timeout");
+		os.emplace_back("PushLogout", o);
+	}
+	{
+		auto o = mp.Create<PKG::Client_Server::Join>();
+		o->serial = 3;
+		mp.CreateTo(o->username, "abc");
+		mp.CreateTo(o->password, "123");
+		os.emplace_back("Join", o);
+	}
+	{
+		auto o = mp.Create<PKG::Client_Server::Message>();
+		mp.CreateTo(o->text, "hi");
+		os.emplace_back("Message", o);
+	}
+	os.emplace_back("Logout", mp.Create<PKG::Client_Server::Logout>());
+	return os;
+}
+
+// 读回后再写出须与原数据逐字节相同
+void TestAllTypes(xx::MemPool& mp)
+{
+	xx::BBuffer_v bb(mp), bb2(mp);
+	auto os = MakeAllTypes(mp);
+	for (int dedup = 0; dedup < 2; ++dedup)
+	{
+		int failed = 0;
+		for (auto& o : os)
+		{
+			bb->Clear();
+			bb->WriteRoot(o.second, dedup != 0);
+			xx::MPObject* r = nullptr;
+			bb->offset = 0;
+			auto rtv = bb->ReadRoot(r, dedup != 0);
+			bb2->Clear();
+			if (r) bb2->WriteRoot(r, dedup != 0);
+			if (rtv || bb->offset != bb->dataLen || !r || r->typeId() != o.second->typeId() || !SameContent(mp, o.second, r)
+				|| bb2->dataLen != bb->dataLen || memcmp(bb2->buf, bb->buf, bb->dataLen))
+			{
+				std::cout << o.first << " ";
+				++failed;
+			}
+			mp.SafeRelease(r);
+		}
+		Check(!failed, dedup ? "every PKG type round-trips with dedup" : "every PKG type round-trips without dedup");
+	}
+	for (auto& o : os) mp.Release(o.second);
+}
+
+void BenchAllTypes(xx::MemPool& mp)
+{
+	xx::BBuffer_v bb(mp);
+	auto os = MakeAllTypes(mp);
+	xx::Stopwatch sw;
+	for (int dedup = 1; dedup >= 0; --dedup)
+	{
+		int64_t totalWrite = 0, totalRead = 0;
+		for (auto& o : os)
+		{
+			int count = o.second->typeId() == xx::TypeId<PKG::Server_Client::JoinSuccess>::value ? 20000 : 200000;
+			sw.Reset();
+			for (int i = 0; i < count; ++i)
+			{
+				bb->Clear();
+				bb->WriteRoot(o.second, dedup != 0);
+			}
+			totalWrite += sw();
+			for (int i = 0; i < count; ++i)
+			{
+				bb->offset = 0;
+				xx::MPObject* r = nullptr;
+				bb->ReadRoot(r, dedup != 0);
+				mp.SafeRelease(r);
+			}
+			totalRead += sw();
+		}
+		mp.Cout("all PKG types", (dedup ? " dedup: write " : " no dedup: write "), totalWrite, " ms, read ", totalRead, " ms\n");
+	}
+	for (auto& o : os) mp.Release(o.second);
+}
+
+
+/***********************************************************************************/
+// LZ4 块压缩 与 可压缩包
+/***********************************************************************************/
+
+// 压缩后解压, 输入输出都放在刚好大小的堆内存里( 越界读写可被 ASan 发现 )
+bool LZ4RoundTrip(std::vector<char> const& src)
+{
+	auto len = (uint32_t)src.size();
+	std::unique_ptr<char[]> in(new char[len + 1]), c(new char[xx::LZ4CompressBound(len)]);
+	if (len) memcpy(in.get(), src.data(), len);
+	auto clen = xx::LZ4Compress(in.get(), len, c.get());
+	if (clen > xx::LZ4CompressBound(len)) return false;
+	std::unique_ptr<char[]> exact(new char[clen]), out(new char[len + 1]);
+	memcpy(exact.get(), c.get(), clen);
+	if (xx::LZ4Decompress(exact.get(), clen, out.get(), len)) return false;
+	return !len || !memcmp(out.get(), src.data(), len);
+}
+
+// 解压刚好大小的输入, 返回值非 0 即拒绝
+int LZ4DecompressExact(std::vector<char> const& src, uint32_t const& dstLen)
+{
+	std::unique_ptr<char[]> in(new char[src.size() + 1]), out(new char[dstLen + 1]);
+	if (!src.empty()) memcpy(in.get(), src.data(), src.size());
+	return xx::LZ4Decompress(in.get(), (uint32_t)src.size(), out.get(), dstLen);
+}
+
+std::vector<char> LZ4CompressToVector(std::vector<char> const& src)
+{
+	std::vector<char> c(xx::LZ4CompressBound((uint32_t)src.size()));
+	c.resize(xx::LZ4Compress(src.data(), (uint32_t)src.size(), c.data()));
+	return c;
+}
+
+void TestLZ4(xx::MemPool& mp)
+{
+	std::mt19937 rnd(7);
+	auto randomBytes = [&](size_t n) { std::vector<char> v(n); for (auto& c : v) c = (char)rnd(); return v; };
+	auto repeated = [&](size_t n, size_t period) { std::vector<char> v(n); for (size_t i = 0; i < n; ++i) v[i] = (char)('a' + i % period); return v; };
+
+	// 往返: 不可压 / 高度重复 / 边界长度( 含 15 / 255 的长度进位, mfLimit 12, 64K 偏移窗口 )
+	int failed = 0;
+	for (uint32_t len = 0; len <= 300; ++len)
+	{
+		if (!LZ4RoundTrip(randomBytes(len))) ++failed;
+		if (!LZ4RoundTrip(repeated(len, 1))) ++failed;
+		if (!LZ4RoundTrip(repeated(len, 7))) ++failed;
+	}
+	for (uint32_t len : { 65535u, 65536u, 65537u, 200000u })
+	{
+		if (!LZ4RoundTrip(randomBytes(len))) ++failed;
+		if (!LZ4RoundTrip(repeated(len, 1))) ++failed;
+		if (!LZ4RoundTrip(repeated(len, 70000))) ++failed;
+	}
+	Check(!failed, "LZ4 round-trips random, repetitive and boundary-length inputs");
+	auto big = repeated(100000, 1);
+	Check(LZ4CompressToVector(big).size() < 1000, "LZ4 compresses a repeated byte run");
+	auto noise = randomBytes(100000);
+	Check(LZ4CompressToVector(noise).size() <= xx::LZ4CompressBound(100000), "LZ4 stays within the bound on random input");
+
+	// 截断 / 原长不符
+	auto text = repeated(5000, 13);
+	for (int i = 0; i < 2000; ++i) text[rnd() % text.size()] = (char)rnd();
+	auto c = LZ4CompressToVector(text);
+	failed = 0;
+	for (size_t len = 0; len < c.size(); ++len)
+	{
+		if (!LZ4DecompressExact(std::vector<char>(c.begin(), c.begin() + len), (uint32_t)text.size())) ++failed;
+	}
+	Check(!failed, "every truncation of an LZ4 block is rejected");
+	Check(!LZ4DecompressExact(c, (uint32_t)text.size()), "the intact block decompresses");
+	Check(LZ4DecompressExact(c, (uint32_t)text.size() - 1) != 0, "a raw length one short is rejected");
+	Check(LZ4DecompressExact(c, (uint32_t)text.size() + 1) != 0, "a raw length one long is rejected");
+	Check(LZ4DecompressExact(c, 0) != 0, "a zero raw length is rejected");
+
+	// 匹配偏移越界: 指向输出开始之前 或 为 0
+	Check(LZ4DecompressExact({ 0x10, 'a', 2, 0, 0x00 }, 5) == -5, "a match offset before the output start is rejected");
+	Check(LZ4DecompressExact({ 0x10, 'a', 0, 0, 0x00 }, 5) == -5, "a zero match offset is rejected");
+	Check(LZ4DecompressExact({ 0x10, 'a', 1, 0, 0x00 }, 5) == 0, "an offset-1 overlapping match is accepted");
+	// 字面量 / 匹配长度超出
+	Check(LZ4DecompressExact({ (char)0xF0, (char)255, (char)255, 'a' }, 600) != 0, "a literal length past the input is rejected");
+	Check(LZ4DecompressExact({ 0x1F, 'a', 1, 0, (char)255, (char)255, (char)255 }, 100) != 0, "a match length past the output is rejected");
+
+	// 可压缩包: 阈值以下原样, 以上压缩, 读时解开
+	xx::BBuffer_v bb(mp), tmp(mp);
+	auto js = MakeJoinSuccess(mp, 100);
+	for (uint32_t threshold : { 0xFFFFFFFFu, 256u })
+	{
+		bb->Clear();
+		Check(bb->WritePackageCompressible(js, threshold), "WritePackageCompressible fits the header");
+		uint16_t pkgLen = 0;
+		memcpy(&pkgLen, bb->buf, 2);
+		Check(pkgLen + 2u == bb->dataLen && bb->buf[2] == (threshold == 256 ? 1 : 0), threshold == 256 ? "a large package is compressed" : "a package below the threshold is left raw");
+		auto p = bb->buf + 2;
+		uint32_t len = pkgLen;
+		Check(!xx::BBuffer::ReadPackageCompressible(p, len, *tmp), "ReadPackageCompressible unpacks the body");
+		xx::BBuffer_v body(mp);
+		body->WriteBuf(p, len);
+		PKG::Server_Client::JoinSuccess* r = nullptr;
+		Check(!body->ReadRoot(r) && SameContent(mp, js, r), "the unpacked body reads back");
+		mp.SafeRelease(r);
+	}
+
+	// 可压缩包的非法数据: 标记不为 0 / 1, 空, 原长超出 LZ4 最大压缩比, 截断
+	auto unpack = [&](std::vector<char> const& v)
+	{
+		std::unique_ptr<char[]> in(new char[v.size() + 1]);
+		if (!v.empty()) memcpy(in.get(), v.data(), v.size());
+		auto p = in.get();
+		auto len = (uint32_t)v.size();
+		return xx::BBuffer::ReadPackageCompressible(p, len, *tmp);
+	};
+	Check(unpack({ 2, 'a' }) == -2, "a compression flag other than 0 / 1 is rejected");
+	Check(unpack({}) != 0, "an empty compressible body is rejected");
+	Check(unpack({ 1, (char)0xFF, (char)0xFF, (char)0xFF, 0x0F, 0x00 }) == -3, "a raw length beyond the LZ4 ratio is rejected");
+	std::vector<char> pkg(bb->buf + 2, bb->buf + bb->dataLen);
+	failed = 0;
+	for (size_t len = 1; len < pkg.size(); ++len)
+	{
+		if (!unpack(std::vector<char>(pkg.begin(), pkg.begin() + len))) ++failed;
+	}
+	Check(!failed, "every truncation of a compressed package is rejected");
+	mp.Release(js);
+}
+
+
+/***********************************************************************************/
+// 分段写模式( EnableChunks ) 与 连续内存 的 WritePackage, 以及经 BBQueue 的多段发送
+/***********************************************************************************/
+
+// 依次写入所有对象的包, 每个包之后再以 2 字节包头写一个超长的包( 须被回滚 )
+template<typename SizeType>
+void WriteAllPackages(xx::BBuffer& bb, std::vector<std::pair<char const*, xx::MPObject*>> const& os, xx::MPObject* big)
+{
+	for (auto& o : os)
+	{
+		bb.WritePackage<SizeType>(o.second);
+		Check(!bb.WritePackage<uint16_t>(big), "an oversized package is rolled back");
+	}
+}
+
+// 拼接分段写模式下的所有数据
+void GatherChunks(xx::BBuffer& bb, xx::BBuffer& out)
+{
+	out.Clear();
+	for (auto& c : *bb.chunks) out.WriteBuf(c);
+	out.WriteBuf(bb);
+}
+
+template<typename SizeType>
+void TestChunks(xx::MemPool& mp, char const* name)
+{
+	auto os = MakeAllTypes(mp);
+	os.emplace_back("JoinSuccess 300", MakeJoinSuccess(mp, 300));
+	auto big = MakeJoinSuccess(mp, 5000);
+	xx::BBuffer_v flat(mp), chunked(mp), gathered(mp);
+	WriteAllPackages<SizeType>(*flat, os, big);
+
+	for (uint32_t chunkSize : { 16u, 100u, 1000u, 65536u })
+	{
+		chunked->Clear();
+		chunked->EnableChunks(chunkSize);
+		WriteAllPackages<SizeType>(*chunked, os, big);
+		GatherChunks(*chunked, *gathered);
+		if (gathered->dataLen != chunked->WritePos() || gathered->dataLen != flat->dataLen || memcmp(gathered->buf, flat->buf, flat->dataLen))
+		{
+			std::cout << name << " chunkSize " << chunkSize << " ";
+			Check(false, "chunked packages equal the flat bytes");
+			continue;
+		}
+
+		// 逐个包读回
+		int failed = 0;
+		uint32_t offset = 0;
+		for (auto& o : os)
+		{
+			SizeType pkgLen = 0;
+			memcpy(&pkgLen, gathered->buf + offset, sizeof(SizeType));
+			offset += sizeof(SizeType);
+			xx::BBuffer_v pkg(mp);
+			pkg->WriteBuf(gathered->buf + offset, pkgLen);
+			offset += pkgLen;
+			xx::MPObject* r = nullptr;
+			if (pkg->ReadRoot(r) || pkg->offset != pkg->dataLen || !SameContent(mp, o.second, r)) ++failed;
+			mp.SafeRelease(r);
+		}
+		Check(!failed && offset == gathered->dataLen, "chunked packages read back");
+	}
+
+	// 经 Add / AddRange 追加的数据也走分段
+	chunked->Clear();
+	chunked->EnableChunks(16);
+	for (uint32_t i = 0; i < flat->dataLen; i += 7)
+	{
+		chunked->Add(flat->buf[i]);
+		if (i + 1 < flat->dataLen) chunked->AddRange(flat->buf + i + 1, std::min(6u, flat->dataLen - i - 1));
+	}
+	int oversized = 0;
+	for (auto& c : *chunked->chunks) if (c->bufLen > 1024) ++oversized;
+	GatherChunks(*chunked, *gathered);
+	Check(!oversized && gathered->dataLen == flat->dataLen && !memcmp(gathered->buf, flat->buf, flat->dataLen), "Add / AddRange in chunk mode equal the flat bytes");
+
+	// 压入 BBQueue 后各段即为多段数据, 按任意长度弹出拼接后与连续写入相同
+	xx::BBQueue_v q(mp);
+	auto bb = q->CreateBB();
+	bb->EnableChunks(100);
+	WriteAllPackages<SizeType>(*bb, os, big);
+	auto numChunks = bb->chunks->dataLen;
+	q->Push(bb);
+	xx::List_v<IoVec> bufs(mp);
+	gathered->Clear();
+	uint32_t maxBufs = 0;
+	while (q->PopTo(*bufs, 777))
+	{
+		for (auto& b : *bufs) gathered->WriteBuf(b.base, b.len);
+		if (bufs->dataLen > maxBufs) maxBufs = bufs->dataLen;
+	}
+	Check(numChunks > 1 && maxBufs > 1 && gathered->dataLen == flat->dataLen && !memcmp(gathered->buf, flat->buf, flat->dataLen), "BBQueue pops chunks as separate segments");
+
+	mp.Release(big);
+	for (auto& o : os) mp.Release(o.second);
+}
+
+// 不清理地连续弹出( 同时发多段 ), 各段发送成功后按序 ReleasePopped: 只释放该次弹出前已弹完的 bb
+void TestReleasePopped(xx::MemPool& mp)
+{
+	xx::BBQueue_v q(mp);
+	std::vector<xx::BBuffer*> bbs;
+	for (uint32_t len : { 100u, 50u, 300u, 10u, 200u })
+	{
+		auto bb = q->CreateBB();
+		for (uint32_t i = 0; i < len; ++i) bb->Add((char)(bbs.size() * 31 + i));
+		bb->AddRef();													// 多持有一份, 由 refCount 判断是否已被队列释放
+		bbs.push_back(bb);
+		q->Push(bb);
+	}
+	auto released = [&] { uint32_t n = 0; for (auto& bb : bbs) if (bb->refCount() == 1) ++n; return n; };
+
+	xx::List_v<IoVec> bufs(mp);
+	xx::BBuffer_v popped(mp);
+	std::vector<uint32_t> indexs;
+	while (q->PopTo(*bufs, 120, false))
+	{
+		for (auto& b : *bufs) popped->WriteBuf(b.base, b.len);
+		indexs.push_back(q->bufIndex);
+	}
+	Check(!released() && q->BytesCount() == 0 && indexs.size() == 6, "popping without release keeps every buffer alive");
+
+	bool ok = true;
+	uint32_t offset = 0;
+	for (auto& bb : bbs)
+	{
+		ok = ok && !memcmp(popped->buf + offset, bb->buf, bb->dataLen);
+		offset += bb->dataLen;
+	}
+	Check(ok && offset == popped->dataLen, "pops without release return the data in order");
+
+	// 每次弹出 120 字节, 停在某个 bb 中间时该 bb 不释放. 各 bb 的数据区间: [0,100) [100,150) [150,450) [450,460) [460,660)
+	std::vector<uint32_t> expected = { 1, 2, 2, 4, 4, 5 };
+	ok = true;
+	for (size_t i = 0; i < indexs.size(); ++i)
+	{
+		q->ReleasePopped(indexs[i]);
+		ok = ok && released() == expected[i];
+	}
+	Check(ok, "ReleasePopped frees only buffers popped completely before that pop");
+
+	// releasePopped 为真时照旧于下次弹出时清理
+	for (auto& bb : bbs) bb->Release();
+	bbs.clear();
+	for (int i = 0; i < 3; ++i)
+	{
+		auto bb = q->CreateBB();
+		bb->WriteBuf("0123456789", 10);
+		bb->AddRef();
+		bbs.push_back(bb);
+		q->Push(bb);
+	}
+	q->PopTo(*bufs, 15);
+	auto before = released();
+	q->PopTo(*bufs, 15);
+	Check(!before && released() == 1 && bufs->dataLen == 2 && bufs->At(0).len == 5 && bufs->At(1).len == 10, "PopTo with release frees the previous pop");
+	q->Clear();
+	Check(released() == 3, "Clear frees every buffer");
+	for (auto& bb : bbs) bb->Release();
+}
+
+// 发送路径: 写包 -> 压入 BBQueue -> 按 64K 弹出多段 -> 逐段复制( 模拟内核复制 )
+void BenchSend(xx::MemPool& mp, int n, int count)
+{
+	auto js = MakeJoinSuccess(mp, n);
+	xx::BBQueue_v q(mp);
+	xx::List_v<IoVec> bufs(mp);
+	std::vector<char> sink(65536);
+	xx::Stopwatch sw;
+	for (int chunked = 0; chunked < 2; ++chunked)
+	{
+		uint32_t pkgLen = 0, numBufs = 0;
+		sw.Reset();
+		for (int i = 0; i < count; ++i)
+		{
+			auto bb = q->CreateBB();
+			if (chunked) bb->EnableChunks();
+			bb->WritePackage<uint32_t>(js);
+			pkgLen = bb->WritePos();
+			q->Push(bb);
+			while (q->PopTo(*bufs, 65536))
+			{
+				uint32_t pos = 0;
+				for (auto& b : *bufs)
+				{
+					memcpy(sink.data() + pos, b.base, b.len);
+					pos += b.len;
+					++numBufs;
+				}
+			}
+		}
+		mp.Cout("send JoinSuccess( ", pkgLen, " bytes ) x ", count, (chunked ? " chunked: " : " flat: "), sw(), " ms, ", numBufs / count, " bufs each\n");
+	}
+	mp.Release(js);
+}
+
+
+/***********************************************************************************/
+// 不反序列化的 预读类型 / 跳过包 / 跳过字段
+/***********************************************************************************/
+
+// 逐包 PeekPackage + SkipPackage 走完整个流, 截断的流只走到最后一个完整的包
+template<typename SizeType>
+void TestPeekPackages(xx::MemPool& mp, char const* name)
+{
+	auto os = MakeAllTypes(mp);
+	xx::BBuffer_v bb(mp);
+	std::vector<uint32_t> ends;
+	for (auto& o : os)
+	{
+		bb->WritePackage<SizeType>(o.second);
+		ends.push_back(bb->dataLen);
+	}
+
+	int failed = 0;
+	uint16_t tid = 0;
+	uint32_t pkgLen = 0;
+	for (size_t i = 0; i < os.size(); ++i)
+	{
+		auto offset = bb->offset;
+		uint32_t len = 0;
+		auto headerLen = xx::BBuffer::ReadPackageHeader(bb->buf + offset, bb->dataLen - offset, len, (SizeType*)nullptr);
+		if (bb->PeekPackage<SizeType>(pkgLen, tid) || bb->offset != offset || tid != os[i].second->typeId() || pkgLen != len
+			|| offset + headerLen + pkgLen != ends[i] || bb->SkipPackage<SizeType>() || bb->offset != ends[i]) ++failed;
+	}
+	Check(!failed && bb->offset == bb->dataLen, name);
+	Check(bb->PeekPackage<SizeType>(pkgLen, tid) == 1 && bb->SkipPackage<SizeType>() == 1 && bb->offset == bb->dataLen, "peek / skip at the end of the stream wait for more data");
+
+	// 每种截断长度: 完整的包照常走过, 其后 Peek / Skip 均返回 1 且不移动 offset
+	auto fullLen = bb->dataLen;
+	failed = 0;
+	for (uint32_t len = 0; len < fullLen; ++len)
+	{
+		bb->dataLen = len;
+		bb->offset = 0;
+		size_t n = 0;
+		while (!bb->PeekPackage<SizeType>(pkgLen, tid) && !bb->SkipPackage<SizeType>()) ++n;
+		auto offset = bb->offset;
+		auto complete = std::upper_bound(ends.begin(), ends.end(), len) - ends.begin();
+		if (n != (size_t)complete || offset != (n ? ends[n - 1] : 0)
+			|| bb->PeekPackage<SizeType>(pkgLen, tid) != 1 || bb->SkipPackage<SizeType>() != 1 || bb->offset != offset) ++failed;
+	}
+	Check(!failed, "every truncation stops at the last complete package");
+	bb->dataLen = fullLen;
+
+	// 数据长度为 0 的包: 长度完整, 但读不出类型编号
+	bb->Clear();
+	bb->BeginWritePackage<SizeType>();
+	bb->EndWritePackage<SizeType>();
+	bb->offset = 0;
+	Check(bb->PeekPackage<SizeType>(pkgLen, tid) < 0 && !bb->SkipPackage<SizeType>() && bb->offset == bb->dataLen, "an empty package body is invalid to peek but can be skipped");
+
+	for (auto& o : os) mp.Release(o.second);
+}
+
+void TestPeek(xx::MemPool& mp)
+{
+	TestPeekPackages<uint16_t>(mp, "peek / skip walk a uint16_t framed stream");
+	TestPeekPackages<uint32_t>(mp, "peek / skip walk a uint32_t framed stream");
+	TestPeekPackages<xx::VarPackageSize>(mp, "peek / skip walk a varint framed stream");
+
+	// PeekRootTypeId 不移动 offset, 不创建对象
+	auto js = MakeJoinSuccess(mp, 20);
+	xx::BBuffer_v bb(mp);
+	bb->Write((int32_t)-7);
+	bb->offset = bb->dataLen;
+	bb->WriteRoot(js);
+	uint16_t tid = 0;
+	auto offset = bb->offset;
+	Check(!bb->PeekRootTypeId(tid) && tid == js->typeId() && bb->offset == offset, "PeekRootTypeId reads the root type id in place");
+	bb->dataLen = offset;
+	Check(bb->PeekRootTypeId(tid) && bb->offset == offset, "PeekRootTypeId fails at the end of data");
+	mp.Release(js);
+
+	// Skip: 值类型, String* / BBuffer* 系( 含回引与空指针 ), 去重与不去重
+	auto s = mp.Create<xx::String>("hello");
+	auto b = mp.Create<xx::BBuffer>();
+	b->Write((uint64_t)1234567890123);
+	for (int dedup = 0; dedup < 2; ++dedup)
+	{
+		bb->Clear();
+		bb->offset = 0;
+		bb->writeDedup = bb->readDedup = dedup != 0;
+		bb->BeginWrite();
+		bb->Write((int32_t)123456);
+		bb->Write(s);
+		bb->Write(b);
+		bb->Write(3.5);
+		bb->Write(s);
+		bb->Write((xx::String*)nullptr);
+		bb->Write((int8_t)-1);
+		bb->EndWrite();
+		bb->BeginRead();
+		auto r = bb->Skip<int32_t>();
+		if (!r) r = bb->Skip<xx::String*>();
+		if (!r) r = bb->Skip<xx::Ptr<xx::BBuffer>>();
+		if (!r) r = bb->Skip<double>();
+		if (!r) r = bb->Skip<xx::StringView>();
+		if (!r) r = bb->Skip<xx::MPtr<xx::String>>();
+		int8_t last = 0;
+		if (!r) r = bb->Read(last);
+		bb->EndRead();
+		Check(!r && last == -1 && bb->offset == bb->dataLen, dedup ? "fields are skipped with dedup" : "fields are skipped without dedup");
+
+		// 截断处跳过失败
+		auto fullLen = bb->dataLen;
+		int succeeded = 0;
+		for (uint32_t len = 0; len < fullLen; ++len)
+		{
+			bb->dataLen = len;
+			bb->offset = 0;
+			bb->BeginRead();
+			r = bb->Skip<int32_t>();
+			if (!r) r = bb->Skip<xx::String*>();
+			if (!r) r = bb->Skip<xx::Ptr<xx::BBuffer>>();
+			if (!r) r = bb->Skip<double>();
+			if (!r) r = bb->Skip<xx::StringView>();
+			if (!r) r = bb->Skip<xx::MPtr<xx::String>>();
+			if (!r) r = bb->Read(last);
+			bb->EndRead();
+			if (!r) ++succeeded;
+		}
+		Check(!succeeded, "skipping truncated fields fails");
+		bb->dataLen = fullLen;
+	}
+	bb->writeDedup = bb->readDedup = true;
+	s->Release();
+	b->Release();
+}
+
+// 收包分派: 全部 ReadRoot 后按类型处理 与 先 PeekRootTypeId 只解需要的包
+void BenchPeek(xx::MemPool& mp)
+{
+	const int count = 50;
+	auto js = MakeJoinSuccess(mp, 20);
+	auto pm = mp.Create<PKG::Server_Client::PushMessage>();
+	mp.CreateTo(pm->text, "hello world");
+	xx::BBuffer_v bb(mp), pkg(mp);
+	for (int i = 0; i < 1000; ++i)
+	{
+		bb->WritePackage(js);
+		bb->WritePackage(pm);
+	}
+	xx::Stopwatch sw;
+	for (int peek = 0; peek < 2; ++peek)
+	{
+		int handled = 0;
+		sw.Reset();
+		for (int i = 0; i < count; ++i)
+		{
+			bb->offset = 0;
+			uint32_t pkgLen = 0;
+			uint16_t tid = 0;
+			while (!bb->PeekPackage(pkgLen, tid))
+			{
+				pkg->Clear();
+				pkg->offset = 0;
+				pkg->WriteBuf(bb->buf + bb->offset + 2, pkgLen);
+				bb->SkipPackage();
+				if (peek && (pkg->PeekRootTypeId(tid) || tid != pm->typeId())) continue;	// 只处理 PushMessage, 其他丢弃
+				xx::MPObject* r = nullptr;
+				if (!pkg->ReadRoot(r) && r->typeId() == pm->typeId()) ++handled;
+				mp.SafeRelease(r);
+			}
+		}
+		mp.Cout("dispatch 1000 JoinSuccess( dropped ) + 1000 PushMessage x ", count, (peek ? " peek: " : " ReadRoot: "), sw(), " ms, handled ", handled, "\n");
+	}
+	mp.Release(js);
+	mp.Release(pm);
+}
+
+int main()
+{
+	PKG::AllTypesRegister();
+	xx::MemPool mp;
+
+	TestVarInts<int32_t>(mp);
+	TestVarInts<uint32_t>(mp);
+	TestVarInts<int64_t>(mp);
+	TestVarInts<uint64_t>(mp);
+	TestMemcpyWire(mp);
+	TestViews(mp);
+	TestDedup(mp);
+	TestPreSize(mp);
+	TestAllTypes(mp);
+	TestLZ4(mp);
+	TestChunks<uint16_t>(mp, "uint16_t");
+	TestChunks<uint32_t>(mp, "uint32_t");
+	TestPeek(mp);
+	TestReleasePopped(mp);
+	std::cout << (errors ? "FAILED" : "ok") << std::endl;
+
+	BenchVarInts<int32_t>(mp, "int32_t", true);
+	BenchVarInts<int32_t>(mp, "int32_t", false);
+	BenchVarInts<int64_t>(mp, "int64_t", true);
+	BenchVarInts<int64_t>(mp, "int64_t", false);
+	BenchDedup(mp);
+	BenchWritePackage(mp, 20, 50000);
+	BenchWritePackage(mp, 500, 2000);
+	BenchAllTypes(mp);
+	BenchSend(mp, 20, 20000);
+	BenchSend(mp, 20000, 50);
+	BenchPeek(mp);
+	return errors;
+}
@@ -0,0 +1,621 @@
+﻿#include "xx_uv.h"
+#include "pkg/PKG_class.h"
+#include <iostream>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <random>
+
+// 经本机回环的 UV 收发测试. 返回值为失败项数
+
+int errors = 0;
+inline void Check(bool ok, char const* what)
+{
+	if (ok) return;
+	++errors;
+	std::cout << "FAILED: " << what << std::endl;
+}
+
+// 超时则停掉 loop, 以免测试卡死
+struct TimeoutTimer : xx::UVTimer
+{
+	bool timedOut = false;
+	TimeoutTimer(xx::UV* uv, uint64_t const& timeoutMS) : xx::UVTimer(uv)
+	{
+		Start(timeoutMS, 0);
+	}
+	virtual void OnFire() override
+	{
+		timedOut = true;
+		uv->Stop();
+	}
+};
+
+// 原样回发收到的包
+struct EchoPeer : xx::UVServerPeer
+{
+	using xx::UVServerPeer::UVServerPeer;
+	virtual void OnReceivePackage(xx::BBuffer& bb) override
+	{
+		SendPackageData(bb.buf, bb.dataLen);
+	}
+	virtual void OnDisconnect() override {}
+};
+
+
+/***********************************************************************************/
+// UVCluster: 多 loop 以 SO_REUSEPORT 监听同一端口, 跨 loop Post
+/***********************************************************************************/
+
+const int clusterPort = 12401;
+std::atomic<int> clusterAccepted{ 0 }, clusterPosted{ 0 }, clusterWrongLoop{ 0 };
+
+struct ClusterListener : xx::UVListener
+{
+	using xx::UVListener::UVListener;
+	virtual xx::UVServerPeer* OnCreatePeer() override
+	{
+		++clusterAccepted;
+		return mempool().Create<EchoPeer>(this);
+	}
+};
+
+// 连上后先发 16 个, 每收回一个再补发一个, 共收回 numMsgs 个
+struct ClusterClient : xx::UVClientPeer
+{
+	int numMsgs = 0, sent = 0, received = 0, bad = 0;
+	int* numDone = nullptr;
+	int numClients = 0;
+	using xx::UVClientPeer::UVClientPeer;
+	void SendOne()
+	{
+		auto m = mempool().Create<PKG::Server_Client::PushMessage>();
+		m->id = sent++;
+		mempool().CreateTo(m->text, "hello from a client, a moderately sized chat message");
+		SendPackages(m);
+		m->Release();
+	}
+	virtual void OnConnect() override
+	{
+		if (lastStatus) return;
+		for (int i = 0; i < 16; ++i) SendOne();
+	}
+	virtual void OnReceivePackage(xx::BBuffer& bb) override
+	{
+		PKG::Server_Client::PushMessage* m = nullptr;
+		if (bb.ReadRoot(m) || !m || m->id != received) ++bad;
+		mempool().SafeRelease(m);
+		if (++received == numMsgs)
+		{
+			if (++*numDone == numClients) uv->Stop();
+		}
+		else if (sent < numMsgs) SendOne();
+	}
+	virtual void OnDisconnect() override {}
+};
+
+void TestCluster(xx::MemPool& mp)
+{
+	const int numLoops = 2, numClients = 8, numMsgs = 500;
+	xx::UVCluster c;
+	Check(!c.Start(numLoops, [](xx::UV& uv) { return uv.CreateListener<ClusterListener>(clusterPort, 128) ? 0 : -1; }), "a cluster starts its loops");
+
+	// 不开 SO_REUSEPORT 监听同一端口须失败
+	{
+		xx::UVCluster c2;
+		Check(c2.Start(1, [](xx::UV& uv) { uv.reusePort = false; return uv.CreateListener<ClusterListener>(clusterPort, 128) ? 0 : -1; }) != 0, "a listener without SO_REUSEPORT cannot share the port");
+	}
+
+	// 跨 loop 接力投递
+	for (int i = 0; i < numLoops; ++i)
+	{
+		c.Post(i, [&c, i](xx::UV& uv)
+		{
+			if ((int)uv.clusterIndex != i) ++clusterWrongLoop;
+			c.Post((i + 1) % numLoops, [](xx::UV&) { ++clusterPosted; });
+		});
+	}
+
+	int numDone = 0, bad = 0, received = 0;
+	{
+		xx::UV_v uv(mp);
+		auto timer = uv->CreateTimer<TimeoutTimer>(10000);
+		for (int i = 0; i < numClients; ++i)
+		{
+			auto p = uv->CreateClientPeer<ClusterClient>();
+			p->numMsgs = numMsgs;
+			p->numDone = &numDone;
+			p->numClients = numClients;
+			p->SetAddress("127.0.0.1", clusterPort);
+			p->Connect();
+		}
+		uv->Run();
+		Check(!timer->timedOut, "cluster echo finishes in time");
+		for (auto& p : *uv->clientPeers)
+		{
+			bad += ((ClusterClient*)p)->bad;
+			received += ((ClusterClient*)p)->received;
+		}
+	}
+	Check(numDone == numClients && received == numClients * numMsgs && !bad, "every client gets all its echoes back in order");
+	Check(clusterAccepted == numClients, "the loops accept every connection");
+	for (int i = 0; i < 1000 && clusterPosted < numLoops; ++i) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	c.Stop();
+	c.Join();
+	Check(clusterPosted == numLoops && !clusterWrongLoop, "posted functions run on their target loops");
+	Check(c.Post(0, [](xx::UV&) {}) != 0, "posting to a stopped cluster fails");
+}
+
+
+/***********************************************************************************/
+// 收包拆包: 任意切分的数据流逐段模拟 libuv 读回调, 须还原出同样的包
+/***********************************************************************************/
+
+// 记下收到的包. 不连接, 由 Feed 喂数据
+struct RecvPeer : xx::UVClientPeer
+{
+	std::vector<std::string> pkgs;
+	int disconnects = 0;
+	using xx::UVClientPeer::UVClientPeer;
+	virtual void OnConnect() override {}
+	virtual void OnReceivePackage(xx::BBuffer& bb) override
+	{
+		pkgs.emplace_back(bb.buf, bb.dataLen);
+	}
+	virtual void OnDisconnect() override {}
+	virtual int Disconnect(bool const& immediately = true) override		// 只计数( 没有连接可断 )
+	{
+		++disconnects;
+		return 0;
+	}
+};
+
+// 同 libuv 对一次读的处理: 先 AllocCB 取缓冲区, 填入数据后 ReadCB. len 不超过 65536. numDirect 非空则累计直接读进 bbReceiveLeft 的次数
+void FeedOnce(xx::UVPeer* p, char const* data, uint32_t len, uint32_t* numDirect = nullptr)
+{
+	uv_buf_t buf;
+	xx::UVPeer::AllocCB((uv_handle_t*)&p->stream, 65536, &buf);
+	if (numDirect && buf.base != p->bbReceive->buf) ++*numDirect;
+	memcpy(buf.base, data, len);
+	xx::UVPeer::ReadCB((uv_stream_t*)&p->stream, len, &buf);
+}
+
+// 把 data 按 step 字节一段喂给 p, 断开即停
+void Feed(RecvPeer* p, std::string const& data, uint32_t step)
+{
+	for (uint32_t o = 0; o < data.size() && !p->disconnects; o += step)
+	{
+		FeedOnce(p, data.data() + o, std::min(step, (uint32_t)data.size() - o));
+	}
+}
+
+// 2 字节包头 + 随机数据的包流
+std::string MakeStream(std::vector<uint32_t> const& lens, std::vector<std::string>& pkgs)
+{
+	std::mt19937 rnd(123);
+	std::string s;
+	pkgs.clear();
+	for (auto len : lens)
+	{
+		std::string pkg(len, 0);
+		for (auto& c : pkg) c = (char)rnd();
+		s += (char)(len & 0xFF);
+		s += (char)(len >> 8);
+		s += pkg;
+		pkgs.push_back(std::move(pkg));
+	}
+	return s;
+}
+
+void TestReceive(xx::MemPool& mp)
+{
+	xx::UV_v uv(mp);
+	auto p1 = uv->CreateClientPeer<RecvPeer>();
+	auto p2 = uv->CreateClientPeer<RecvPeer>();
+	std::vector<std::string> pkgs;
+	auto stream = MakeStream({ 1, 5, 0, 100, 1000, 18000, 2, 65535, 3, 30000 }, pkgs);
+
+	int failed = 0, holding = 0;
+	for (uint32_t step : { 1u, 2u, 3u, 7u, 100u, 1001u, 4096u, 65536u })
+	{
+		p1->pkgs.clear();
+		Feed(p1, stream, step);
+		if (p1->pkgs != pkgs)
+		{
+			std::cout << "step " << step << " ";
+			++failed;
+		}
+		if (p1->bbReceiveLeft->buf) ++holding;
+	}
+	Check(!failed, "packages split at any read boundary are reassembled");
+	Check(!holding, "no receive memory is held once every package is complete");
+
+	// 两个 peer 交替收各自的半截包: 共用接收缓冲区时, 不完整的数据须留在各自的 bbReceiveLeft
+	p1->pkgs.clear();
+	p2->pkgs.clear();
+	auto stream2 = MakeStream({ 18000, 7, 40000 }, pkgs);
+	for (uint32_t o = 0; o < stream2.size(); o += 5000)
+	{
+		auto n = std::min(5000u, (uint32_t)stream2.size() - o);
+		FeedOnce(p1, stream2.data() + o, n);
+		FeedOnce(p2, stream2.data() + o, n);
+	}
+	Check(p1->pkgs == pkgs && p2->pkgs == pkgs, "peers keep their partial packages apart");
+#ifdef XX_UV_SHARED_RECEIVE_BUFFER
+	Check(p1->bbReceive == &*uv->bbReceive && p2->bbReceive == &*uv->bbReceive, "peers read into the loop's shared receive buffer");
+#else
+	Check(p1->bbReceive != p2->bbReceive, "each peer owns its receive buffer");
+#endif
+}
+
+
+/***********************************************************************************/
+// 包头格式( UInt16 / UInt32 / VarUInt32 ), 大包直接收进 bbReceiveLeft, maxPackageLen
+/***********************************************************************************/
+
+char const* const headerNames[] = { "UInt16", "UInt32", "VarUInt32" };
+
+// 用 p 的 BeginPackage / EndPackage( 按其 packageHeader, compress )拼包流. 每 3 个包中有 1 个全 0( 可压缩 )
+std::string MakePeerStream(xx::UVPeer* p, std::vector<uint32_t> const& lens, std::vector<std::string>& pkgs)
+{
+	xx::BBuffer_v bb(p->mempool());
+	std::mt19937 rnd(123);
+	pkgs.clear();
+	for (auto len : lens)
+	{
+		std::string pkg(len, 0);
+		if (pkgs.size() % 3 != 2) for (auto& c : pkg) c = (char)rnd();
+		p->BeginPackage(*bb);
+		bb->WriteBuf(pkg.data(), len);
+		if (!p->EndPackage(*bb)) Check(false, "a test package fits its header");
+		pkgs.push_back(std::move(pkg));
+	}
+	return std::string(bb->buf, bb->dataLen);
+}
+
+void TestPackageHeaders(xx::MemPool& mp)
+{
+	xx::UV_v uv(mp);
+	auto sender = uv->CreateClientPeer<RecvPeer>();
+	auto p = uv->CreateClientPeer<RecvPeer>();
+	std::vector<std::string> pkgs;
+	for (int h = 0; h < 3; ++h)
+	{
+		for (int compress = 0; compress < 2; ++compress)
+		{
+			sender->packageHeader = p->packageHeader = (xx::UVPackageHeaders)h;
+			sender->compress = p->compress = compress != 0;
+			sender->compressThreshold = 100;
+
+			// 在每一个字节处切成两次读
+			auto stream = MakePeerStream(sender, { 0, 1, 127, 128, 300, 200, 5000, 16384, 3 }, pkgs);
+			int failed = 0;
+			for (uint32_t k = 0; k <= stream.size(); ++k)
+			{
+				p->pkgs.clear();
+				if (k) FeedOnce(p, stream.data(), k);
+				if (k < stream.size()) FeedOnce(p, stream.data() + k, (uint32_t)stream.size() - k);
+				if (p->pkgs != pkgs || p->disconnects || p->bbReceiveLeft->dataLen) ++failed;
+			}
+			p->pkgs.clear();
+			Feed(p, stream, 1);
+			if (p->pkgs != pkgs || p->disconnects) ++failed;
+			Check(!failed, (std::string(headerNames[h]) + (compress ? " compressed" : "") + ": packages split at every byte are reassembled").c_str());
+		}
+	}
+
+	// 大包: 包头收全后 bbReceiveLeft 一次分配到位, 之后 libuv 直接读进它的剩余空间
+	for (int h = 1; h < 3; ++h)
+	{
+		sender->packageHeader = p->packageHeader = (xx::UVPackageHeaders)h;
+		sender->compress = p->compress = false;
+		auto stream = MakePeerStream(sender, { 100, 1024 * 1024 + 3, 7, 300000, 65536 * 2 }, pkgs);
+		p->pkgs.clear();
+		uint32_t numDirect = 0, numRealloc = 0;
+		char* leftBuf = nullptr;
+		for (uint32_t o = 0; o < stream.size(); )
+		{
+			auto n = std::min(o ? 65536u : 150u, (uint32_t)stream.size() - o);
+			FeedOnce(p, stream.data() + o, n, &numDirect);
+			o += n;
+			if (p->recvHeaderLen && leftBuf && leftBuf != p->bbReceiveLeft->buf) ++numRealloc;
+			leftBuf = p->recvHeaderLen ? p->bbReceiveLeft->buf : nullptr;
+		}
+		Check(p->pkgs == pkgs && !p->disconnects, (std::string(headerNames[h]) + ": large packages read directly into bbReceiveLeft are intact").c_str());
+		Check(numDirect >= 20 && !numRealloc, (std::string(headerNames[h]) + ": a pending large package is reserved once and read into directly").c_str());
+	}
+
+	// 超过 maxPackageLen 的包头: 不缓存数据, 直接断开. 之前的包照常收到
+	for (int h = 0; h < 3; ++h)
+	{
+		sender->packageHeader = p->packageHeader = (xx::UVPackageHeaders)h;
+		sender->compress = p->compress = false;
+		p->maxPackageLen = 1000;
+		auto stream = MakePeerStream(sender, { 500, 1001, 10 }, pkgs);
+		int failed = 0;
+		for (uint32_t step : { 1u, 2u, 3u, 600u, 65536u })
+		{
+			p->Clear();
+			p->pkgs.clear();
+			p->disconnects = 0;
+			Feed(p, stream, step);
+			if (p->disconnects != 1 || p->pkgs.size() != 1 || p->pkgs[0] != pkgs[0] || p->bbReceiveLeft->bufLen > 1000) ++failed;
+		}
+		Check(!failed, (std::string(headerNames[h]) + ": a package longer than maxPackageLen disconnects before it is buffered").c_str());
+	}
+
+	// 压缩包解压后的长度同样受 maxPackageLen 限制
+	sender->packageHeader = p->packageHeader = xx::UVPackageHeaders::UInt32;
+	sender->compress = p->compress = true;
+	p->Clear();
+	p->pkgs.clear();
+	p->disconnects = 0;
+	auto stream = MakePeerStream(sender, { 200, 200, 200000 }, pkgs);
+	Check(stream.size() < 2000, "200KB of zeros compresses below maxPackageLen");
+	Feed(p, stream, 65536);
+	Check(p->disconnects == 1 && p->pkgs.size() == 2 && uv->bbReceiveUnpack->bufLen < 200000, "a package that decompresses past maxPackageLen disconnects before unpacking");
+}
+
+
+/***********************************************************************************/
+// 发送: uv_try_write 只写出一部分时剩下的走 uv_write, 多个 uv_write 同时在发, 回调按序释放
+/***********************************************************************************/
+
+const int sendPort = 12402;
+
+// 连上后先不读, 等计时器开始读, 令发送方的内核缓冲区先被塞满
+struct SlowReadPeer : xx::UVServerPeer
+{
+	std::vector<std::string> const* expected = nullptr;
+	size_t received = 0;
+	int bad = 0;
+	using xx::UVServerPeer::UVServerPeer;
+	virtual void OnReceivePackage(xx::BBuffer& bb) override
+	{
+		if (received >= expected->size() || std::string(bb.buf, bb.dataLen) != (*expected)[received]) ++bad;
+		if (++received == expected->size()) uv->Stop();
+	}
+	virtual void OnDisconnect() override {}
+};
+
+struct SlowReadListener : xx::UVListener
+{
+	std::vector<std::string> const* expected = nullptr;
+	SlowReadPeer* peer = nullptr;
+	using xx::UVListener::UVListener;
+	virtual xx::UVServerPeer* OnCreatePeer() override
+	{
+		peer = mempool().Create<SlowReadPeer>(this);
+		peer->packageHeader = xx::UVPackageHeaders::UInt32;
+		peer->expected = expected;
+		uv_read_stop((uv_stream_t*)&peer->stream);
+		return peer;
+	}
+};
+
+struct StartReadTimer : xx::UVTimer
+{
+	SlowReadListener* listener = nullptr;
+	StartReadTimer(xx::UV* uv, SlowReadListener* listener) : xx::UVTimer(uv), listener(listener)
+	{
+		Start(200, 0);
+	}
+	virtual void OnFire() override
+	{
+		if (listener->peer) uv_read_start((uv_stream_t*)&listener->peer->stream, xx::UVPeer::AllocCB, xx::UVPeer::ReadCB);
+	}
+};
+
+// 连上后一口气发完所有包
+struct BurstClient : xx::UVClientPeer
+{
+	std::vector<std::string> const* pkgs = nullptr;
+	int sendErrors = 0;
+	uint32_t maxNumWritings = 0;
+	using xx::UVClientPeer::UVClientPeer;
+	virtual void OnConnect() override
+	{
+		if (lastStatus) return;
+		int size = 4096;
+		uv_send_buffer_size((uv_handle_t*)&stream, &size);				// 内核发送缓冲区远小于一段( 64K ), 首次 uv_try_write 只能写出一部分
+		for (auto& pkg : *pkgs)
+		{
+			if (SendPackageData(pkg.data(), (uint32_t)pkg.size())) ++sendErrors;
+			if (numWritings > maxNumWritings) maxNumWritings = numWritings;
+		}
+	}
+	virtual void OnReceivePackage(xx::BBuffer& bb) override {}
+	virtual void OnDisconnect() override {}
+};
+
+void TestPartialWrite(xx::MemPool& mp)
+{
+	std::vector<std::string> pkgs;
+	std::mt19937 rnd(123);
+	for (uint32_t len : { 70000u, 10u, 200000u, 1u, 65536u, 300u, 150000u, 5000u, 100000u, 7u })
+	{
+		std::string pkg(len, 0);
+		for (auto& c : pkg) c = (char)rnd();
+		pkgs.push_back(std::move(pkg));
+	}
+
+	xx::UV_v uv(mp);
+	auto timer = uv->CreateTimer<TimeoutTimer>(10000);
+	auto listener = uv->CreateListener<SlowReadListener>(sendPort, 128);
+	int size = 4096;
+	uv_recv_buffer_size((uv_handle_t*)&listener->tcpServer, &size);		// 由连上的 socket 继承
+	listener->expected = &pkgs;
+	uv->CreateTimer<StartReadTimer>(listener);
+	auto c = uv->CreateClientPeer<BurstClient>();
+	c->packageHeader = xx::UVPackageHeaders::UInt32;
+	c->pkgs = &pkgs;
+	c->SetAddress("127.0.0.1", sendPort);
+	c->Connect();
+	uv->Run();
+
+	// 最后的写回调可能还没处理
+	for (int i = 0; i < 100 && c->numWritings; ++i) uv_run(&uv->loop, UV_RUN_NOWAIT);
+	Check(!timer->timedOut && listener->peer && listener->peer->received == pkgs.size() && !listener->peer->bad, "a burst written partly by uv_try_write arrives intact and in order");
+	Check(!c->sendErrors && c->maxNumWritings == xx::UVPeer::maxWritings, "a burst keeps several uv_write requests in flight");
+	Check(!c->numWritings && !c->sendBufs->BytesCount(), "every write completes and its buffers are released");
+}
+
+
+/***********************************************************************************/
+// cork: Send 只入队, 于本轮末( I/O 回调后的 uv_check, 或等待 I/O 前的 uv_prepare )合并发出
+/***********************************************************************************/
+
+const int corkPort = 12403;
+bool corkLateTimerFired = false;							// 第二个 timer 是否已触发
+bool corkTimerBatchInTime = false;							// 第一个 timer 发的那批是否于第二个 timer 触发前收齐( 由 uv_prepare 发出, 而不是等到下次 I/O )
+const size_t corkTimerBatchLast = 11;
+
+struct CorkRecvPeer : xx::UVServerPeer
+{
+	std::vector<std::string> const* expected = nullptr;
+	size_t received = 0;
+	int bad = 0;
+	using xx::UVServerPeer::UVServerPeer;
+	virtual void OnReceivePackage(xx::BBuffer& bb) override
+	{
+		if (received >= expected->size() || std::string(bb.buf, bb.dataLen) != (*expected)[received]) ++bad;
+		if (received == corkTimerBatchLast) corkTimerBatchInTime = !corkLateTimerFired;
+		if (++received == expected->size()) uv->Stop();
+	}
+	virtual void OnDisconnect() override {}
+};
+
+struct CorkListener : xx::UVListener
+{
+	std::vector<std::string> const* expected = nullptr;
+	CorkRecvPeer* peer = nullptr;
+	using xx::UVListener::UVListener;
+	virtual xx::UVServerPeer* OnCreatePeer() override
+	{
+		peer = mempool().Create<CorkRecvPeer>(this);
+		peer->expected = expected;
+		return peer;
+	}
+};
+
+// 连上后( I/O 回调 )发 0..7, 第一个 timer 发 8..11, 第二个 timer 发 12..15 后 Disconnect(false)
+struct CorkClient : xx::UVClientPeer
+{
+	std::vector<std::string> const* pkgs = nullptr;
+	int sendErrors = 0;
+	bool queued = false, flushed = false, flushedAfterIO = false, latencyQueued = false, latencyFlushed = false;
+	using xx::UVClientPeer::UVClientPeer;
+	void SendRange(size_t from, size_t to)
+	{
+		for (auto i = from; i < to; ++i)
+		{
+			if (SendPackageData((*pkgs)[i].data(), (uint32_t)(*pkgs)[i].size())) ++sendErrors;
+		}
+	}
+	bool Pending()
+	{
+		return sendBufs->BytesCount() && uv_flushPeers_index != (uint32_t)-1 && !numWritings;
+	}
+	bool Sent()
+	{
+		return !sendBufs->BytesCount() && uv_flushPeers_index == (uint32_t)-1;
+	}
+	virtual void OnConnect() override
+	{
+		if (lastStatus) return;
+		cork = true;
+		SendRange(0, 4);
+		uint32_t bytes = 0;
+		for (size_t i = 0; i < 4; ++i) bytes += 2 + (uint32_t)(*pkgs)[i].size();
+		queued = Pending() && sendBufs->BytesCount() == bytes;		// 只入队, 一个字节都没发
+		SendRange(4, 5);
+		if (Flush()) ++sendErrors;
+		flushed = Sent();											// Flush 立即发出
+		SendRange(5, 8);											// 留给 uv_check 发
+	}
+	void OnFire1()
+	{
+		flushedAfterIO = Sent();
+		SendRange(8, 12);											// 留给 uv_prepare 发
+	}
+	void OnFire2()
+	{
+		flushedAfterIO = flushedAfterIO && Sent();
+		corkMaxLatency = 1;
+		SendRange(12, 13);
+		latencyQueued = Pending();
+		auto t = uv_hrtime();
+		while (uv_hrtime() - t < 10000) {}
+		SendRange(13, 14);
+		latencyFlushed = Sent();									// 最早留待的已超过 corkMaxLatency, 这次 Send 立即发
+		SendRange(14, 16);
+		Disconnect(false);											// 先发出留待的再 shutdown
+	}
+	virtual void OnReceivePackage(xx::BBuffer& bb) override {}
+	virtual void OnDisconnect() override {}
+};
+
+struct CorkTimer : xx::UVTimer
+{
+	CorkClient* client;
+	bool late;
+	CorkTimer(xx::UV* uv, CorkClient* client, uint64_t const& timeoutMS, bool late) : xx::UVTimer(uv), client(client), late(late)
+	{
+		Start(timeoutMS, 0);
+	}
+	virtual void OnFire() override
+	{
+		if (client->state != xx::UVPeerStates::Connected) return;
+		if (late)
+		{
+			corkLateTimerFired = true;
+			client->OnFire2();
+		}
+		else client->OnFire1();
+	}
+};
+
+void TestCork(xx::MemPool& mp)
+{
+	std::vector<std::string> pkgs;
+	std::mt19937 rnd(321);
+	for (int i = 0; i < 16; ++i)
+	{
+		std::string pkg(1 + rnd() % 300, 0);
+		for (auto& c : pkg) c = (char)rnd();
+		pkgs.push_back(std::move(pkg));
+	}
+
+	xx::UV_v uv(mp);
+	auto timer = uv->CreateTimer<TimeoutTimer>(10000);
+	auto listener = uv->CreateListener<CorkListener>(corkPort, 128);
+	listener->expected = &pkgs;
+	auto c = uv->CreateClientPeer<CorkClient>();
+	c->pkgs = &pkgs;
+	c->SetAddress("127.0.0.1", corkPort);
+	c->Connect();
+	uv->CreateTimer<CorkTimer>(c, 100, false);
+	uv->CreateTimer<CorkTimer>(c, 300, true);
+	uv->Run();
+
+	Check(!timer->timedOut && listener->peer && listener->peer->received == pkgs.size() && !listener->peer->bad, "corked packages arrive intact and in order");
+	Check(!c->sendErrors && c->queued, "with cork, Send only queues");
+	Check(c->flushed, "Flush sends corked data at once");
+	Check(c->flushedAfterIO, "data corked in an I/O callback is sent by the end of that loop iteration");
+	Check(corkTimerBatchInTime, "data corked in a timer is sent before waiting for I/O (uv_prepare)");
+	Check(c->latencyQueued && c->latencyFlushed, "a Send past corkMaxLatency flushes at once");
+}
+
+int main()
+{
+	PKG::AllTypesRegister();
+	xx::MemPool mp;
+
+	TestCluster(mp);
+	TestReceive(mp);
+	TestPackageHeaders(mp);
+	TestPartialWrite(mp);
+	TestCork(mp);
+	std::cout << (errors ? "FAILED" : "ok") << std::endl;
+	return errors;
+}
@@ -2,9 +2,17 @@
 #include "xx_mempool.h"
 #include "xx_bbuffer.h"
 #include "xx_queue.h"
+#include <climits>
 
 namespace xx
 {
+	// PopTo 单次最多弹出的段数. 有 IOV_MAX 的平台( writev )按它来, 否则按 64( 听说批量发送指令一般只支持最多 64 段数据 )
+#ifdef IOV_MAX
+	static const uint32_t BBQueueMaxBufsCount = IOV_MAX;
+#else
+	static const uint32_t BBQueueMaxBufsCount = 64;
+#endif
+
 	// 包队列。提供按字节数零散 pop 的功能
 	// 包直接使用 BBuffer 来实现, 指针方式使用, 走引用计数删除
 	struct BBQueue : protected Queue<BBuffer*>
@@ -56,7 +64,7 @@ namespace xx
 		// 如果队列尾包存在，且 非正在发送状态 且 引用计数为 1( 非群发 ), 就返回它用于继续填充. 否则用当前内存池新建一个返回.
 		BBuffer* PopLastBB(uint32_t const& capacity = 0)
 		{
-			if (Count() + numPopBufs > bufIndex && Last()->refCount() == 1)
+			if (Count() + numPopBufs > bufIndex + (byteOffset ? 1 : 0) && Last()->refCount() == 1)	// 尾包已发出一部分( byteOffset ) 时不能再改, 扩容会令发送中的内存失效
 			{
 				numPushLen -= Last()->dataLen;
 				auto bb = Last();
@@ -69,8 +77,19 @@ namespace xx
 		}
 
 		// 将待发数据 bb 压入队列托管( 将同步相应的统计数值, PopTo 后将自动 Release ), 之后不可以再继续操作 bb
+		// 分段写模式的 bb 先按序压入各段( 移交所有权 ), PopTo 时各段即为多段数据, 不再拼接复制
 		void Push(BBuffer* const& bb)
 		{
+			if (bb->chunks)
+			{
+				for (auto& c : *bb->chunks)
+				{
+					numPushLen += c->dataLen;
+					this->BaseType::Push(c);
+				}
+				bb->chunks->Clear();
+				bb->chunksLen = 0;
+			}
 			numPushLen += bb->dataLen;
 			std::swap(bb->ptrStore, ptrStore);
 			std::swap(bb->idxStore, idxStore);
@@ -78,26 +97,22 @@ namespace xx
 		}
 
 		// 弹出指定字节长度到指定容器( [ { len, bufPtr,  }, ... ] 格式 ), 返回实际弹出字节数
-		// 下次调用时将清理上一次的内存 以确保数据持有到发送成功. 也就是说只有发送成功之后才能再次调用该函数.
+		// releasePopped 为真: 下次调用时将清理上一次的内存 以确保数据持有到发送成功. 也就是说只有发送成功之后才能再次调用该函数.
+		// releasePopped 为假: 不清理, 可连续弹出多段同时发送. 记下每次弹出后的 bufIndex, 发送成功后按序 ReleasePopped
 		// 如果发送失败, 要重试, outBufs 的值是可以反复使用的.
-		template<typename T, uint32_t maxBufsCount = 64>
-		uint32_t PopTo(List<T>& outBufs, uint32_t len)
+		template<typename T, uint32_t maxBufsCount = BBQueueMaxBufsCount>
+		uint32_t PopTo(List<T>& outBufs, uint32_t len, bool const& releasePopped = true)
 		{
 			outBufs.Clear();
 			if (!len) return 0;
 
-			if (bufIndex != numPopBufs)							// 清理内存
+			if (releasePopped)
 			{
-				for (uint32_t i = 0; i < bufIndex - numPopBufs; i++)
-				{
-					Top()->Release();
-					Pop();
-				}
-				numPopBufs = bufIndex;
+				ReleasePopped(bufIndex);
 			}
 
-			auto maxIdx = MIN(maxBufsCount, Count());		// 听说批量发送指令一般只支持最多 64 段数据
 			auto idx = uint32_t(bufIndex - numPopBufs);
+			auto maxIdx = MIN(idx + maxBufsCount, Count());
 			if (idx >= maxIdx) return 0;						// 没有数据要发
 
 			auto bak_len = len;
@@ -124,6 +139,18 @@ namespace xx
 			return bak_len - len;
 		}
 
+		// 释放 popBufIndex( 某次 PopTo 之后的 bufIndex )之前已弹完的 bb. 弹出的数据发送成功后调用
+		void ReleasePopped(uint32_t const& popBufIndex)
+		{
+			assert(popBufIndex <= bufIndex);
+			while (numPopBufs < popBufIndex)
+			{
+				Top()->Release();
+				Pop();
+				++numPopBufs;
+			}
+		}
+
 		// 清光所有数据, 释放所有 bb
 		void Clear()
 		{
@@ -5,9 +5,229 @@
 #include "xx_string.h"
 #include "xx_list.h"
 #include "xx_dict.h"
+#include "xx_lz4.h"
 
 namespace xx
 {
+#ifdef XX_MEMPOOL_STATS
+	/*************************************************************************/
+	// MemPool 统计数据的序列化适配
+	/*************************************************************************/
+
+	template<>
+	struct BytesFunc<MemPool::ClassStat, void>
+	{
+		static inline uint32_t Calc(MemPool::ClassStat const &in)
+		{
+			return BBCalc(in.classSize, in.allocs, in.frees, in.hits, in.misses, in.live, in.peak);
+		}
+		static inline uint32_t WriteTo(char *dstBuf, MemPool::ClassStat const &in)
+		{
+			return BBWriteTo(dstBuf, in.classSize, in.allocs, in.frees, in.hits, in.misses, in.live, in.peak);
+		}
+		static inline int ReadFrom(char const *srcBuf, uint32_t const &dataLen, uint32_t &offset, MemPool::ClassStat &out)
+		{
+			return BBReadFrom(srcBuf, dataLen, offset, out.classSize, out.allocs, out.frees, out.hits, out.misses, out.live, out.peak);
+		}
+	};
+
+	template<>
+	struct BytesFunc<MemPool::TypeStat, void>
+	{
+		static inline uint32_t Calc(MemPool::TypeStat const &in)
+		{
+			return BBCalc(in.typeId, in.live, in.bytes);
+		}
+		static inline uint32_t WriteTo(char *dstBuf, MemPool::TypeStat const &in)
+		{
+			return BBWriteTo(dstBuf, in.typeId, in.live, in.bytes);
+		}
+		static inline int ReadFrom(char const *srcBuf, uint32_t const &dataLen, uint32_t &offset, MemPool::TypeStat &out)
+		{
+			return BBReadFrom(srcBuf, dataLen, offset, out.typeId, out.live, out.bytes);
+		}
+	};
+#endif
+
+
+	/*************************************************************************/
+	// Handle 的序列化适配( 按 uint32_t 变长写 )
+	/*************************************************************************/
+
+	template<typename T>
+	struct BytesFunc<Handle<T>, void>
+	{
+		static inline uint32_t Calc(Handle<T> const &in)
+		{
+			return BBCalc(in.value);
+		}
+		static inline uint32_t WriteTo(char *dstBuf, Handle<T> const &in)
+		{
+			return BBWriteTo(dstBuf, in.value);
+		}
+		static inline int ReadFrom(char const *srcBuf, uint32_t const &dataLen, uint32_t &offset, Handle<T> &out)
+		{
+			return BBReadFrom(srcBuf, dataLen, offset, out.value);
+		}
+	};
+
+
+	/*************************************************************************/
+	// 树形包标记
+	/*************************************************************************/
+
+	// 标记 T 为树形包( 其数据中不存在共享 / 循环引用 ). 以 T 为 root 的 WriteRoot / ReadRoot 将不做指针去重:
+	// 指针按 类型编号 + 类数据 写( 同 C# 端不带引用的编码 ), 省掉每个对象的字典操作. 须经 MemPool::Register 注册生效.
+	template<typename T, typename ENABLE = void>
+	struct NoPtrDedup
+	{
+		static const bool value = false;
+	};
+
+
+	/*************************************************************************/
+	// StringView / BytesView( 反序列化时直接引用接收缓冲区的只读视图 )
+	/*************************************************************************/
+
+	// 线上格式与 String* / BBuffer* 相同. 读时不创建对象也不复制, buf 直接指向 BBuffer 的内存,
+	// 故只在该段内存有效期内可用( 通常即 OnReceivePackage 期间 ), 需长期持有时用 Materialize 复制成对象.
+	// buf 为空表示 nullptr. 写时总是按新对象写出( 不参与指针去重 ).
+	// 读时可引用之前出现的 String* / BBuffer* 或视图, 但之后出现的 String* / BBuffer* 不可引用视图读出的数据( 返回 -4 ).
+	template<typename T>
+	struct BufView
+	{
+		char const* buf = nullptr;
+		uint32_t dataLen = 0;
+
+		BufView() = default;
+		BufView(char const* buf, uint32_t dataLen) : buf(buf), dataLen(dataLen) {}
+		BufView(T const* o) : buf(o ? o->buf : nullptr), dataLen(o ? o->dataLen : 0) {}
+
+		explicit operator bool() const
+		{
+			return buf != nullptr;
+		}
+
+		// 用 mp 创建对象并复制数据( 视图为空则返回 nullptr )
+		T* Materialize(MemPool& mp) const
+		{
+			if (!buf) return nullptr;
+			auto o = mp.Create<T>(dataLen);
+			if (o) o->AddRange(buf, dataLen);
+			return o;
+		}
+	};
+	typedef BufView<String> StringView;
+	typedef BufView<BBuffer> BytesView;
+
+	template<typename T>
+	struct IsBufView
+	{
+		static const bool value = false;
+	};
+	template<typename T>
+	struct IsBufView<BufView<T>>
+	{
+		static const bool value = true;
+	};
+	template<typename T>
+	constexpr bool IsBufView_v = IsBufView<T>::value;
+
+	// 取 指针 / MPtr / Ptr / 视图 所指的类型( 供 BBuffer::Skip 判断能否按 String / BBuffer 的格式跳过 )
+	template<typename T>
+	struct BBSkipTarget
+	{
+		typedef void type;
+	};
+	template<typename T>
+	struct BBSkipTarget<T*>
+	{
+		typedef T type;
+	};
+	template<typename T>
+	struct BBSkipTarget<MPtr<T>>
+	{
+		typedef T type;
+	};
+	template<typename T>
+	struct BBSkipTarget<Ptr<T>>
+	{
+		typedef T type;
+	};
+	template<typename T>
+	struct BBSkipTarget<BufView<T>>
+	{
+		typedef T type;
+	};
+
+
+	/*************************************************************************/
+	// 包头
+	/*************************************************************************/
+
+	// 用作 BeginWritePackage 等的 SizeType, 表示包头为 7bit 变长编码的数据长度( 1 ~ 5 字节 )
+	struct VarPackageSize {};
+
+	// 包头的 保留长度 与 所能表达的数据长度上限
+	template<typename SizeType>
+	struct PackageSizeTraits
+	{
+		static const uint32_t headerLen = sizeof(SizeType);
+		static const uint64_t maxLen = std::numeric_limits<SizeType>::max();
+	};
+	template<>
+	struct PackageSizeTraits<VarPackageSize>
+	{
+		static const uint32_t headerLen = 5;
+		static const uint64_t maxLen = std::numeric_limits<uint32_t>::max();
+	};
+
+	template<>
+	struct StrFunc<StringView, void>
+	{
+		static inline uint32_t Calc(StringView const &in)
+		{
+			return in.buf ? in.dataLen + 2 : 3;
+		}
+		static inline uint32_t WriteTo(char *dstBuf, StringView const &in)
+		{
+			if (!in.buf)
+			{
+				memcpy(dstBuf, "nil", 3);
+				return 3;
+			}
+			dstBuf[0] = '\"';
+			memcpy(dstBuf + 1, in.buf, in.dataLen);
+			dstBuf[in.dataLen + 1] = '\"';
+			return in.dataLen + 2;
+		}
+	};
+
+	template<>
+	struct StrFunc<BytesView, void>
+	{
+		static inline uint32_t Calc(BytesView const &in)
+		{
+			return in.buf ? 40 + in.dataLen * 5 : 3;
+		}
+		static inline uint32_t WriteTo(char *dstBuf, BytesView const &in)
+		{
+			if (!in.buf)
+			{
+				memcpy(dstBuf, "nil", 3);
+				return 3;
+			}
+			auto len = StrWriteTo(dstBuf, "{ \"len\" : ", in.dataLen, ", \"data\" : [ ");
+			for (uint32_t i = 0; i < in.dataLen; i++)
+			{
+				len += StrWriteTo(dstBuf + len, (int)(uint8_t)in.buf[i], ", ");
+			}
+			if (in.dataLen) len -= 2;
+			len += StrWriteTo(dstBuf + len, " ] }");
+			return len;
+		}
+	};
+
 
 	/*************************************************************************/
 	// BBufferRWSwitcher( GCC 需要将这样的声明写在类外面 )
@@ -18,14 +238,16 @@ namespace xx
 	{
 		static void Write(BBuffer* bb, T const& v);
 		static int Read(BBuffer* bb, T& v);
+		static uint64_t Calc(T const& v);
 	};
 
 	// 非 MPObject 任何形态
 	template<typename T>
-	struct BBufferRWSwitcher<T, std::enable_if_t< !IsMPObject_v<T> >>
+	struct BBufferRWSwitcher<T, std::enable_if_t< !IsMPObject_v<T> && !IsBufView_v<T> >>
 	{
 		static void Write(BBuffer* bb, T const& v);
 		static int Read(BBuffer* bb, T& v);
+		static uint64_t Calc(T const& v);
 	};
 
 	// MPObject* || MPtr || Ptr ( 能当指针来处理的 )
@@ -34,6 +256,7 @@ namespace xx
 	{
 		static void Write(BBuffer* bb, T const& v);
 		static int Read(BBuffer* bb, T& v);
+		static uint64_t Calc(T const& v);
 	};
 
 	// Dock
@@ -42,6 +265,16 @@ namespace xx
 	{
 		static void Write(BBuffer* bb, T const& v);
 		static int Read(BBuffer* bb, T& v);
+		static uint64_t Calc(T const& v);
+	};
+
+	// StringView / BytesView
+	template<typename T>
+	struct BBufferRWSwitcher<T, std::enable_if_t< IsBufView_v<T> >>
+	{
+		static void Write(BBuffer* bb, T const& v);
+		static int Read(BBuffer* bb, T& v);
+		static uint64_t Calc(T const& v);
 	};
 
 	// todo: 这里并未支持 MPObjectStruct 参与序列化, 因为实际上不会那么用
@@ -57,6 +290,14 @@ namespace xx
 		uint32_t offsetRoot = 0;				// offset值写入修正
 		uint32_t dataLenBak = 0;				// WritePackage 时用于备份当前数据写入偏移
 		uint32_t readLengthLimit = 0;			// 主用于传递给容器类进行长度合法校验
+		MemPool* readMemPool = nullptr;			// 反序列化创建对象所用的内存池. 空则使用 BBuffer 自己的( 可指向临时池以配合 ArenaScope )
+		bool writeDedup = true;					// WritePtr 是否做指针去重( 支持共享 / 循环引用 ). 由 WriteRoot 设置
+		bool readDedup = true;					// ReadPtr 是否做指针去重. 由 ReadRoot 设置
+		bool writeUnchecked = false;			// WritePods 及整块写入的 List / BBuffer 不再 Reserve. 由 WriteRoot 按 CalcBBufferSize 预留好空间后设置
+		uint32_t lastRootLen = 0;				// 上次 WriteRoot 写入的长度. 剩余空间不足它时 WriteRoot 才预先计算长度上限
+		List<BBuffer*>* chunks = nullptr;		// 非空即分段写模式( 见 EnableChunks ): 空间不足时已写数据连内存移交给新 BBuffer 追加于此, 不扩容复制
+		uint32_t chunksLen = 0;					// chunks 中的数据总长. 加 dataLen 即为逻辑写入位置
+		uint32_t chunkSize = 0;					// 分段写模式下新分配块的最小长度
 
 		BBuffer(BBuffer const&o) = delete;
 		BBuffer& operator=(BBuffer const&o) = delete;
@@ -66,6 +307,111 @@ namespace xx
 		{
 			mempool().SafeRelease(ptrStore);
 			mempool().SafeRelease(idxStore);
+			if (chunks)
+			{
+				ClearChunks();
+				chunks->Release();
+			}
+		}
+
+		/*************************************************************************/
+		// 分段写模式. 拼超大消息( 如整个场景的状态 )时免去反复扩容复制. 各段可直接交给 BBQueue / UVPeer::Send 作为多段数据发送
+		// 写入中途只有 数据长度, 包头回填, 指针去重 offset 依赖位置, 都已按逻辑位置处理. 分段写模式下不压缩
+		// 可安全使用的写入接口: Write* 系列, WriteRoot, WritePackage*, 以及下面覆盖的 Reserve / Add / Emplace / AddRange
+		// List 的函数并非虚函数: 经由 List<char, 16>& 调用的扩容( 以及 Resize, InsertAt, EmplaceAt )仍会直接扩容而绕过分段
+		/*************************************************************************/
+
+		void EnableChunks(uint32_t const& chunkSize = 65536)
+		{
+			if (!chunks) this->mempool().CreateTo(chunks);
+			this->chunkSize = chunkSize;
+		}
+
+		// 覆盖 List::Reserve. 分段写模式下空间不足时, 已写数据( 连同内存 )移交给新 BBuffer 追加到 chunks, 本体换一块新内存
+		// 已取得的 buf 指针仍然有效( 指向移交出去的块 ), 只有基于 dataLen 的位置会变, 故位置都用 WritePos
+		void Reserve(uint32_t const& capacity)
+		{
+			if (capacity <= this->bufLen) return;
+			if (!chunks || !this->dataLen)
+			{
+				this->BaseType::Reserve(capacity < chunkSize ? chunkSize : capacity);
+				return;
+			}
+			auto c = this->mempool().Create<BBuffer>();
+			std::swap(c->buf, this->buf);
+			std::swap(c->bufLen, this->bufLen);
+			c->dataLen = this->dataLen;
+			chunks->Add(c);
+			chunksLen += this->dataLen;
+			auto len = capacity - this->dataLen;
+			this->dataLen = 0;
+			this->BaseType::Reserve(len < chunkSize ? chunkSize : len);
+		}
+
+		// 覆盖 List::Add / Emplace / AddRange, 使之走上面的 Reserve
+		void Add(char const& v)
+		{
+			this->Reserve(this->dataLen + 1);
+			this->buf[this->dataLen++] = v;
+		}
+		char& Emplace(char const& v = 0)
+		{
+			this->Reserve(this->dataLen + 1);
+			return this->buf[this->dataLen++] = v;
+		}
+		void AddRange(char const* items, uint32_t count)
+		{
+			WriteBuf(items, count);
+		}
+
+		// 逻辑写入位置( 含已移交到 chunks 的数据 )
+		uint32_t WritePos() const
+		{
+			return chunksLen + this->dataLen;
+		}
+
+		// 逻辑位置 pos 处的内存( 分段写模式下可能位于 chunks 中 )
+		char* WritePosAt(uint32_t const& pos)
+		{
+			if (pos >= chunksLen) return this->buf + (pos - chunksLen);
+			auto p = chunksLen;
+			for (auto i = chunks->dataLen - 1; ; --i)
+			{
+				auto c = chunks->At(i);
+				p -= c->dataLen;
+				if (pos >= p) return c->buf + (pos - p);
+			}
+		}
+
+		// 回退到逻辑位置 pos, 丢弃其后写入的数据
+		void WritePosRollback(uint32_t const& pos)
+		{
+			while (pos < chunksLen)
+			{
+				auto c = chunks->Top();
+				chunks->Pop();
+				std::swap(c->buf, this->buf);
+				std::swap(c->bufLen, this->bufLen);
+				this->dataLen = c->dataLen;
+				chunksLen -= c->dataLen;
+				c->Release();
+			}
+			this->dataLen = pos - chunksLen;
+		}
+
+		// 释放 chunks 中的数据( 不退出分段写模式 )
+		void ClearChunks()
+		{
+			for (auto& c : *chunks) c->Release();
+			chunks->Clear();
+			chunksLen = 0;
+		}
+
+		// 覆盖 List::Clear, 顺便清掉 chunks
+		void Clear(bool const& freeBuf = false)
+		{
+			if (chunks) ClearChunks();
+			this->BaseType::Clear(freeBuf);
 		}
 
 		/*************************************************************************/
@@ -82,6 +428,17 @@ namespace xx
 		{
 			return BBufferRWSwitcher<T>::Read(this, v);
 		}
+		// 返回不去重时 Write(v) 写入长度的上限( 含 MPObject 的 CalcBBufferSize. 未知则 >= BBufferSizeUnknown )
+		template<typename T>
+		static uint64_t CalcWriteSize(T const& v)
+		{
+			return BBufferRWSwitcher<T>::Calc(v);
+		}
+		template<typename T, typename ...TS>
+		static uint64_t CalcWriteSize(T const& v, TS const& ...vs)
+		{
+			return BBufferRWSwitcher<T>::Calc(v) + CalcWriteSize(vs...);
+		}
 
 
 		/*************************************************************************/
@@ -91,7 +448,11 @@ namespace xx
 		template<typename ...TS>
 		void WritePods(TS const& ...vs)
 		{
-			this->Reserve(this->dataLen + BBCalc(vs...));
+			if (!writeUnchecked)
+			{
+				auto len = BBCalc(vs...);											// 先就地比较, 空间不足才调 Reserve( 它通常不会被内联 )
+				if (this->dataLen + len > this->bufLen) this->Reserve(this->dataLen + len);
+			}
 			this->dataLen += BBWriteTo(this->buf + this->dataLen, vs...);
 			assert(this->dataLen <= this->bufLen);
 		}
@@ -105,6 +466,25 @@ namespace xx
 		int ReadPods() { return 0; }
 
 
+		/*************************************************************************/
+		// 4 / 8 字节整数数组批量读写( 与逐个 Write / Read 的结果一致 )
+		/*************************************************************************/
+
+		template<typename T>
+		void WriteVarInts(T const* vs, uint32_t len)
+		{
+			this->Reserve(this->dataLen + len * (sizeof(T) + 1) + 8);
+			this->dataLen += VarWrite7Array(this->buf + this->dataLen, vs, len);
+			assert(this->dataLen <= this->bufLen);
+		}
+
+		template<typename T>
+		int ReadVarInts(T* vs, uint32_t len)
+		{
+			return VarRead7Array(this->buf, this->dataLen, this->offset, vs, len);
+		}
+
+
 		/*************************************************************************/
 		//  MPObject 对象读写系列
 		/*************************************************************************/
@@ -116,7 +496,7 @@ namespace xx
 		{
 			if (!ptrStore) this->mempool().CreateTo(ptrStore, 16);
 			//else ptrStore->Clear();
-			offsetRoot = dataLen;
+			offsetRoot = WritePos();
 		}
 		void EndWrite()
 		{
@@ -135,28 +515,105 @@ namespace xx
 			idxStore->Clear();
 		}
 
-		// 一键爽 write
+		// 一键爽 write. 是否做指针去重由 root 的类型决定( 见 NoPtrDedup )
 		template<typename T>
 		void WriteRoot(T const& v)
 		{
-			BeginWrite();
+			WriteRoot(v, !IsNoPtrDedupRoot(v));
+		}
+		// 一键爽 write. dedup 为 false 时不做指针去重( 数据中不可存在共享 / 循环引用 )
+		// 不去重且剩余空间不足上次写入长度时( 通常是新 BBuffer ), 先算出长度上限一次性 Reserve, 之后的写入不再逐个检查空间( 分段写模式除外 )
+		template<typename T>
+		void WriteRoot(T const& v, bool const& dedup)
+		{
+			auto bak = writeDedup;
+			auto bakUnchecked = writeUnchecked;
+			auto bakPos = WritePos();
+			writeDedup = dedup;
+			writeUnchecked = false;
+			if (!dedup && !chunks && bufLen - dataLen <= lastRootLen)
+			{
+				auto siz = CalcWriteSize(v);
+				if (siz < BBufferSizeUnknown && dataLen + siz <= std::numeric_limits<uint32_t>::max())
+				{
+					this->Reserve(dataLen + (uint32_t)siz);
+					writeUnchecked = true;
+				}
+			}
+			if (dedup) BeginWrite();
 			Write(v);
-			EndWrite();
+			if (dedup) EndWrite();
+			lastRootLen = WritePos() - bakPos;
+			writeDedup = bak;
+			writeUnchecked = bakUnchecked;
 		}
-		// 一键爽 read
+		// 一键爽 read. 是否做指针去重由数据中 root 的类型编号决定( 与 WriteRoot 对应 )
 		template<typename T>
 		int ReadRoot(T &v)
 		{
-			BeginRead();
+			return ReadRoot(v, !PeekNoPtrDedupRoot<T>());
+		}
+		// 一键爽 read. dedup 须与写入时一致
+		template<typename T>
+		int ReadRoot(T &v, bool const& dedup)
+		{
+			auto bak = readDedup;
+			readDedup = dedup;
+			if (dedup) BeginRead();
 			auto rtv = Read(v);
-			EndRead();
+			if (dedup) EndRead();
+			readDedup = bak;
 			return rtv;
 		}
 
+		// root 是否为注册了 NoPtrDedup 的类型
+		template<typename T>
+		static std::enable_if_t<IsMPObjectPointer_v<T>, bool> IsNoPtrDedupRoot(T const& v)
+		{
+			return v && MemPool::noPtrDedups()[v->typeId()];
+		}
+		template<typename T>
+		static std::enable_if_t<IsMPtr_v<T>, bool> IsNoPtrDedupRoot(T const& v)
+		{
+			return IsNoPtrDedupRoot(v.Ensure());
+		}
+		template<typename T>
+		static std::enable_if_t<IsPtr_v<T>, bool> IsNoPtrDedupRoot(T const& v)
+		{
+			return IsNoPtrDedupRoot(v.pointer);
+		}
+		template<typename T>
+		static std::enable_if_t<!IsMPObjectPointer_v<T> && !IsMPtr_v<T> && !IsPtr_v<T>, bool> IsNoPtrDedupRoot(T const& v)
+		{
+			return false;
+		}
+
+		// 从当前 offset 预读 root 的类型编号, 返回其是否为注册了 NoPtrDedup 的类型
+		template<typename T>
+		std::enable_if_t<IsMPObjectPointer_v<T> || IsMPtr_v<T> || IsPtr_v<T>, bool> PeekNoPtrDedupRoot() const
+		{
+			uint16_t tid = 0;
+			uint32_t o = offset;
+			if (BBReadFrom(this->buf, this->dataLen, o, tid)) return false;
+			return MemPool::noPtrDedups()[tid];
+		}
+		template<typename T>
+		std::enable_if_t<!IsMPObjectPointer_v<T> && !IsMPtr_v<T> && !IsPtr_v<T>, bool> PeekNoPtrDedupRoot() const
+		{
+			return false;
+		}
+
+		// 从当前 offset 预读 root 的类型编号( 不移动 offset, 不创建对象 ). 成功返回 0
+		// 用于按类型分派: 先据此找处理函数, 找到了才 ReadRoot, 丢弃 / 转发的包就不必反序列化
+		int PeekRootTypeId(uint16_t& tid) const
+		{
+			uint32_t o = offset;
+			return BBReadFrom(this->buf, this->dataLen, o, tid);
+		}
+
 		template<typename T>
 		void WritePtr(T* const& v)
 		{
-			assert(ptrStore);
 			if (!v)
 			{
 				WritePods((uint8_t)0);
@@ -164,7 +621,16 @@ namespace xx
 			}
 			WritePods(v->typeId());
 
-			auto rtv = ptrStore->Add((void*)v, dataLen - offsetRoot);
+			// 不去重: 类型编号 + 类数据
+			if (!writeDedup)
+			{
+				v->ToBBuffer(*this);
+				return;
+			}
+
+			assert(ptrStore);
+
+			auto rtv = ptrStore->Add((void*)v, WritePos() - offsetRoot);
 			WritePods(ptrStore->ValueAt(rtv.index));
 			if (rtv.success)
 			{
@@ -174,8 +640,6 @@ namespace xx
 		template<typename T>
 		int ReadPtr(T* &v)
 		{
-			assert(idxStore);
-
 			// get typeid
 			uint16_t tid;
 			if (auto rtv = ReadPods(tid)) return rtv;
@@ -187,6 +651,18 @@ namespace xx
 				return 0;
 			}
 
+			// 不去重: 类型编号 + 类数据
+			if (!readDedup)
+			{
+				if (!mempool().IsBaseOf(TypeId<T>::value, tid)) return -2;
+				auto f = MemPool::creators()[tid];
+				assert(f);
+				v = (T*)f(readMemPool ? readMemPool : &mempool(), this, 0);
+				return v ? 0 : -3;
+			}
+
+			assert(idxStore);
+
 			// get offset
 			uint32_t ptr_offset = 0, bb_offset_bak = offset - offsetRoot;
 			if (auto rtv = ReadPods(ptr_offset)) return rtv;
@@ -202,7 +678,7 @@ namespace xx
 				assert(f);
 
 				// try create & read from bb
-				v = (T*)f(&mempool(), this, ptr_offset);
+				v = (T*)f(readMemPool ? readMemPool : &mempool(), this, ptr_offset);
 				if (v == nullptr) return -3;
 			}
 			else
@@ -220,6 +696,23 @@ namespace xx
 			return 0;
 		}
 
+		// 不去重时指针写入长度的上限( 类型编号 + 类数据 ). 只用于树形数据, 故不防循环引用
+		static uint64_t CalcPtrSize(MPObject const* const& v)
+		{
+			if (!v) return 1;
+			return BBCalc(v->typeId()) + v->CalcBBufferSize();
+		}
+		template<typename T>
+		static uint64_t CalcPtrSize(MPtr<T> const& v)
+		{
+			return CalcPtrSize(v.Ensure());
+		}
+		template<typename T>
+		static uint64_t CalcPtrSize(Ptr<T> const& v)
+		{
+			return CalcPtrSize(v.pointer);
+		}
+
 		template<typename T>
 		void WritePtr(MPtr<T> const& v)
 		{
@@ -260,6 +753,91 @@ namespace xx
 		}
 
 
+		template<typename T>
+		void WriteView(BufView<T> const& v)
+		{
+			if (!v.buf)
+			{
+				WritePods((uint8_t)0);
+				return;
+			}
+			WritePods((uint16_t)TypeId<T>::value);
+			if (writeDedup) WritePods(WritePos() - offsetRoot);
+			WritePods(v.dataLen);
+			WriteBuf(v.buf, v.dataLen);
+		}
+		template<typename T>
+		int ReadView(BufView<T> &v)
+		{
+			// get typeid
+			uint16_t tid;
+			if (auto rtv = ReadPods(tid)) return rtv;
+
+			// isnull ?
+			if (tid == 0)
+			{
+				v = BufView<T>();
+				return 0;
+			}
+			if (tid != TypeId<T>::value) return -2;
+			if (!readDedup) return ReadViewBody(v);
+
+			// get offset
+			uint32_t ptr_offset = 0, bb_offset_bak = offset - offsetRoot;
+			if (auto rtv = ReadPods(ptr_offset)) return rtv;
+
+			// fill
+			if (ptr_offset == bb_offset_bak) return ReadViewBody(v);
+
+			// ref 之前读出的 String* / BBuffer*
+			typename std::remove_pointer_t<decltype(idxStore)>::ValueType val;
+			if (idxStore && idxStore->TryGetValue(ptr_offset, val))
+			{
+				if (std::get<1>(val) != tid) return -2;
+				v = BufView<T>((T*)std::get<0>(val));
+				return 0;
+			}
+
+			// ref 之前读出的视图: 回到其数据处重新定位
+			if (ptr_offset > bb_offset_bak) return -4;
+			auto bak = offset;
+			offset = offsetRoot + ptr_offset;
+			uint32_t tmp = 0;
+			auto rtv = ReadPods(tmp);
+			if (!rtv && tmp != ptr_offset) rtv = -4;
+			if (!rtv) rtv = ReadViewBody(v);
+			offset = bak;
+			return rtv;
+		}
+		template<typename T>
+		int ReadViewBody(BufView<T> &v)
+		{
+			uint32_t len = 0;
+			if (auto rtv = ReadPods(len)) return rtv;
+			if (readLengthLimit != 0 && len > readLengthLimit) return -1;
+			if ((uint64_t)offset + len > dataLen) return -2;
+			v = BufView<T>(buf + offset, len);
+			offset += len;
+			return 0;
+		}
+
+		// 跳过一个 T 类型的值( 不创建对象 ). T 可为 基础类型 / 枚举 / 结构体 等值类型, 或 String* / BBuffer* 系( 含 MPtr, Ptr, 视图 )
+		// 类实例的长度须逐字段解析才知道, 不支持跳过. 整包丢弃用 SkipPackage, 或直接不读 OnReceivePackage 的 bb
+		// 注意: 去重模式下被跳过的 String* / BBuffer* 之后只能以视图方式引用( 同 ReadView 的限制 )
+		template<typename T>
+		std::enable_if_t<!IsMPObject_v<T> && !IsBufView_v<T>, int> Skip()
+		{
+			T v;
+			return ReadPods(v);
+		}
+		template<typename T>
+		std::enable_if_t<(IsMPObject_v<T> || IsBufView_v<T>) && (std::is_same<typename BBSkipTarget<T>::type, String>::value || std::is_same<typename BBSkipTarget<T>::type, BBuffer>::value), int> Skip()
+		{
+			BufView<typename BBSkipTarget<T>::type> v;
+			return ReadView(v);
+		}
+
+
 		/*************************************************************************/
 		//  其他工具函数
 		/*************************************************************************/
@@ -345,29 +923,59 @@ namespace xx
 		}
 
 
-		// 开始写一个包( 特指 2 字节长度头的, 保留出包头区域 )
+		// 开始写一个包( 保留出包头区域 ). SizeType 为包头的长度类型, 默认 2 字节. VarPackageSize 为变长包头, 先按最长保留
 		template<typename SizeType = uint16_t>
 		void BeginWritePackage()
 		{
-			dataLenBak = dataLen;
-			Reserve(dataLen + sizeof(SizeType));
-			dataLen += sizeof(SizeType);
+			Reserve(dataLen + PackageSizeTraits<SizeType>::headerLen);
+			dataLenBak = WritePos();
+			dataLen += PackageSizeTraits<SizeType>::headerLen;
 		}
 
-		// 结束写一个包, 返回长度是否在包头表达范围内( 如果 true 则会填充包头, false 则回滚长度 )
+		// 结束写一个包, 返回长度是否在包头表达范围内且不超过 maxLen( 如果 true 则会填充包头, false 则回滚长度 )
 		template<typename SizeType = uint16_t>
-		bool EndWritePackage()
+		bool EndWritePackage(uint32_t const& maxLen = std::numeric_limits<uint32_t>::max())
 		{
-			auto pkgLen = dataLen - dataLenBak - sizeof(SizeType);
-			if (pkgLen > std::numeric_limits<SizeType>::max())
+			auto pkgLen = WritePos() - dataLenBak - PackageSizeTraits<SizeType>::headerLen;
+			if (pkgLen > PackageSizeTraits<SizeType>::maxLen || pkgLen > maxLen)
 			{
-				dataLen = dataLenBak;
+				WritePosRollback(dataLenBak);
 				return false;
 			}
-			memcpy(buf + dataLenBak, &pkgLen, sizeof(SizeType));
+			WritePackageHeader(pkgLen, (SizeType*)nullptr);
 			return true;
 		}
 
+		// 于 dataLenBak 处填充定长包头
+		template<typename SizeType>
+		void WritePackageHeader(uint32_t const& pkgLen, SizeType*)
+		{
+			auto len = (SizeType)pkgLen;
+			memcpy(WritePosAt(dataLenBak), &len, sizeof(SizeType));
+		}
+
+		// 于 dataLenBak 处填充变长包头. 短包将数据前移贴紧包头; 长包( 或分段写模式 )不移动数据,
+		// 而是在编码中插入冗余的 0x80 字节将包头补足 5 字节( VarRead7 照样能读 )
+		void WritePackageHeader(uint32_t const& pkgLen, VarPackageSize*)
+		{
+			char h[5];
+			auto n = VarWrite7(h, pkgLen);
+			auto p = WritePosAt(dataLenBak);
+			if (n < 5 && !chunks && pkgLen <= 4096)
+			{
+				memmove(p + n, p + 5, pkgLen);
+				dataLen -= 5 - n;
+			}
+			else if (n < 5)
+			{
+				h[n - 1] |= 0x80;
+				for (; n < 4; ++n) h[n] = (char)0x80;
+				h[4] = 0;
+				n = 5;
+			}
+			memcpy(p, h, n);
+		}
+
 		// 一键爽 write 定长 字节长度 + root数据. 如果超过 长度最大计数, 将回滚 dataLen 并返回 false
 		template<typename SizeType = uint16_t, typename T>
 		bool WritePackage(T const& v)
@@ -377,6 +985,120 @@ namespace xx
 			return EndWritePackage<SizeType>();
 		}
 
+		// 开始写一个可压缩的包( 包头后多保留 1 字节压缩标记: 0 原样, 1 为 [原长 varint] + [LZ4 块] )
+		template<typename SizeType = uint16_t>
+		void BeginWritePackageCompressible()
+		{
+			BeginWritePackage<SizeType>();
+			Reserve(dataLen + 1);
+			buf[dataLen++] = 0;
+		}
+
+		// 结束写一个可压缩的包. 数据长度达到 threshold 时尝试压缩, 变短才替换并置标记. 返回值同 EndWritePackage
+		// 压缩后才放得进包头的大包也能发出. 分段写模式下不压缩
+		template<typename SizeType = uint16_t>
+		bool EndWritePackageCompressible(uint32_t const& threshold, uint32_t const& maxLen = std::numeric_limits<uint32_t>::max())
+		{
+			auto pos = dataLenBak + PackageSizeTraits<SizeType>::headerLen + 1;
+			auto rawLen = dataLen - pos;
+			if (!chunks && rawLen >= threshold)
+			{
+				// 压到已有数据后面的空闲区, 变短则拷回原位
+				Reserve(dataLen + 5 + LZ4CompressBound(rawLen));
+				auto p = buf + dataLen;
+				auto len = VarWrite7(p, rawLen);
+				len += LZ4Compress(buf + pos, rawLen, p + len);
+				if (len < rawLen)
+				{
+					buf[pos - 1] = 1;
+					memcpy(buf + pos, p, len);
+					dataLen = pos + len;
+				}
+			}
+			return EndWritePackage<SizeType>(maxLen);
+		}
+
+		// 一键爽 write 可压缩的包
+		template<typename SizeType = uint16_t, typename T>
+		bool WritePackageCompressible(T const& v, uint32_t const& threshold)
+		{
+			BeginWritePackageCompressible<SizeType>();
+			WriteRoot(v);
+			return EndWritePackageCompressible<SizeType>(threshold);
+		}
+
+		// 解开可压缩包的数据( 不含包头, 首字节为压缩标记 ). 未压缩时 buf, len 改为指向标记之后, 压缩时解压到 tmp 并指向它. 成功返回 0
+		// 解压后的长度超过 maxLen 视为非法( 防止恶意包令 tmp 分配巨量内存 )
+		static int ReadPackageCompressible(char*& buf, uint32_t& len, BBuffer& tmp, uint32_t const& maxLen = std::numeric_limits<uint32_t>::max())
+		{
+			if (!len) return -1;
+			auto flag = buf[0];
+			++buf;
+			--len;
+			if (!flag) return 0;
+			if (flag != 1) return -2;
+
+			uint32_t offset = 0, rawLen = 0;
+			if (auto rtv = VarRead7(buf, len, offset, rawLen)) return rtv;
+			if (rawLen / 255 > len) return -3;				// 超出 LZ4 的最大压缩比, 不可能是合法数据
+			if (rawLen > maxLen) return -4;
+			tmp.Reserve(rawLen);
+			if (auto rtv = LZ4Decompress(buf + offset, len - offset, tmp.buf, rawLen)) return rtv;
+			tmp.dataLen = rawLen;
+			buf = tmp.buf;
+			len = rawLen;
+			return 0;
+		}
+
+		// 从当前 offset 预读一个 [包头] + [数据] 的 数据长度 与 root 的类型编号( 不移动 offset, 不创建对象 )
+		// 成功返回 0; 数据还不完整返回 1( 等后续数据 ); 数据非法返回负数. 可压缩包请先 ReadPackageCompressible
+		// 网关类应用可据此决定 SkipPackage 丢弃, 或将 buf + offset 起 包头 + pkgLen 字节原样转发
+		template<typename SizeType = uint16_t>
+		int PeekPackage(uint32_t& pkgLen, uint16_t& tid) const
+		{
+			if (dataLen < offset) return 1;
+			auto headerLen = ReadPackageHeader(buf + offset, dataLen - offset, pkgLen, (SizeType*)nullptr);
+			if (headerLen <= 0) return headerLen ? headerLen : 1;
+			auto o = offset + (uint32_t)headerLen;
+			if (dataLen - o < pkgLen) return 1;
+			return BBReadFrom(this->buf, o + pkgLen, o, tid);
+		}
+
+		// 跳过当前 offset 处的一个 [包头] + [数据]. 成功返回 0, 数据不完整返回 1, 包头非法返回负数
+		template<typename SizeType = uint16_t>
+		int SkipPackage()
+		{
+			if (dataLen < offset) return 1;
+			uint32_t pkgLen = 0;
+			auto headerLen = ReadPackageHeader(buf + offset, dataLen - offset, pkgLen, (SizeType*)nullptr);
+			if (headerLen <= 0) return headerLen ? headerLen : 1;
+			if (dataLen - offset - headerLen < pkgLen) return 1;
+			offset += (uint32_t)headerLen + pkgLen;
+			return 0;
+		}
+
+		// 从 buf 读包头( 定长 ). 成功返回包头长度, 数据不足返回 0, 非法返回负数
+		template<typename SizeType>
+		static int ReadPackageHeader(char const* buf, uint32_t const& len, uint32_t& pkgLen, SizeType*)
+		{
+			if (len < sizeof(SizeType)) return 0;
+			SizeType v;
+			memcpy(&v, buf, sizeof(SizeType));
+			if (v > std::numeric_limits<uint32_t>::max()) return -1;
+			pkgLen = (uint32_t)v;
+			return (int)sizeof(SizeType);
+		}
+
+		// 从 buf 读包头( 变长 ). 返回值同上
+		static int ReadPackageHeader(char const* buf, uint32_t const& len, uint32_t& pkgLen, VarPackageSize*)
+		{
+			uint32_t o = 0;
+			auto rtv = VarRead7(buf, len, o, pkgLen);
+			if (rtv == -1) return 0;
+			if (rtv) return rtv;
+			return (int)o;
+		}
+
 		//// 在已知数据长度的情况下, 直接以包头格式写入长度. 成功返回 true
 		//template<typename SizeType = uint16_t, typename T>
 		//bool WritePackageLength(T const& len)
@@ -449,15 +1171,20 @@ namespace xx
 	// 非 MPObject 任何形态
 
 	template<typename T>
-	void BBufferRWSwitcher<T, std::enable_if_t< !IsMPObject_v<T> >>::Write(BBuffer* bb, T const& v)
+	void BBufferRWSwitcher<T, std::enable_if_t< !IsMPObject_v<T> && !IsBufView_v<T> >>::Write(BBuffer* bb, T const& v)
 	{
 		bb->WritePods(v);
 	}
 	template<typename T>
-	int BBufferRWSwitcher<T, std::enable_if_t< !IsMPObject_v<T> >>::Read(BBuffer* bb, T& v)
+	int BBufferRWSwitcher<T, std::enable_if_t< !IsMPObject_v<T> && !IsBufView_v<T> >>::Read(BBuffer* bb, T& v)
 	{
 		return bb->ReadPods(v);
 	}
+	template<typename T>
+	uint64_t BBufferRWSwitcher<T, std::enable_if_t< !IsMPObject_v<T> && !IsBufView_v<T> >>::Calc(T const& v)
+	{
+		return BBCalc(v);
+	}
 
 	// MPObject* || MPtr || Ptr ( 能当指针来处理的 )
 
@@ -471,6 +1198,29 @@ namespace xx
 	{
 		return bb->ReadPtr(v);
 	}
+	template<typename T>
+	uint64_t BBufferRWSwitcher<T, std::enable_if_t< IsMPObjectPointer_v<T> || IsMPtr<T>::value || IsPtr<T>::value >>::Calc(T const& v)
+	{
+		return BBuffer::CalcPtrSize(v);
+	}
+
+	// StringView / BytesView
+
+	template<typename T>
+	void BBufferRWSwitcher<T, std::enable_if_t< IsBufView_v<T> >>::Write(BBuffer* bb, T const& v)
+	{
+		bb->WriteView(v);
+	}
+	template<typename T>
+	int BBufferRWSwitcher<T, std::enable_if_t< IsBufView_v<T> >>::Read(BBuffer* bb, T& v)
+	{
+		return bb->ReadView(v);
+	}
+	template<typename T>
+	uint64_t BBufferRWSwitcher<T, std::enable_if_t< IsBufView_v<T> >>::Calc(T const& v)
+	{
+		return v.buf ? BBCalc((uint16_t)0, v.dataLen) + v.dataLen : 1;
+	}
 
 	// Dock
 
@@ -484,6 +1234,11 @@ namespace xx
 	{
 		return bb->ReadBox(v);
 	}
+	template<typename T>
+	uint64_t BBufferRWSwitcher<T, std::enable_if_t< IsDock_v<T> >>::Calc(T const& v)
+	{
+		return v->CalcBBufferSize();
+	}
 
 	/*************************************************************************/
 	// 实现值类型使用类型声明
@@ -507,40 +1262,40 @@ namespace xx
 		// 存父 pid
 		assert(!pids()[TypeId<T>::value]);
 		pids()[TypeId<T>::value] = TypeId<PT>::value;
+		typeRangesDirty() = true;
+		noPtrDedups()[TypeId<T>::value] = NoPtrDedup<T>::value;
 
 		// 在执行构造函数之前拿到指针 塞入 bb. 构造函数执行失败时从 bb 移除
 		creators()[TypeId<T>::value] = [](MemPool* mp, BBuffer* bb, uint32_t ptrOffset) ->void*
 		{
-			// 插入字典占位, 分配到实际指针后替换
-			auto addResult = bb->idxStore->Add(ptrOffset, std::make_pair(nullptr, TypeId<T>::value));
-
-			// 下列代码 复制自 Create 函数小改
-			auto siz = sizeof(T) + sizeof(MemHeader_MPObject);
-			auto idx = Calc2n(siz);
-			if (siz > (size_t(1) << idx)) siz = size_t(1) << ++idx;
+			// 插入字典占位, 分配到实际指针后替换( 不去重时跳过 )
+			int idx = bb->readDedup ? bb->idxStore->Add(ptrOffset, std::make_pair(nullptr, (uint16_t)TypeId<T>::value)).index : -1;
 
-			void* rtv;
-			if (!mp->ptrstacks[idx].TryPop(rtv)) rtv = malloc(siz);
-			if (!rtv) return nullptr;
+			// 开启了回收的类型: 取回收链表中已重置的对象直接填充
+			if (auto t = mp->PopRecycled<T>())
+			{
+				if (idx >= 0) bb->idxStore->ValueAt(idx).first = t;
+				if (t->FromBBuffer(*bb))
+				{
+					if (idx >= 0) bb->idxStore->RemoveAt(idx);
+					mp->Release(t);
+					return nullptr;
+				}
+				return t;
+			}
 
-			auto p = (MemHeader_MPObject*)rtv;
-			p->versionNumber = (++mp->versionNumber) | ((uint64_t)idx << 56);
-			p->mempool = mp;
-			p->refCount = 1;
-			p->typeId = TypeId<T>::value;
-			p->tsFlags = 0;
+			auto t = mp->AllocMPObject<T>();
+			if (!t) return nullptr;
 
-			auto t = (T*)(p + 1);
-			bb->idxStore->ValueAt(addResult.index).first = t;	// 替换成真实字典
+			if (idx >= 0) bb->idxStore->ValueAt(idx).first = t;	// 替换成真实字典
 			try
 			{
 				new (t) T(bb);
 			}
 			catch (...)
 			{
-				bb->idxStore->RemoveAt(addResult.index);		// 从字典移除( 理论上讲可以不管, 会层层失败出去最后 clear )
-				mp->ptrstacks[idx].Push(p);
-				p->versionNumber = 0;
+				if (idx >= 0) bb->idxStore->RemoveAt(idx);		// 从字典移除( 理论上讲可以不管, 会层层失败出去最后 clear )
+				mp->FreeMPObject(t);
 				return nullptr;
 			}
 			return t;
@@ -550,7 +1305,7 @@ namespace xx
 
 	void BBuffer::ToBBuffer(BBuffer &bb) const
 	{
-		bb.Reserve(bb.dataLen + 5 + this->dataLen);
+		if (!bb.writeUnchecked) bb.Reserve(bb.dataLen + 5 + this->dataLen);
 		bb.Write(this->dataLen);
 		if (!this->dataLen) return;
 		memcpy(bb.buf + bb.dataLen, this->buf, this->dataLen);
@@ -578,30 +1333,39 @@ namespace xx
 		static void ToBBuffer(List<T, reservedHeaderLen> const* list, BBuffer &bb);
 		static int FromBBuffer(List<T, reservedHeaderLen>* list, BBuffer &bb);
 		static void CreateFromBBuffer(List<T, reservedHeaderLen>* list, BBuffer &bb);
+		static uint64_t CalcSize(List<T, reservedHeaderLen> const* list);
 	};
 
-	// 适配 1 字节长度的 数值 或枚举 或 float( 这些类型直接 memcpy )
+	// List 序列化时是否整块 memcpy
+	template<typename T>
+	constexpr bool ListBBMemcpy_v = sizeof(T) == 1 || std::is_same<float, typename std::decay<T>::type>::value || BytesMemcpy_v<T>;
+
+	// 适配 1 字节长度的 数值 或枚举 或 float 或标记了 BytesMemcpy 的结构体( 这些类型直接 memcpy )
 	template<typename T, uint32_t reservedHeaderLen>
-	struct ListBBSwitcher<T, reservedHeaderLen, std::enable_if_t< sizeof(T) == 1 || std::is_same<float, typename std::decay<T>::type>::value >>
+	struct ListBBSwitcher<T, reservedHeaderLen, std::enable_if_t< ListBBMemcpy_v<T> >>
 	{
 		static void ToBBuffer(List<T, reservedHeaderLen> const* list, BBuffer &bb)
 		{
-			bb.Reserve(bb.dataLen + 5 + list->dataLen);
+			if (!bb.writeUnchecked) bb.Reserve(bb.dataLen + 5 + list->dataLen * sizeof(T));
 			bb.Write(list->dataLen);
 			if (!list->dataLen) return;
-			memcpy(bb.buf + bb.dataLen, list->buf, list->dataLen);
-			bb.dataLen += list->dataLen;
+			memcpy(bb.buf + bb.dataLen, list->buf, list->dataLen * sizeof(T));
+			bb.dataLen += list->dataLen * (uint32_t)sizeof(T);
+		}
+		static uint64_t CalcSize(List<T, reservedHeaderLen> const* list)
+		{
+			return 5 + (uint64_t)list->dataLen * sizeof(T);
 		}
 		static int FromBBuffer(List<T, reservedHeaderLen>* list, BBuffer &bb)
 		{
 			uint32_t len = 0;
 			if (auto rtv = bb.Read(len)) return rtv;
 			if (bb.readLengthLimit != 0 && len > bb.readLengthLimit) return -1;
-			if (bb.offset + len > bb.dataLen) return -2;
+			if (bb.offset + (uint64_t)len * sizeof(T) > bb.dataLen) return -2;
 			list->Resize(len);
 			if (len == 0) return 0;
-			memcpy(list->buf, bb.buf + bb.offset, len);
-			bb.offset += len;
+			memcpy(list->buf, bb.buf + bb.offset, len * sizeof(T));
+			bb.offset += len * (uint32_t)sizeof(T);
 			return 0;
 		}
 		static void CreateFromBBuffer(List<T, reservedHeaderLen>* list, BBuffer &bb)
@@ -609,18 +1373,63 @@ namespace xx
 			uint32_t len = 0;
 			if (auto rtv = bb.ReadPods(len)) throw rtv;
 			if (bb.readLengthLimit != 0 && len > bb.readLengthLimit) throw - 1;
-			if (bb.offset + len * sizeof(T) > bb.dataLen) throw - 2;
+			if (bb.offset + (uint64_t)len * sizeof(T) > bb.dataLen) throw - 2;
 			if (len == 0) return;
 			list->Reserve(len);
 			memcpy(list->buf, bb.buf + bb.offset, len * sizeof(T));
-			bb.offset += len * sizeof(T);
+			bb.offset += len * (uint32_t)sizeof(T);
 			list->dataLen = len;
 		}
 	};
 
+	// 适配 4 / 8 字节整数( 批量变长读写 )
+	template<typename T, uint32_t reservedHeaderLen>
+	struct ListBBSwitcher<T, reservedHeaderLen, std::enable_if_t< std::is_integral<T>::value && (sizeof(T) == 4 || sizeof(T) == 8) >>
+	{
+		static void ToBBuffer(List<T, reservedHeaderLen> const* list, BBuffer &bb)
+		{
+			bb.Write(list->dataLen);
+			if (!list->dataLen) return;
+			bb.WriteVarInts(list->buf, list->dataLen);
+		}
+		static uint64_t CalcSize(List<T, reservedHeaderLen> const* list)
+		{
+			return 5 + (uint64_t)list->dataLen * (sizeof(T) + 1);
+		}
+		static int FromBBuffer(List<T, reservedHeaderLen>* list, BBuffer &bb)
+		{
+			uint32_t len = 0;
+			if (auto rtv = bb.Read(len)) return rtv;
+			if (bb.readLengthLimit != 0 && len > bb.readLengthLimit) return -1;
+			if (bb.offset + len > bb.dataLen) return -2;		// 每个值至少 1 字节
+			list->Resize(len);
+			if (len == 0) return 0;
+			if (auto rtv = bb.ReadVarInts(list->buf, len))
+			{
+				list->Resize(0);
+				return rtv;
+			}
+			return 0;
+		}
+		static void CreateFromBBuffer(List<T, reservedHeaderLen>* list, BBuffer &bb)
+		{
+			uint32_t len = 0;
+			if (auto rtv = bb.Read(len)) throw rtv;
+			if (bb.readLengthLimit != 0 && len > bb.readLengthLimit) throw - 1;
+			if (bb.offset + len > bb.dataLen) throw - 2;
+			list->Resize(len);
+			if (len == 0) return;
+			if (auto rtv = bb.ReadVarInts(list->buf, len))
+			{
+				list->Clear(true);
+				throw rtv;
+			}
+		}
+	};
+
 	// 适配非 MPObject* / MPtr ( 只能 foreach 一个个搞, 含 Dock )
 	template<typename T, uint32_t reservedHeaderLen>
-	struct ListBBSwitcher<T, reservedHeaderLen, std::enable_if_t< !(sizeof(T) == 1 || std::is_same<float, typename std::decay<T>::type>::value) && !(IsMPtr_v<T> || (std::is_pointer<T>::value && IsMPObject_v<T>)) >>
+	struct ListBBSwitcher<T, reservedHeaderLen, std::enable_if_t< !ListBBMemcpy_v<T> && !(std::is_integral<T>::value && (sizeof(T) == 4 || sizeof(T) == 8)) && !(IsMPtr_v<T> || (std::is_pointer<T>::value && IsMPObject_v<T>)) >>
 	{
 		static void ToBBuffer(List<T, reservedHeaderLen> const* list, BBuffer &bb)
 		{
@@ -631,6 +1440,15 @@ namespace xx
 				bb.Write(list->At(i));
 			}
 		}
+		static uint64_t CalcSize(List<T, reservedHeaderLen> const* list)
+		{
+			uint64_t siz = 5;
+			for (uint32_t i = 0; i < list->dataLen; ++i)
+			{
+				siz += BBuffer::CalcWriteSize(list->At(i));
+			}
+			return siz;
+		}
 		static int FromBBuffer(List<T, reservedHeaderLen>* list, BBuffer &bb)
 		{
 			uint32_t len = 0;
@@ -679,6 +1497,15 @@ namespace xx
 				bb.Write(list->At(i));
 			}
 		}
+		static uint64_t CalcSize(List<T, reservedHeaderLen> const* list)
+		{
+			uint64_t siz = 5;
+			for (uint32_t i = 0; i < list->dataLen; ++i)
+			{
+				siz += BBuffer::CalcWriteSize(list->At(i));
+			}
+			return siz;
+		}
 		static int FromBBuffer(List<T, reservedHeaderLen>* list, BBuffer &bb)
 		{
 			uint32_t len = 0;
@@ -743,6 +1570,12 @@ namespace xx
 		return ListBBSwitcher<T, reservedHeaderLen>::FromBBuffer(this, bb);
 	}
 
+	template<typename T, uint32_t reservedHeaderLen>
+	uint64_t List<T, reservedHeaderLen>::CalcBBufferSize() const
+	{
+		return ListBBSwitcher<T, reservedHeaderLen>::CalcSize(this);
+	}
+
 
 	inline String::String(BBuffer* bb)
 		: BaseType(bb)
@@ -5,6 +5,17 @@
 #include <cmath>
 #include <cstring>
 #include <array>
+#if !defined(XX_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#    include <emmintrin.h>
+#    define XX_SIMD_SSE2
+#endif
+#if !defined(XX_NO_SIMD) && defined(__AVX2__)
+#    include <immintrin.h>
+#    define XX_SIMD_AVX2
+#endif
+#ifdef _MSC_VER
+#    include <intrin.h>
+#endif
 
 namespace xx
 {
@@ -191,11 +202,343 @@ namespace xx
 		return 0;// Success;
 	}
 
+	/**************************************************************************************************/
+	// 整数数组的批量变长读写( 与逐个 VarWrite7 / VarRead7 的结果逐字节一致 )
+	/**************************************************************************************************/
+
+	// 只支持 4 / 8 字节整数, 要求 little endian. 多字节值按 8 字节整体拼拆, 连续 16 个单字节值走 SIMD 整块处理.
+	// 写: dstBuf 须比最坏长度 len * (sizeof(T) + 1) 多留 8 字节余量
+	// 读: 剩余数据足 80 字节时按 64 字节位图批量解, 否则逐个 VarRead7, 故不会越界
+	// 定义 XX_NO_SIMD 可关掉 SSE2 / AVX2 部分
+
+	inline uint32_t VarCtz64(uint64_t x)
+	{
+#ifdef _MSC_VER
+		unsigned long r;
+		_BitScanForward64(&r, x);
+		return (uint32_t)r;
+#else
+		return (uint32_t)__builtin_ctzll(x);
+#endif
+	}
+	inline uint32_t VarClz64(uint64_t x)
+	{
+#ifdef _MSC_VER
+		unsigned long r;
+		_BitScanReverse64(&r, x);
+		return 63 - (uint32_t)r;
+#else
+		return (uint32_t)__builtin_clzll(x);
+#endif
+	}
+
+	// 8 字节( 每字节低 7 位 ) 压紧为 56 位
+	inline uint64_t VarGather7(uint64_t x)
+	{
+		x = (x & 0x007f007f007f007fULL) | ((x & 0x7f007f007f007f00ULL) >> 1);
+		x = (x & 0x00003fff00003fffULL) | ((x & 0x3fff00003fff0000ULL) >> 2);
+		return (x & 0x000000000fffffffULL) | ((x & 0x0fffffff00000000ULL) >> 4);
+	}
+	// VarGather7 的逆操作( 只取 x 的低 56 位 )
+	inline uint64_t VarSpread7(uint64_t x)
+	{
+		x = (x & 0x000000000fffffffULL) | ((x << 4) & 0x0fffffff00000000ULL);
+		x = (x & 0x00003fff00003fffULL) | ((x << 2) & 0x3fff00003fff0000ULL);
+		return (x & 0x007f007f007f007fULL) | ((x << 1) & 0x7f007f007f007f00ULL);
+	}
+
+	// 不走逐字节循环的 VarWrite7( uint32_t / uint64_t 通用 ). 需要 dstBuf 后面至少有 9 字节可写
+	inline uint32_t VarWrite7Fast(char *dstBuf, uint64_t in)
+	{
+		if (in < 0x80)
+		{
+			dstBuf[0] = (char)in;
+			return 1;
+		}
+		if (in < 0x4000)
+		{
+			dstBuf[0] = (char)(in | 0x80);
+			dstBuf[1] = (char)(in >> 7);
+			return 2;
+		}
+		uint64_t w;
+		if (in >> 56)
+		{
+			w = VarSpread7(in) | 0x8080808080808080ULL;
+			std::memcpy(dstBuf, &w, 8);
+			dstBuf[8] = (char)(in >> 56);
+			return 9;
+		}
+		static const uint8_t lens[64] =			// 下标为前导 0 的个数
+		{
+			9, 9, 9, 9, 9, 9, 9, 9, 8, 8, 8, 8, 8, 8, 8, 7, 7, 7, 7, 7, 7, 7, 6, 6, 6, 6, 6, 6, 6, 5, 5, 5,
+			5, 5, 5, 5, 4, 4, 4, 4, 4, 4, 4, 3, 3, 3, 3, 3, 3, 3, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1
+		};
+		auto len = lens[VarClz64(in)];
+		w = VarSpread7(in) | (0x8080808080808080ULL >> (8 * (9 - len)));
+		std::memcpy(dstBuf, &w, 8);
+		return len;
+	}
+
+	// 整数 <-> 线上无符号值( 有符号的走 ZigZag )
+	template<typename T>
+	struct VarIntCodec
+	{
+		static_assert(std::is_integral<T>::value && (sizeof(T) == 4 || sizeof(T) == 8), "only support 4 / 8 bytes integer");
+		typedef std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t> UT;
+		typedef std::conditional_t<sizeof(T) == 4, int32_t, int64_t> ST;
+
+		static inline UT Encode(T const &in, std::true_type) { return ZigZagEncode((ST)in); }
+		static inline UT Encode(T const &in, std::false_type) { return (UT)in; }
+		static inline T Decode(UT const &in, std::true_type) { return (T)ZigZagDecode(in); }
+		static inline T Decode(UT const &in, std::false_type) { return (T)in; }
+
+		static inline UT Encode(T const &in) { return Encode(in, std::is_signed<T>()); }
+		static inline T Decode(UT const &in) { return Decode(in, std::is_signed<T>()); }
+	};
+
+#ifdef XX_SIMD_SSE2
+	// 16 个值都 < 0x80 时一次性写 16 字节, 否则返回 false
+	inline bool VarWrite7Block16(char *dstBuf, uint32_t const *in, std::true_type)
+	{
+		auto z = [](__m128i x) { return _mm_xor_si128(_mm_slli_epi32(x, 1), _mm_srai_epi32(x, 31)); };
+		auto a = z(_mm_loadu_si128((__m128i const*)in));
+		auto b = z(_mm_loadu_si128((__m128i const*)in + 1));
+		auto c = z(_mm_loadu_si128((__m128i const*)in + 2));
+		auto d = z(_mm_loadu_si128((__m128i const*)in + 3));
+		auto o = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(o, _mm_set1_epi32(~0x7f)), _mm_setzero_si128())) != 0xFFFF) return false;
+		_mm_storeu_si128((__m128i*)dstBuf, _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+		return true;
+	}
+	inline bool VarWrite7Block16(char *dstBuf, uint32_t const *in, std::false_type)
+	{
+		auto a = _mm_loadu_si128((__m128i const*)in);
+		auto b = _mm_loadu_si128((__m128i const*)in + 1);
+		auto c = _mm_loadu_si128((__m128i const*)in + 2);
+		auto d = _mm_loadu_si128((__m128i const*)in + 3);
+		auto o = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(o, _mm_set1_epi32(~0x7f)), _mm_setzero_si128())) != 0xFFFF) return false;
+		_mm_storeu_si128((__m128i*)dstBuf, _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+		return true;
+	}
+	template<bool isSigned>
+	inline bool VarWrite7Block16(char *dstBuf, uint64_t const *in, std::integral_constant<bool, isSigned>)
+	{
+		__m128i v[8];
+		auto o = _mm_setzero_si128();
+		for (int i = 0; i < 8; ++i)
+		{
+			auto x = _mm_loadu_si128((__m128i const*)in + i);
+			if (isSigned)
+			{
+				x = _mm_xor_si128(_mm_slli_epi64(x, 1), _mm_shuffle_epi32(_mm_srai_epi32(x, 31), _MM_SHUFFLE(3, 3, 1, 1)));
+			}
+			o = _mm_or_si128(o, x);
+			v[i] = _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 0, 2, 0));
+		}
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(o, _mm_set1_epi32(~0x7f)), _mm_setzero_si128())) != 0xFFFF) return false;
+		auto a = _mm_packs_epi32(_mm_unpacklo_epi64(v[0], v[1]), _mm_unpacklo_epi64(v[2], v[3]));
+		auto b = _mm_packs_epi32(_mm_unpacklo_epi64(v[4], v[5]), _mm_unpacklo_epi64(v[6], v[7]));
+		_mm_storeu_si128((__m128i*)dstBuf, _mm_packus_epi16(a, b));
+		return true;
+	}
+
+	// 16 个单字节值( 调用方已确认都 < 0x80 ) 一次性展开
+	template<bool isSigned>
+	inline void VarExpand16(char const *srcBuf, uint32_t *out, std::integral_constant<bool, isSigned>)
+	{
+		auto x = _mm_loadu_si128((__m128i const*)srcBuf);
+		auto zero = _mm_setzero_si128();
+		auto one = _mm_set1_epi32(1);
+		auto lo = _mm_unpacklo_epi8(x, zero);
+		auto hi = _mm_unpackhi_epi8(x, zero);
+		__m128i v[4] = { _mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero), _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero) };
+		for (int i = 0; i < 4; ++i)
+		{
+			if (isSigned)
+			{
+				v[i] = _mm_xor_si128(_mm_srli_epi32(v[i], 1), _mm_sub_epi32(zero, _mm_and_si128(v[i], one)));
+			}
+			_mm_storeu_si128((__m128i*)out + i, v[i]);
+		}
+	}
+	template<bool isSigned>
+	inline void VarExpand16(char const *srcBuf, uint64_t *out, std::integral_constant<bool, isSigned>)
+	{
+		auto x = _mm_loadu_si128((__m128i const*)srcBuf);
+		auto zero = _mm_setzero_si128();
+		auto one = _mm_set_epi32(0, 1, 0, 1);
+		auto lo = _mm_unpacklo_epi8(x, zero);
+		auto hi = _mm_unpackhi_epi8(x, zero);
+		__m128i w[4] = { _mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero), _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero) };
+		for (int i = 0; i < 4; ++i)
+		{
+			__m128i v[2] = { _mm_unpacklo_epi32(w[i], zero), _mm_unpackhi_epi32(w[i], zero) };
+			for (int j = 0; j < 2; ++j)
+			{
+				if (isSigned)
+				{
+					v[j] = _mm_xor_si128(_mm_srli_epi64(v[j], 1), _mm_sub_epi64(zero, _mm_and_si128(v[j], one)));
+				}
+				_mm_storeu_si128((__m128i*)out + i * 2 + j, v[j]);
+			}
+		}
+	}
+#endif
+
+	// 批量写. 返回写入的字节数
+	template<typename T>
+	inline uint32_t VarWrite7Array(char *dstBuf, T const *in, uint32_t len)
+	{
+		typedef VarIntCodec<T> C;
+		uint32_t offset = 0, i = 0;
+#ifdef XX_SIMD_SSE2
+		for (; i + 16 <= len; i += 16)
+		{
+			if (VarWrite7Block16(dstBuf + offset, (typename C::UT const*)(in + i), std::is_signed<T>()))
+			{
+				offset += 16;
+				continue;
+			}
+			for (uint32_t j = i; j < i + 16; ++j)
+			{
+				offset += VarWrite7Fast(dstBuf + offset, C::Encode(in[j]));
+			}
+		}
+#endif
+		for (; i < len; ++i)
+		{
+			offset += VarWrite7Fast(dstBuf + offset, C::Encode(in[i]));
+		}
+		return offset;
+	}
+
+	// 取 p 起 64 字节的结束字节位图( 第 k 位为 1 表示 p[k] < 0x80 )
+	inline uint64_t VarEndMask64(char const *p)
+	{
+#if defined(XX_SIMD_AVX2)
+		auto a = (uint32_t)_mm256_movemask_epi8(_mm256_loadu_si256((__m256i const*)p));
+		auto b = (uint32_t)_mm256_movemask_epi8(_mm256_loadu_si256((__m256i const*)p + 1));
+		return ~((uint64_t)a | ((uint64_t)b << 32));
+#elif defined(XX_SIMD_SSE2)
+		uint64_t r = 0;
+		for (int i = 0; i < 4; ++i)
+		{
+			r |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_loadu_si128((__m128i const*)p + i)) << (i * 16);
+		}
+		return ~r;
+#else
+		uint64_t r = 0, w;
+		for (int i = 0; i < 8; ++i)
+		{
+			std::memcpy(&w, p + i * 8, 8);
+			r |= ((((~w & 0x8080808080808080ULL) >> 7) * 0x0102040810204080ULL) >> 56) << (i * 8);
+		}
+		return r;
+#endif
+	}
+
+	// 批量读. 出错时 offset 停在出错的值之前
+	// 先用位图一次找出 64 字节内所有值的结束位置, 各值的读取便不再串行依赖上一个值的长度
+	template<typename T>
+	inline int VarRead7Array(char const *srcBuf, uint32_t dataLen, uint32_t &offset, T *out, uint32_t len)
+	{
+		typedef VarIntCodec<T> C;
+		typedef typename C::UT UT;
+		UT u;
+		uint32_t o = offset, i = 0;			// 用局部变量, 免得 out 的写入令 offset 被反复重读
+		int rtv = 0;
+		while (i < len)
+		{
+			if (o + 80 <= dataLen)			// 64 字节位图 + 末尾的值多读的余量
+			{
+				auto m = VarEndMask64(srcBuf + o);
+				uint32_t s = 0;
+#ifdef XX_SIMD_SSE2
+				while (s < 64 && len - i >= 16 && ((m >> s) & 0xFFFF) == 0xFFFF)
+				{
+					VarExpand16(srcBuf + o + s, (UT*)(out + i), std::is_signed<T>());
+					i += 16;
+					s += 16;
+				}
+				if (s == 64)
+				{
+					o += 64;
+					continue;
+				}
+				m &= ~0ULL << s;
+#endif
+				while (m && i < len)
+				{
+					auto e = VarCtz64(m);
+					auto n = e - s + 1;
+					auto p = srcBuf + o + s;
+					if (n == 1)
+					{
+						u = (uint8_t)p[0];
+					}
+					else if (n == 2)
+					{
+						u = (UT)((p[0] & 0x7f) | ((uint8_t)p[1] << 7));
+					}
+					else if (n <= 8)
+					{
+						if (sizeof(UT) == 4 && (n > 5 || (n == 5 && (uint8_t)p[4] > 15)))
+						{
+							offset = o + s;
+							return -2;// Overflow;
+						}
+						uint64_t w;
+						std::memcpy(&w, p, 8);
+						u = (UT)VarGather7(w & (~0ULL >> (64 - n * 8)) & 0x7f7f7f7f7f7f7f7fULL);
+					}
+					else
+					{
+						if (sizeof(UT) == 4)
+						{
+							offset = o + s;
+							return -2;// Overflow;
+						}
+						// 9 字节的 uint64_t: 末字节是完整 8 位, 带最高位时位图里不算结束, 但其间的位本就是 0, m 不用修正
+						uint64_t w;
+						std::memcpy(&w, p, 8);
+						u = (UT)(VarGather7(w & 0x7f7f7f7f7f7f7f7fULL) | ((uint64_t)(uint8_t)p[8] << 28 << 28));
+						out[i++] = C::Decode(u);
+						if (n == 9) m &= m - 1;
+						s += 9;
+						continue;
+					}
+					out[i++] = C::Decode(u);
+					m &= m - 1;							// 常规路径只清最低位, 不让 m 串行依赖 s
+					s = e + 1;
+				}
+				o += s;
+				if (s) continue;
+			}
+			if ((rtv = VarRead7(srcBuf, dataLen, o, u))) break;
+			out[i++] = C::Decode(u);
+		}
+		offset = o;
+		return rtv;
+	}
+
 
 	/**************************************************************************************************/
 	// 类型--操作适配模板区
 	/**************************************************************************************************/
 
+	// 用于标记结构体以原始内存方式序列化: 单个值定长 sizeof(T) 直接 memcpy, List<T> 整块 memcpy.
+	// 只可用于不含指针的 trivially copyable 结构体. 收发两端须同构( 含对齐填充 ), 要求 little endian. 标记方法:
+	// template<> struct BytesMemcpy<Foo> { static const bool value = true; };
+	template<typename T, typename ENABLE = void>
+	struct BytesMemcpy
+	{
+		static const bool value = false;
+	};
+	template<typename T>
+	constexpr bool BytesMemcpy_v = std::is_class<T>::value && BytesMemcpy<T>::value;
+
 	// 基础适配模板
 	template<typename T, typename ENABLE = void>
 	struct BytesFunc
@@ -239,6 +582,29 @@ namespace xx
 		}
 	};
 
+	// 适配标记了 BytesMemcpy 的结构体( 直接 memcpy )
+	template<typename T>
+	struct BytesFunc<T, std::enable_if_t<BytesMemcpy_v<T>>>
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "BytesMemcpy type must be trivially copyable");
+		static inline uint32_t Calc(T const &)
+		{
+			return sizeof(T);
+		}
+		static inline uint32_t WriteTo(char *dstBuf, T const &in)
+		{
+			std::memcpy(dstBuf, &in, sizeof(T));
+			return sizeof(T);
+		}
+		static inline int ReadFrom(char const *srcBuf, uint32_t const &dataLen, uint32_t &offset, T &out)
+		{
+			if (offset + sizeof(T) > dataLen) return -1;
+			std::memcpy(&out, srcBuf + offset, sizeof(T));
+			offset += sizeof(T);
+			return 0;
+		}
+	};
+
 	// 适配 2+ 字节无符号整数( 变长读写 )
 	template<typename T>
 	struct BytesFunc<T, std::enable_if_t<std::is_integral<T>::value && sizeof(T) >= 2 && std::is_unsigned<T>::value>>
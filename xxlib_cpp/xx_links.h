@@ -31,7 +31,7 @@ namespace xx
 			count = 0;
 			header = -1;
 			tail = -1;
-			auto nodesByteLen = Round2n(capacity * sizeof(Node) + sizeof(MemHeader_VersionNumber)) - sizeof(MemHeader_VersionNumber);
+			auto nodesByteLen = MemPool::CalcUsableSize(capacity * sizeof(Node));
 			nodesLen = (int)(nodesByteLen / sizeof(Node));
 			nodes = (Node*)mempool().Alloc(nodesLen * sizeof(Node));
 		}
@@ -179,7 +179,7 @@ namespace xx
 			assert(count == 0 || count == nodesLen);          // 确保扩容函数使用情型
 			if (capacity == 0) capacity = count * 2;            // 2倍扩容
 			if (capacity <= nodesLen) return;
-			auto nodesByteLen = Round2n(capacity * sizeof(Node) + sizeof(MemHeader_VersionNumber)) - sizeof(MemHeader_VersionNumber);	// 规避写 versionNumber 的区域
+			auto nodesByteLen = MemPool::CalcUsableSize(capacity * sizeof(Node));	// 规避写 versionNumber 的区域
 			nodesLen = (int)(nodesByteLen / sizeof(Node));
 
 			if (std::is_trivial<T>::value || MemmoveSupport_v<T>)
@@ -25,7 +25,7 @@ namespace xx
 			}
 			else
 			{
-				auto bufByteLen = Round2n((reservedHeaderLen + capacity) * sizeof(T) + sizeof(MemHeader_VersionNumber)) - sizeof(MemHeader_VersionNumber);
+				auto bufByteLen = MemPool::CalcUsableSize((reservedHeaderLen + capacity) * sizeof(T));
 				buf = (T*)mempool().Alloc((uint32_t)bufByteLen) + reservedHeaderLen;
 				bufLen = uint32_t(bufByteLen / sizeof(T)) - reservedHeaderLen;
 			}
@@ -53,25 +53,23 @@ namespace xx
 		{
 			if (capacity <= bufLen) return;
 
-			auto newBufByteLen = Round2n(reservedHeaderLen + capacity * sizeof(T) + sizeof(MemHeader_VersionNumber)) - sizeof(MemHeader_VersionNumber);
-			auto newBuf = (T*)mempool().Alloc((uint32_t)newBufByteLen) + reservedHeaderLen;
-
+			auto newBufByteLen = MemPool::CalcUsableSize((reservedHeaderLen + (capacity < bufLen * 2 ? bufLen * 2 : capacity)) * sizeof(T));	// 至少 2 倍扩容
 			if (std::is_trivial<T>::value || MemmoveSupport_v<T>)
 			{
-				memcpy(newBuf, buf, dataLen * sizeof(T));
+				// 可直接 memcpy 的类型走 Realloc ( 大块内存可就地扩容而不复制 ). 会顺带复制 reservedHeaderLen 区域
+				buf = (T*)mempool().Realloc(buf ? buf - reservedHeaderLen : nullptr, newBufByteLen, (reservedHeaderLen + dataLen) * sizeof(T)) + reservedHeaderLen;
 			}
 			else
 			{
+				auto newBuf = (T*)mempool().Alloc((uint32_t)newBufByteLen) + reservedHeaderLen;
 				for (uint32_t i = 0; i < dataLen; ++i)
 				{
 					new (&newBuf[i]) T((T&&)buf[i]);
 					buf[i].~T();
 				}
+				if (buf) mempool().Free(buf - reservedHeaderLen);
+				buf = newBuf;
 			}
-			// memcpy(newBuf - reservedHeaderLen, buf - reservedHeaderLen, reservedHeaderLen * sizeof(T));
-
-			if (buf) mempool().Free(buf - reservedHeaderLen);
-			buf = newBuf;
 			bufLen = uint32_t(newBufByteLen / sizeof(T)) - reservedHeaderLen;
 		}
 
@@ -433,6 +431,8 @@ namespace xx
 		virtual void ToBBuffer(BBuffer &bb) const override;
 
 		virtual int FromBBuffer(BBuffer &bb) override;
+
+		virtual uint64_t CalcBBufferSize() const override;
 	};
 
 
@@ -0,0 +1,181 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstring>
+
+namespace xx
+{
+	// 无依赖的 LZ4 块格式( block format, 不含 frame 头 )压缩 / 解压. 与官方 lz4 的 LZ4_compress_default / LZ4_decompress_safe 互通
+	// 压缩: 单遍 4096 槽哈希, 找不到匹配时步长随连续失败次数增大( 不可压数据很快跳过 )
+	// 解压: 逐段校验边界, 可安全处理任意( 含恶意 )输入
+
+	// 压缩结果的最大长度( 不可压时会略大于原长 )
+	inline uint32_t LZ4CompressBound(uint32_t const& len)
+	{
+		return len + len / 255 + 16;
+	}
+
+	inline uint32_t LZ4Read32(uint8_t const* p)
+	{
+		uint32_t v;
+		memcpy(&v, p, 4);
+		return v;
+	}
+
+	inline uint32_t LZ4Hash(uint32_t const& seq)
+	{
+		return (seq * 2654435761u) >> (32 - 12);
+	}
+
+	// 写 长度的 15 溢出部分( 255 255 ... n )
+	inline uint8_t* LZ4WriteLen(uint8_t* op, uint32_t len)
+	{
+		for (; len >= 255; len -= 255) *op++ = 255;
+		*op++ = (uint8_t)len;
+		return op;
+	}
+
+	// 压缩 srcBuf 到 dstBuf, 返回压缩后长度. dstBuf 至少要有 LZ4CompressBound(srcLen) 字节
+	inline uint32_t LZ4Compress(char const* srcBuf, uint32_t const& srcLen, char* dstBuf)
+	{
+		static const uint32_t minMatch = 4, lastLiterals = 5, mfLimit = 12;
+		auto src = (uint8_t const*)srcBuf;
+		auto iend = src + srcLen;
+		auto ip = src, anchor = src;
+		auto op = (uint8_t*)dstBuf;
+
+		if (srcLen > mfLimit)
+		{
+			uint32_t table[1 << 12] = {};					// 存 距 src 的偏移. 初始全 0 即指向 src, 由比较内容兜底
+			auto mflimit = iend - mfLimit;					// 匹配起点上限
+			auto matchlimit = iend - lastLiterals;			// 匹配终点上限( 最后 5 字节必须是字面量 )
+			uint32_t searchCount = 1 << 6;					// >> 6 即步长. 连续找不到匹配时逐渐加速
+			++ip;
+
+			while (ip < mflimit)
+			{
+				auto seq = LZ4Read32(ip);
+				auto h = LZ4Hash(seq);
+				auto ref = src + table[h];
+				table[h] = (uint32_t)(ip - src);
+				if (ip - ref > 65535 || LZ4Read32(ref) != seq)
+				{
+					ip += searchCount++ >> 6;
+					continue;
+				}
+				searchCount = 1 << 6;
+
+				// 向前扩展匹配
+				while (ip > anchor && ref > src && ip[-1] == ref[-1])
+				{
+					--ip;
+					--ref;
+				}
+
+				// 向后扩展匹配
+				auto p = ip + minMatch, r = ref + minMatch;
+				while (p < matchlimit && *p == *r)
+				{
+					++p;
+					++r;
+				}
+
+				// token + 字面量 + offset + 匹配长度
+				auto litLen = (uint32_t)(ip - anchor);
+				auto matchLen = (uint32_t)(p - ip) - minMatch;
+				auto token = op++;
+				*token = (uint8_t)((litLen >= 15 ? 15 : litLen) << 4);
+				if (litLen >= 15) op = LZ4WriteLen(op, litLen - 15);
+				memcpy(op, anchor, litLen);
+				op += litLen;
+				auto offset = (uint32_t)(ip - ref);
+				*op++ = (uint8_t)offset;
+				*op++ = (uint8_t)(offset >> 8);
+				*token |= (uint8_t)(matchLen >= 15 ? 15 : matchLen);
+				if (matchLen >= 15) op = LZ4WriteLen(op, matchLen - 15);
+
+				ip = anchor = p;
+				if (ip < mflimit) table[LZ4Hash(LZ4Read32(ip - 2))] = (uint32_t)(ip - 2 - src);
+			}
+		}
+
+		// 剩下的都是字面量
+		auto litLen = (uint32_t)(iend - anchor);
+		*op++ = (uint8_t)((litLen >= 15 ? 15 : litLen) << 4);
+		if (litLen >= 15) op = LZ4WriteLen(op, litLen - 15);
+		memcpy(op, anchor, litLen);
+		op += litLen;
+		return (uint32_t)(op - (uint8_t*)dstBuf);
+	}
+
+	// 读 长度的 15 溢出部分. 超出 limit 或数据不足返回 false
+	inline bool LZ4ReadLen(uint8_t const*& ip, uint8_t const* iend, uint32_t& len, uint32_t const& limit)
+	{
+		uint8_t b;
+		do
+		{
+			if (ip >= iend) return false;
+			b = *ip++;
+			len += b;
+			if (len > limit) return false;
+		} while (b == 255);
+		return true;
+	}
+
+	// 解压 srcBuf 到 dstBuf. 解出的长度必须刚好为 dstLen( 由发送方另行传递 ). 成功返回 0
+	inline int LZ4Decompress(char const* srcBuf, uint32_t const& srcLen, char* dstBuf, uint32_t const& dstLen)
+	{
+		auto ip = (uint8_t const*)srcBuf;
+		auto iend = ip + srcLen;
+		auto dst = (uint8_t*)dstBuf;
+		auto op = dst;
+		auto oend = dst + dstLen;
+		while (true)
+		{
+			if (ip >= iend) return -1;
+			uint32_t token = *ip++;
+
+			// 字面量
+			uint32_t litLen = token >> 4;
+			if (litLen < 15 && iend - ip >= 16 && oend - op >= 16)
+			{
+				memcpy(op, ip, 16);							// 短字面量且两边都有余量: 定长复制, 多写的部分随后会被覆盖
+				op += litLen;
+				ip += litLen;
+				if (ip == iend) break;
+				goto LabMatch;
+			}
+			if (litLen == 15 && !LZ4ReadLen(ip, iend, litLen, dstLen)) return -2;
+			if ((uint32_t)(iend - ip) < litLen || (uint32_t)(oend - op) < litLen) return -3;
+			memcpy(op, ip, litLen);
+			op += litLen;
+			ip += litLen;
+			if (ip == iend) break;							// 最后一段只有字面量
+
+			// 匹配
+		LabMatch:
+			if (iend - ip < 2) return -4;
+			uint32_t offset = ip[0] | ((uint32_t)ip[1] << 8);
+			ip += 2;
+			if (!offset || offset > (uint32_t)(op - dst)) return -5;
+			uint32_t matchLen = token & 15;
+			if (matchLen == 15 && !LZ4ReadLen(ip, iend, matchLen, dstLen)) return -6;
+			matchLen += 4;
+			if ((uint32_t)(oend - op) < matchLen) return -7;
+			auto m = op - offset;
+			if (offset >= 8 && (uint32_t)(oend - op) >= matchLen + 8)
+			{
+				for (uint32_t i = 0; i < matchLen; i += 8) memcpy(op + i, m + i, 8);	// 8 字节一段, 源段总在已写区内
+			}
+			else if (offset >= matchLen)
+			{
+				memcpy(op, m, matchLen);
+			}
+			else
+			{
+				for (uint32_t i = 0; i < matchLen; ++i) op[i] = m[i];	// 重叠复制( 如 offset 1 的重复字节 )
+			}
+			op += matchLen;
+		}
+		return op == oend ? 0 : -8;
+	}
+}
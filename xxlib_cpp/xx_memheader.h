@@ -48,6 +48,15 @@ namespace xx
 		// 减到 0 就真正 Dispose
 		uint32_t refCount = 1;
 
+		// refCount 的共享标记位( 线程安全模式下有效 ). 带该标记的对象 加持 / 减持 为原子操作. 最高位已被 Dock 占用( 防 Release )
+		static const uint32_t sharedFlag = 0x40000000;
+
+		// refCount 的句柄标记位. 带该标记的对象在 MemPool 的句柄表中占有槽位, 析构前需先回收
+		static const uint32_t handleFlag = 0x20000000;
+
+		// refCount 去掉标记位后的计数部分
+		static const uint32_t refCountMask = 0x1FFFFFFF;
+
 		// MemPool 创建时填充类型ID
 		uint16_t typeId = 0;
 
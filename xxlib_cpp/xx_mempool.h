@@ -3,86 +3,1340 @@
 #include "xx_ptr.h"
 #include <array>
 #include <string.h>	// for linux memcpy
+#ifdef _WIN32
+#include <malloc.h>	// _aligned_malloc
+#else
+#include <sys/mman.h>
+#endif
+#ifdef XX_MEMPOOL_THREAD_SAFE
+#include <atomic>
+#include <thread>
+#endif
 
 namespace xx
 {
-	// todo: 用宏的方式 开/关 基于 interlocked_compare_exchange 改链表的内存 请求/释放 操作, 以提供部分情况下所需线程安全的特性
 	// todo2: 提供 1 producer 1 consumer 安全的队列 / 无序bag, 理论上讲似乎和上面这种内存搞法差不多
 
-	/*
-	// 示例:
-	template<> struct TypeId<T> { static const uint16_t value = 1; };
-	template<> struct TypeId<T> { static const uint16_t value = 2; };
-	template<> struct TypeId<T> { static const uint16_t value = 3; };
-	...
-	注意生成器默认规则为 String 和 BBuffer 占掉 typeid 的 1, 2, 而 0 留给 mpobject
+	/*
+	// 线程安全模式( 编译时定义 XX_MEMPOOL_THREAD_SAFE 开启 ):
+	每个线程各自持有自己的 MemPool ( 相当于线程私有缓存 ), 只有创建 MemPool 的线程可以 Alloc / Create.
+	其他线程 Free / Release 属于该 MemPool 的内存时, 内存块会压入该 MemPool 的 lock-free 归还链表( 按 2^n 下标分开 ),
+	所属线程在对应 stack 取不到内存时, 成批取回归还链表中的内存块.
+	版本号依然在 Free / Release 时清 0, 故 MPtr 的有效性判断语义不变.
+	注意: MPObject 的 refCount 依然不是原子的. 跨线程 Release 的前提是当前线程已独占该对象.
+
+	// 共享对象( 线程安全模式下有效 ):
+	Share( p ) 于 refCount 打上 sharedFlag, 之后该对象的 AddRef / Release 均为原子操作, 可同时被多个线程持有( 比如广播包, 转给 SQL 线程的请求包 ).
+	类型特化 SharedType<T> 则该类型的对象 Create 出来即为共享对象( arena 对象除外 ).
+	最后一个 Release 的线程负责析构, 内存经由跨线程归还链表回到所属 MemPool. 未共享的对象只多一次标记位判断.
+	约定: 共享之后对象只读( 包括 ToString 用到的 tsFlags ). 其成员对象随之析构, 故不应再被其他线程持有( 除非也已共享 ).
+	*/
+
+	/*
+	// 句柄表( MPtr 的紧凑替代品 ):
+	MakeHandle( p ) 为对象分配句柄表槽位, 返回 32 位句柄 = 槽位下标( 低 handleIndexBits 位 ) | 代数( 高位, 不为 0 ). 0 表示空.
+	FromHandle( h ) 只比对槽位中记录的句柄, 不访问对象本身. 槽位 16 字节连续存放, 大量扫描时缓存友好.
+	对象析构( Release 到 0 )时自动回收槽位, 代数 +1 令旧句柄失效. 空闲槽位按 FIFO 复用, 以推迟代数回绕.
+	持有句柄的对象于 refCount 打上 handleFlag, 故 Release 只在原有的 Dock 判断处多走一个分支, 未持有句柄的对象没有额外开销.
+	析构时按对象地址在 开放寻址表 中查找槽位. 句柄表只能由所属线程访问, 持有句柄的对象不可共享, 且须在所属线程 Release.
+	typed 包装见 Handle<T>.
+	*/
+
+	/*
+	// 示例:
+	template<> struct TypeId<T> { static const uint16_t value = 1; };
+	template<> struct TypeId<T> { static const uint16_t value = 2; };
+	template<> struct TypeId<T> { static const uint16_t value = 3; };
+	...
+	注意生成器默认规则为 String 和 BBuffer 占掉 typeid 的 1, 2, 而 0 留给 mpobject
+
+	MemPool::Register< T, PT >();
+	MemPool::Register< T, PT >();
+	MemPool::Register< T, PT >();
+	...
+	MemPool::BuildTypeRanges();		// 可省略( 首次 IsBaseOf 时自动重建 ). 注册完后要多线程使用的, 应在开线程前调用
+
+	MemPool mp;
+	auto o = mp.Create<T>(.....);
+
+	*/
+
+
+	struct BBuffer;
+	template<typename T, uint32_t reservedHeaderLen>
+	struct List;
+
+	/*
+	// 尺寸分级( size class ):
+	每个 2^n 区间再等分为 4 级, 即 2^n 的 1.25, 1.5, 1.75, 2 倍. 含头长度 <= 32 时只分 16, 32 两级( 确保 8 字节对齐 ).
+	下标 = floor(log2(siz - 1)) * 4 + 次高两位, 分级尺寸 = (5 + 次高两位) << (floor(log2(siz - 1)) - 2), 均为 O(1) 位运算.
+	下标依然存放于版本号的最高字节, Free / Release 直接取用.
+	最坏情况的内部碎片率由 2^n 规则的 50% 降至 20%.
+
+	// 碎片统计( 编译时定义 XX_MEMPOOL_FRAG_STATS 开启 ):
+	对每个分级累计 分配次数, 请求字节数( 含头 ), 分级字节数, 以及按原 2^n 规则本应占用的字节数,
+	可用 FragStatsToString 输出对比报表.
+	*/
+
+	/*
+	// 运行统计( 编译时定义 XX_MEMPOOL_STATS 开启, release 下亦可用 ):
+	对每个分级统计 分配次数, 释放次数, stack 命中 / 未命中( 切块或 malloc ) 次数, 在用块数 及其 峰值;
+	对每个 typeId 统计 在用对象数 及其 占用字节数( 含头 ).
+	GetStats 将非 0 的条目快照到 List<ClassStat> / List<TypeStat>, 可直接写入 BBuffer 或 String.
+	线程安全模式下, 分级统计只在所属线程更新( 跨线程归还的块在取回时计为释放 ), typeId 统计为原子计数.
+	*/
+
+	/*
+	// span( 大块内存切片 ):
+	分级尺寸 <= spanMaxBlockSize 的内存块, 不再逐个 malloc, 而是从按分级申请的 span( 64KB ~ 2MB, mmap, 按自身长度对齐 )中顺序切出.
+	块地址 & ~(spanSize - 1) 即为 span 头, 头中记录 已切出块数 和 在用块数.
+	span 中的块全部归还后即为空 span. 当空 span 总字节数超过 spanRetainBytes, 且某分级空 span 所含的块占到缓存块的一半以上时,
+	将该分级空 span 的块从 stack 中剔除并归还系统( 正在切块的 span 除外 ), 扫描开销均摊到 Free 上依然为 O(1).
+	保留一定量的空 span 是为了避免 大量分配 / 全部释放 反复交替时频繁 mmap / munmap.
+	析构时按 span 整体释放( 仍有在用块的 span 不释放 ), 开销为 O(span 数).
+	编译时定义 XX_MEMPOOL_HUGE_PAGE 则 span 统一为 2MB 并提示系统使用大页( 仅 linux 有效 ).
+	windows 下 span 由 _aligned_malloc 分配.
+	*/
+
+	/*
+	// 大块内存:
+	Alloc 含头长度超过 largeAllocSize 的内存不进 stack 缓存, 直接 mmap( 按 4KB 取整 ), Free 时 munmap.
+	映射区开头 8 字节存放映射长度, 其后才是 MemHeader_VersionNumber, 其 ptrStackIndex 固定为 largeIndex.
+	Realloc 扩容时 linux 下使用 mremap( 不复制数据 ), 其他平台则 映射新区 + 复制. windows 下使用 malloc / realloc.
+	*/
+
+	/*
+	// arena( 整体回收的临时分配区 ):
+	ArenaScope 生存期间, 所绑定 MemPool 的 Alloc / Create 改为从 arena chunk 中顺序切出( bump pointer ), 不经过 stack.
+	块头前额外存放块长( 对象还多一个链表指针, 按创建顺序串起来 ), 版本号的 ptrStackIndex 固定为 arenaIndex.
+	Free 只清版本号; Release 照常执行析构, 但不回收内存.
+	scope 结束时按创建顺序析构仍存活的对象( 不管引用计数 ), 再将切块位置退回 scope 开始时. chunk 留着下次复用, Trim 时释放. 支持嵌套.
+	注意: scope 中分配的内存 / 对象于 scope 结束后即失效, 不可被外部持有( 包括在 scope 中扩容的外部容器 ).
+	故建议为临时对象单独准备一个 MemPool( 参见 BBuffer::readMemPool, UVPeer::tmpMemPool ).
+	*/
+
+	/*
+	// 缓存回收( Trim ):
+	Trim() 将所有缓存块归还系统( span 分级只能归还空 span ).
+	TrimTick() 为自动策略, 建议定时调用( 见 xx_uv.h 的 UVMemPoolTrimmer, 或于 UV::OnIdle 中调用 ):
+	每个分级在两次调用之间记录 stack 缓存块数的最低点( 只在分配时更新, Free 路径不变 ), 缓存块数 - 最低点 即本周期实际用到的缓存量.
+	保留量 = MAX( 本周期用量, 上次保留量 * trimDecayPercent / 100 ), 即高水位按周期衰减.
+	缓存总字节数超过 trimBudgetBytes 时, 从大到小逐个分级回收超出保留量的缓存块, 直到不超预算.
+	*/
+
+	/*
+	// 预热 与 对象回收:
+	Reserve<T>(n) 令 T 所在分级的 stack 至少缓存 n 块. span 分级一次从 span 中连续切出( 并写穿所有页 ), 取出时按地址顺序.
+	预热的块与普通缓存块无异, 依然受 spanRetainBytes / TrimTick 约束, 故大量预热时应相应调大这两个值.
+
+	EnableRecycle<T>(capacity) 为 T 开启回收链表( 按 typeId, 最多存 capacity 个 ): Release 到 0 时不析构, 而是重置后挂入链表,
+	无参 Create<T>() 与反序列化时优先从链表取出( 版本号重新生成, 故旧 MPtr 依然失效 ).
+	重置: T 自己声明了 void Reset() 则调用之, 否则 原地析构 + 默认构造. Reset 须令对象回到默认构造的状态( 指针成员要释放并清空 ).
+	回收链表中的对象不计入 typeId 统计. arena 对象 与 非所属线程 Release 的对象不回收. Trim 与析构时全部析构回收.
+	*/
+
+	// 整套库的核心内存分配组件. 按尺寸分级划分内存分配行为, 将 free 的指针放入 stack 缓存复用
+	// 对于分配出来的内存, 自增 版本号 将填充在 指针 -8 区( Alloc ). 用于判断指针是否已失效
+	// MPObject 对象使用 Create / Release 来创建和析构
+	struct MemPool
+	{
+		// 单链表. 指向下一指针的内存区域避开版本号区域不写
+		struct PtrStack
+		{
+			void* header = nullptr;
+#ifndef NDEBUG
+			uint32_t count = 0;
+#endif
+
+			inline bool TryPop(void*& output)
+			{
+				if (!header) return false;
+				output = header;
+				header = *(void**)((char*)header + sizeof(MemHeader_VersionNumber));
+#ifndef NDEBUG
+				--count;
+#endif
+				return true;
+			}
+
+			inline void Push(void* const& v)
+			{
+				*(void**)((char*)v + sizeof(MemHeader_VersionNumber)) = header;
+				header = v;
+#ifndef NDEBUG
+				++count;
+#endif
+			}
+		};
+
+		// 尺寸分级总数( 每个 2^n 区间 4 级 )
+		static const size_t numClasses = sizeof(size_t) * 8 * 4;
+
+		// 数组长度涵盖所有分级
+		std::array<PtrStack, numClasses> ptrstacks;
+
+		// 自增版本号( 每次创建时先 ++ 再填充 )
+		uint64_t versionNumber = 0;
+
+#ifdef XX_MEMPOOL_THREAD_SAFE
+		// 跨线程归还链表( 与 ptrstacks 下标一一对应 ). 多线程 push, 所属线程一次性全部取走
+		std::array<std::atomic<void*>, numClasses> returns;
+
+		// 所属线程 id
+		std::thread::id ownerThreadId;
+#endif
+
+		// span 头. 位于 span 起始地址. 其后 spanHeaderSize 处开始切块
+		struct Span
+		{
+			Span* prev;
+			Span* next;
+			uint32_t live;							// 在用块数
+			uint32_t carved;						// 已切出块数( 切出的块要么在用, 要么在 stack 中 )
+			bool releasing;							// SweepSpans 时的回收标记
+		};
+
+		static const size_t spanHeaderSize = 64;
+		static const size_t spanMinSize = 64 * 1024;
+		static const size_t spanMaxSize = 2 * 1024 * 1024;
+		static const size_t spanMaxBlockSize = spanMaxSize / 8;	// 分级尺寸超过该值的块直接 malloc
+
+		// 每个分级的 span 管理数据
+		struct SpanClass
+		{
+			Span* spans = nullptr;					// span 双向链表
+			Span* carving = nullptr;				// 正在切块的 span
+			size_t spanSize = 0;					// span 长度. 0 表示该分级不使用 span
+			uint32_t blocksPerSpan = 0;				// 每个 span 可切出的块数
+			uint32_t emptySpans = 0;				// 在用块数为 0 的 span 个数
+			size_t cached = 0;						// stack 中缓存的块数
+			size_t numSpans = 0;					// span 个数
+			size_t lowCached = 0;					// 本 TrimTick 周期内 cached 的最低点
+			size_t keepCached = 0;					// 上次 TrimTick 计算出的保留块数( 高水位 )
+		};
+		std::array<SpanClass, numClasses> spanClasses;
+
+		// 所有分级的 span 个数 与 总字节数, 空 span 总字节数
+		size_t numSpans = 0;
+		size_t numSpanBytes = 0;
+		size_t numEmptySpanBytes = 0;
+
+		// 大块内存的 含头长度阈值 与 专用下标( 超出 numClasses 范围内实际可达的下标 )
+		static const size_t largeAllocSize = 1024 * 1024;
+		static const size_t largeIndex = 0xFF;
+		static const size_t largeHeaderSize = sizeof(size_t) + sizeof(MemHeader_VersionNumber);
+
+		// arena 块的专用下标
+		static const size_t arenaIndex = 0xFE;
+
+		// arena chunk 的默认长度
+		static const size_t arenaChunkSize = 64 * 1024;
+
+		// arena chunk 头. 其后为切块区
+		struct ArenaChunk
+		{
+			ArenaChunk* next;
+			size_t size;							// 含头总长
+		};
+
+		// arena 对象的链表指针. 位于 块长 之前
+		struct ArenaObject
+		{
+			ArenaObject* next;
+		};
+
+		// scope 开始时的 arena 状态, 结束时据此退回
+		struct ArenaMark
+		{
+			ArenaChunk* chunk;
+			char* cur;
+			ArenaObject* tail;
+		};
+
+		ArenaChunk* arenaChunks = nullptr;			// 所有 chunk
+		ArenaChunk* arenaChunk = nullptr;			// 当前切块的 chunk
+		char* arenaCur = nullptr;					// 切块位置
+		char* arenaEnd = nullptr;					// 当前 chunk 结束位置
+		ArenaObject* arenaObjects = nullptr;		// arena 对象链表头
+		ArenaObject* arenaObjectsTail = nullptr;	// arena 对象链表尾
+		uint32_t arenaDepth = 0;					// ArenaScope 嵌套层数. 非 0 表示 arena 生效中
+		bool arenaDestroying = false;				// 是否正在析构 scope 结束时仍存活的对象
+
+		// 在用大块内存的 个数 与 映射总字节数
+#ifdef XX_MEMPOOL_THREAD_SAFE
+		// 其他线程 Free 大块内存时直接归还系统( 不经归还链表 ), 故计数须原子
+		typedef std::atomic<size_t> LargeCounter;
+		inline static void LargeAdd(LargeCounter& c, size_t v) { c.fetch_add(v, std::memory_order_relaxed); }
+		inline static void LargeSub(LargeCounter& c, size_t v) { c.fetch_sub(v, std::memory_order_relaxed); }
+#else
+		typedef size_t LargeCounter;
+		inline static void LargeAdd(LargeCounter& c, size_t v) { c += v; }
+		inline static void LargeSub(LargeCounter& c, size_t v) { c -= v; }
+#endif
+		LargeCounter numLarges{ 0 };
+		LargeCounter numLargeBytes{ 0 };
+
+		// 空 span 总字节数不超过该值时不归还系统
+		size_t spanRetainBytes = 32 * 1024 * 1024;
+
+		// TrimTick: 缓存总字节数不超过该值时不回收
+		size_t trimBudgetBytes = 64 * 1024 * 1024;
+
+		// TrimTick: 每个周期保留量( 高水位 )衰减到上次的百分比
+		size_t trimDecayPercent = 50;
+
+		// 单个 typeId 的对象回收链表. 链表指针借用对象头的 mempool 字段存放
+		struct Recycler
+		{
+			MemHeader_MPObject* header = nullptr;
+			uint32_t count = 0;
+			uint32_t capacity = 0;					// 0 表示未开启
+			bool(*reset)(MPObject*) = nullptr;		// 重置对象. 返回 false 表示对象已析构( 重新构造失败 )
+		};
+
+		// 按 typeId 下标的回收链表数组. 首次 EnableRecycle 时 calloc 分配
+		Recycler* recyclers = nullptr;
+
+		// 句柄表的槽位. 空闲时 nextFree 存下一个空闲槽位下标
+		struct HandleSlot
+		{
+			union
+			{
+				MPObject* pointer;
+				size_t nextFree;
+			};
+			uint32_t handle;						// 槽位当前的有效句柄. 回收时 代数 +1
+			uint16_t typeId;						// 供 FromHandle<T> 做类型检查, 免得访问对象
+		};
+
+		static const uint32_t handleIndexBits = 20;
+		static const uint32_t handleIndexMask = (1u << handleIndexBits) - 1;
+
+		HandleSlot* handleSlots = nullptr;
+		uint32_t handleSlotsLen = 0;				// 用到过的槽位数( 含空闲 )
+		uint32_t handleSlotsCap = 0;
+		uint32_t handleFreeHead = (uint32_t)-1;		// FIFO 空闲链表
+		uint32_t handleFreeTail = (uint32_t)-1;
+		uint32_t* handleMap = nullptr;				// 对象地址 -> 槽位下标 + 1 的开放寻址表( 线性探测, 长度 2^n, 负载 <= 50% )
+		uint32_t handleMapBits = 0;
+		uint32_t numHandles = 0;					// 在用句柄数
+
+#ifdef XX_MEMPOOL_STATS
+		// 单个分级的统计数据
+		struct ClassStat
+		{
+			uint64_t classSize = 0;					// 分级尺寸( 含头 )
+			uint64_t allocs = 0;					// 分配次数
+			uint64_t frees = 0;						// 释放次数
+			uint64_t hits = 0;						// 从 stack 取到的次数
+			uint64_t misses = 0;					// 切块或 malloc 的次数
+			uint64_t live = 0;						// 在用块数
+			uint64_t peak = 0;						// 在用块数峰值
+		};
+		std::array<ClassStat, numClasses> classStats;
+
+		// 单个 typeId 的统计数据( 快照用 )
+		struct TypeStat
+		{
+			uint16_t typeId = 0;
+			int64_t live = 0;						// 在用对象数
+			int64_t bytes = 0;						// 在用字节数( 含头 )
+		};
+
+# ifdef XX_MEMPOOL_THREAD_SAFE
+		typedef std::atomic<int64_t> StatCounter;
+		inline static void StatAdd(StatCounter& c, int64_t v) { c.fetch_add(v, std::memory_order_relaxed); }
+# else
+		typedef int64_t StatCounter;
+		inline static void StatAdd(StatCounter& c, int64_t v) { c += v; }
+# endif
+		struct TypeCounter
+		{
+			StatCounter live;
+			StatCounter bytes;
+		};
+
+		// 按 typeId 下标的计数数组. calloc 分配, 只有用到的页才占物理内存
+		TypeCounter* typeCounters = nullptr;
+#endif
+
+#ifdef XX_MEMPOOL_FRAG_STATS
+		// 单个分级的碎片统计数据( 字节数均含头 )
+		struct FragStat
+		{
+			uint64_t count = 0;						// 分配次数
+			uint64_t requestBytes = 0;				// 请求字节数累计
+			uint64_t classBytes = 0;				// 按分级实际占用字节数累计
+			uint64_t pow2Bytes = 0;					// 按 2^n 规则本应占用的字节数累计
+		};
+		std::array<FragStat, numClasses> fragStats;
+#endif
+
+
+		MemPool(MemPool const&) = delete;
+		MemPool& operator=(MemPool const &) = delete;
+		MemPool()
+		{
+			for (size_t i = 0; i < numClasses; ++i)
+			{
+				auto& sc = spanClasses[i];
+				sc.spanSize = CalcSpanSize(i);
+				if (sc.spanSize) sc.blocksPerSpan = uint32_t((sc.spanSize - spanHeaderSize) / CalcClassSize(i));
+			}
+#ifdef XX_MEMPOOL_STATS
+			for (size_t i = 15; i < numClasses; ++i) classStats[i].classSize = CalcClassSize(i);
+			typeCounters = (TypeCounter*)std::calloc(1 << sizeof(uint16_t) * 8, sizeof(TypeCounter));
+#endif
+#ifdef XX_MEMPOOL_THREAD_SAFE
+			for (auto& r : returns) r.store(nullptr, std::memory_order_relaxed);
+			ownerThreadId = std::this_thread::get_id();
+#endif
+		}
+		~MemPool()
+		{
+#ifdef XX_MEMPOOL_THREAD_SAFE
+			DrainReturns();
+#endif
+			ClearRecycle();
+			std::free(recyclers);
+			std::free(handleSlots);
+			std::free(handleMap);
+
+			// 池内存回收. span 整体释放, 仍有在用块的 span 放弃不管( 同以前的 malloc 块一样泄露 )
+			void* p;
+			for (size_t i = 0; i < numClasses; ++i)
+			{
+				auto& sc = spanClasses[i];
+				if (sc.spanSize)
+				{
+					for (auto s = sc.spans; s;)
+					{
+						auto next = s->next;
+						if (!s->live) UnmapSpan(s, sc.spanSize);
+						s = next;
+					}
+				}
+				else
+				{
+					while (ptrstacks[i].TryPop(p)) std::free(p);
+				}
+			}
+#ifdef XX_MEMPOOL_STATS
+			std::free(typeCounters);
+#endif
+			assert(!arenaDepth);
+			FreeArenaChunks();
+		}
+
+
+		/***********************************************************************************/
+		// 内部函数: 内存块的 取 / 还( Alloc / Create / Free / Release 共用 )
+		/***********************************************************************************/
+
+		// 根据 ptrstacks 下标计算分级尺寸( 含头 )
+		inline static size_t CalcClassSize(size_t idx)
+		{
+			return size_t(5 + (idx & 3)) << ((idx >> 2) - 2);
+		}
+
+		// 根据含头长度计算 ptrstacks 下标, 并将 siz 修正为实际分配长度
+		inline static size_t CalcIndex(size_t& siz)
+		{
+			if (siz <= 16) siz = 16;
+			auto e = (size_t)Calc2n(siz - 1);
+			auto idx = e < 5 ? (e * 4 + 3) : (e * 4 + (((siz - 1) >> (e - 2)) & 3));
+			siz = CalcClassSize(idx);
+			return idx;
+		}
+
+		// 根据 ptrstacks 下标计算 span 长度. 返回 0 表示该分级直接 malloc
+		inline static size_t CalcSpanSize(size_t idx)
+		{
+			if (idx < 15 || (idx >> 2) >= (size_t)Calc2n(spanMaxBlockSize)) return 0;	// 未使用的下标 或 块过大
+#ifdef XX_MEMPOOL_HUGE_PAGE
+			return spanMaxSize;
+#else
+			auto siz = Round2n(CalcClassSize(idx) * 8);
+			return siz < spanMinSize ? spanMinSize : (siz > spanMaxSize ? spanMaxSize : siz);
+#endif
+		}
+
+		// 根据含头长度计算大块内存的映射长度( 含映射长度字段, 按 4KB 取整 )
+		inline static size_t CalcLargeMapSize(size_t siz)
+		{
+			return (siz + sizeof(size_t) + 4095) & ~(size_t)4095;
+		}
+
+		// 返回 Alloc( siz ) 实际可用的长度. 容器类可据此最大化利用分配到的内存
+		inline static size_t CalcUsableSize(size_t siz)
+		{
+			siz += sizeof(MemHeader_VersionNumber);
+			if (siz > largeAllocSize) return CalcLargeMapSize(siz) - largeHeaderSize;
+			CalcIndex(siz);
+			return siz - sizeof(MemHeader_VersionNumber);
+		}
+
+#ifdef XX_MEMPOOL_STATS
+		// 记录一次块分配. hit 表示从 stack 取到
+		inline void StatAlloc(size_t idx, bool hit)
+		{
+			auto& cs = classStats[idx];
+			++cs.allocs;
+			++(hit ? cs.hits : cs.misses);
+			if (++cs.live > cs.peak) cs.peak = cs.live;
+		}
+
+		// 记录一次块释放( 放回 stack 时 )
+		inline void StatFree(size_t idx)
+		{
+			auto& cs = classStats[idx];
+			++cs.frees;
+			--cs.live;
+		}
+
+		// 记录一个 MPObject 的 创建( n = 1 ) / 释放( n = -1 )
+		inline void StatObject(uint16_t typeId, size_t idx, int64_t n)
+		{
+			auto& tc = typeCounters[typeId];
+			StatAdd(tc.live, n);
+			StatAdd(tc.bytes, n * (int64_t)CalcClassSize(idx));
+		}
+
+		// 清空统计数据( 在用数据保留, 峰值重置为当前在用数 )
+		inline void ClearStats()
+		{
+			for (auto& cs : classStats)
+			{
+				cs.allocs = cs.frees = cs.hits = cs.misses = 0;
+				cs.peak = cs.live;
+			}
+		}
+
+		// 将有数据的分级 / typeId 统计快照到 outClassStats / outTypeStats ( 会先清空 ). 实现在 xx_string.h
+		void GetStats(List<ClassStat, 0>& outClassStats, List<TypeStat, 0>& outTypeStats) const;
+#endif
+
+#ifdef XX_MEMPOOL_FRAG_STATS
+		// 记录一次分配的碎片情况. reqSiz 为请求长度, siz 为分级长度( 均含头 )
+		inline void RecordFragStat(size_t idx, size_t reqSiz, size_t siz)
+		{
+			auto& fs = fragStats[idx];
+			++fs.count;
+			fs.requestBytes += reqSiz;
+			fs.classBytes += siz;
+			fs.pow2Bytes += Round2n(reqSiz);
+		}
+
+		// 清空碎片统计数据
+		inline void ClearFragStats()
+		{
+			fragStats.fill(FragStat());
+		}
+
+		// 输出每个分级的碎片统计报表( 含与 2^n 规则的对比 ). 实现在 xx_string.h
+		void FragStatsToString(String& s) const;
+#endif
+
+		// 从 idx 对应的 stack 取出一块内存, 取不到就从 span 切( 或 malloc )
+		inline void* PopBlock(size_t idx, size_t siz)
+		{
+			void* p;
+			if (XX_LIKELY(ptrstacks[idx].TryPop(p))) return TakeBlock(p, idx);
+#ifdef XX_MEMPOOL_THREAD_SAFE
+			if (DrainReturns(idx) && ptrstacks[idx].TryPop(p)) return TakeBlock(p, idx);
+#endif
+			p = spanClasses[idx].spanSize ? CarveBlock(idx) : std::malloc(siz);
+#ifdef XX_MEMPOOL_STATS
+			if (p) StatAlloc(idx, false);
+#endif
+			return p;
+		}
+
+		// 从 stack 取出块之后的计数
+		inline void* TakeBlock(void* p, size_t idx)
+		{
+#ifdef XX_MEMPOOL_STATS
+			StatAlloc(idx, true);
+#endif
+			auto& sc = spanClasses[idx];
+			if (--sc.cached < sc.lowCached) sc.lowCached = sc.cached;
+			if (sc.spanSize && !SpanOf(p, sc.spanSize)->live++)
+			{
+				--sc.emptySpans;
+				numEmptySpanBytes -= sc.spanSize;
+			}
+			return p;
+		}
+
+		// 块放回 stack 并计数. 空 span 超出保留量且其块占到缓存块的一半以上时回收空 span. 只能由所属线程调用
+		inline void StackPush(void* h, size_t idx)
+		{
+#ifdef XX_MEMPOOL_STATS
+			StatFree(idx);
+#endif
+			auto& sc = spanClasses[idx];
+			ptrstacks[idx].Push(h);
+			++sc.cached;
+			if (sc.spanSize && !--SpanOf(h, sc.spanSize)->live)
+			{
+				++sc.emptySpans;
+				if ((numEmptySpanBytes += sc.spanSize) > spanRetainBytes
+					&& (size_t)sc.emptySpans * sc.blocksPerSpan * 2 >= sc.cached)
+				{
+					SweepSpans(idx);
+				}
+			}
+		}
+
+		// 将内存块放回 idx 对应的 stack( 调用前应已清 0 版本号 ). 非所属线程调用时将压入跨线程归还链表
+		inline void PushBlock(void* h, size_t idx)
+		{
+#ifdef XX_MEMPOOL_THREAD_SAFE
+			if (std::this_thread::get_id() != ownerThreadId)
+			{
+				auto& r = returns[idx];
+				auto& next = *(void**)((char*)h + sizeof(MemHeader_VersionNumber));
+				next = r.load(std::memory_order_relaxed);
+				while (!r.compare_exchange_weak(next, h, std::memory_order_release, std::memory_order_relaxed));
+				return;
+			}
+#endif
+			StackPush(h, idx);
+		}
+
+		/***********************************************************************************/
+		// 内部函数: span 的 申请 / 切块 / 回收
+		/***********************************************************************************/
+
+		// 根据块地址得到所在 span
+		inline static Span* SpanOf(void* p, size_t spanSize)
+		{
+			return (Span*)((size_t)p & ~(spanSize - 1));
+		}
+
+		// 向系统申请按 siz 对齐的 siz 长度内存
+		inline static void* MapSpan(size_t siz)
+		{
+#ifdef _WIN32
+			return _aligned_malloc(siz, siz);
+#else
+			auto p = (char*)mmap(nullptr, siz * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (p == (char*)MAP_FAILED) return nullptr;
+			auto a = (char*)(((size_t)p + siz - 1) & ~(siz - 1));				// 多申请一倍, 掐头去尾得到对齐的区域
+			if (a > p) munmap(p, a - p);
+			munmap(a + siz, p + siz - a);
+# if defined(XX_MEMPOOL_HUGE_PAGE) && defined(MADV_HUGEPAGE)
+			madvise(a, siz, MADV_HUGEPAGE);
+# endif
+			return a;
+#endif
+		}
+
+		inline static void UnmapSpan(void* p, size_t siz)
+		{
+#ifdef _WIN32
+			_aligned_free(p);
+#else
+			munmap(p, siz);
+#endif
+		}
+
+		// 申请一个新的 span 作为 idx 分级的切块 span
+		inline Span* NewSpan(size_t idx)
+		{
+			auto& sc = spanClasses[idx];
+			auto s = (Span*)MapSpan(sc.spanSize);
+			if (!s) return nullptr;
+			s->prev = nullptr;
+			s->next = sc.spans;
+			if (sc.spans) sc.spans->prev = s;
+			sc.spans = s;
+			s->live = 0;
+			s->carved = 0;
+			s->releasing = false;
+			sc.carving = s;
+			++sc.emptySpans;
+			numEmptySpanBytes += sc.spanSize;
+			++sc.numSpans;
+			++numSpans;
+			numSpanBytes += sc.spanSize;
+			return s;
+		}
+
+		// 从切块 span 中切出一块. 切完了就申请新 span
+		inline void* CarveBlock(size_t idx)
+		{
+			auto& sc = spanClasses[idx];
+			auto s = sc.carving;
+			if (!s || s->carved == sc.blocksPerSpan)
+			{
+				s = NewSpan(idx);
+				if (!s) return nullptr;
+			}
+			auto p = (char*)s + spanHeaderSize + CalcClassSize(idx) * s->carved++;
+			if (!s->live++)
+			{
+				--sc.emptySpans;
+				numEmptySpanBytes -= sc.spanSize;
+			}
+			return p;
+		}
+
+		// 回收 idx 分级的空 span( 所含块数累计到 maxBlocks 为止. includeCarving: 正在切块的 span 为空时也回收 ):
+		// 先从 stack 中剔除其所含的块, 再归还系统. 返回回收字节数
+		inline size_t SweepSpans(size_t idx, size_t maxBlocks = (size_t)-1, bool includeCarving = false)
+		{
+			auto& sc = spanClasses[idx];
+			if (!sc.spanSize || !sc.emptySpans) return 0;
+			size_t n = 0, blocks = 0;
+			for (auto s = sc.spans; s; s = s->next)
+			{
+				s->releasing = !s->live && (includeCarving || s != sc.carving) && blocks < maxBlocks;
+				if (s->releasing)
+				{
+					++n;
+					blocks += s->carved;
+				}
+			}
+			if (!n) return 0;
+
+			auto& stack = ptrstacks[idx];
+			auto link = &stack.header;
+			while (auto p = *link)
+			{
+				auto next = (void**)((char*)p + sizeof(MemHeader_VersionNumber));
+				if (SpanOf(p, sc.spanSize)->releasing)
+				{
+					*link = *next;
+					--sc.cached;
+#ifndef NDEBUG
+					--stack.count;
+#endif
+				}
+				else link = next;
+			}
+			if (sc.lowCached > sc.cached) sc.lowCached = sc.cached;
+
+			for (auto s = sc.spans; s;)
+			{
+				auto next = s->next;
+				if (s->releasing)
+				{
+					if (s->prev) s->prev->next = next;
+					else sc.spans = next;
+					if (next) next->prev = s->prev;
+					if (s == sc.carving) sc.carving = nullptr;
+					UnmapSpan(s, sc.spanSize);
+					--sc.emptySpans;
+					--sc.numSpans;
+					--numSpans;
+					numSpanBytes -= sc.spanSize;
+					numEmptySpanBytes -= sc.spanSize;
+				}
+				s = next;
+			}
+			return n * sc.spanSize;
+		}
+
+		/***********************************************************************************/
+		// 内部函数: 大块内存的 映射 / 重映射 / 释放
+		/***********************************************************************************/
+
+		inline static void* MapLarge(size_t len)
+		{
+#ifdef _WIN32
+			return std::malloc(len);
+#else
+			auto p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			return p == MAP_FAILED ? nullptr : p;
+#endif
+		}
+
+		// 将 p 的映射长度由 oldLen 扩为 newLen. 需要搬家时最多复制 copyLen 字节. 失败返回空( p 不变 )
+		inline static void* RemapLarge(void* p, size_t oldLen, size_t newLen, size_t copyLen)
+		{
+#ifdef _WIN32
+			(void)oldLen;
+			(void)copyLen;
+			return std::realloc(p, newLen);
+#elif defined(__linux__) && defined(MREMAP_MAYMOVE)
+			(void)copyLen;													// mremap 自己搬, 整段保留
+			auto np = mremap(p, oldLen, newLen, MREMAP_MAYMOVE);
+			return np == MAP_FAILED ? nullptr : np;
+#else
+			auto np = MapLarge(newLen);
+			if (!np) return nullptr;
+			memcpy(np, p, MIN(oldLen, copyLen));
+			munmap(p, oldLen);
+			return np;
+#endif
+		}
+
+		inline static void UnmapLarge(void* p, size_t len)
+		{
+#ifdef _WIN32
+			std::free(p);
+#else
+			munmap(p, len);
+#endif
+		}
+
+		// 分配大块内存. siz 为含头长度. 返回 MemHeader_VersionNumber 之后的地址
+		inline void* AllocLarge(size_t siz)
+		{
+			auto len = CalcLargeMapSize(siz);
+			auto p = (size_t*)MapLarge(len);
+			if (!p) return nullptr;
+			*p = len;
+			LargeAdd(numLarges, 1);
+			LargeAdd(numLargeBytes, len);
+			auto h = (MemHeader_VersionNumber*)(p + 1);
+			h->versionNumber = ++versionNumber;
+			h->ptrStackIndex() = (uint8_t)largeIndex;
+			return h + 1;
+		}
+
+		// 释放大块内存. h 为其 MemHeader_VersionNumber 地址. 线程安全模式下可由任意线程调用
+		inline void FreeLarge(MemHeader_VersionNumber* h)
+		{
+			auto p = (size_t*)h - 1;
+			LargeSub(numLarges, 1);
+			LargeSub(numLargeBytes, *p);
+			UnmapLarge(p, *p);
+		}
+
+		/***********************************************************************************/
+		// arena
+		/***********************************************************************************/
+
+		// 开始一层 arena scope, 返回用于退回的状态. 一般通过 ArenaScope 使用
+		inline ArenaMark BeginArena()
+		{
+			if (!arenaChunks)
+			{
+				auto c = (ArenaChunk*)std::malloc(arenaChunkSize);
+				if (!c) throw - 1;
+				c->next = nullptr;
+				c->size = arenaChunkSize;
+				arenaChunks = c;
+			}
+			if (!arenaDepth++)
+			{
+				arenaChunk = arenaChunks;
+				arenaCur = (char*)(arenaChunk + 1);
+				arenaEnd = (char*)arenaChunk + arenaChunk->size;
+			}
+			return ArenaMark{ arenaChunk, arenaCur, arenaObjectsTail };
+		}
+
+		// 结束一层 arena scope: 按创建顺序析构 m 之后创建且仍存活的对象, 再退回切块位置
+		inline void EndArena(ArenaMark const& m)
+		{
+			assert(arenaDepth);
+			auto bak = arenaDestroying;
+			arenaDestroying = true;
+			for (auto o = m.tail ? m.tail->next : arenaObjects; o; o = o->next)	// 析构过程中新建的对象会追加到尾部, 一并处理
+			{
+				auto h = (MemHeader_MPObject*)((size_t*)(o + 1) + 1);
+				if (!h->versionNumber) continue;
+				h->versionNumber = 0;
+				((MPObject*)(h + 1))->~MPObject();
+			}
+			arenaDestroying = bak;
+
+			if (m.tail) m.tail->next = nullptr;
+			else arenaObjects = nullptr;
+			arenaObjectsTail = m.tail;
+			arenaChunk = m.chunk;
+			arenaCur = m.cur;
+			arenaEnd = (char*)m.chunk + m.chunk->size;
+			--arenaDepth;
+		}
+
+		// 从 arena 切出 siz 字节( 8 字节对齐 ). 当前 chunk 不够就换下一个( 不够大则新建 )
+		inline char* ArenaAlloc(size_t siz)
+		{
+			siz = (siz + 7) & ~(size_t)7;
+			if (XX_UNLIKELY(arenaCur + siz > arenaEnd))
+			{
+				auto c = arenaChunk->next;
+				if (!c || c->size - sizeof(ArenaChunk) < siz)
+				{
+					auto len = MAX(arenaChunkSize, siz + sizeof(ArenaChunk));
+					c = (ArenaChunk*)std::malloc(len);
+					if (!c) return nullptr;
+					c->size = len;
+					c->next = arenaChunk->next;
+					arenaChunk->next = c;
+				}
+				arenaChunk = c;
+				arenaCur = (char*)(c + 1);
+				arenaEnd = (char*)c + c->size;
+			}
+			auto p = arenaCur;
+			arenaCur += siz;
+			return p;
+		}
+
+		// Alloc 的 arena 版. siz 为含头长度. 返回 MemHeader_VersionNumber 之后的地址
+		inline void* ArenaAllocBlock(size_t siz)
+		{
+			auto p = (size_t*)ArenaAlloc(siz + sizeof(size_t));
+			if (!p) return nullptr;
+			*p = (size_t)(arenaCur - (char*)p);
+			auto h = (MemHeader_VersionNumber*)(p + 1);
+			h->versionNumber = ++versionNumber;
+			h->ptrStackIndex() = (uint8_t)arenaIndex;
+			return h + 1;
+		}
+
+		// AllocMPObject 的 arena 版. 对象追加到 arena 对象链表以便 scope 结束时析构
+		template<typename T>
+		inline T* ArenaAllocMPObject() noexcept
+		{
+			auto o = (ArenaObject*)ArenaAlloc(sizeof(ArenaObject) + sizeof(size_t) + sizeof(MemHeader_MPObject) + sizeof(T));
+			if (!o) return nullptr;
+			o->next = nullptr;
+			if (arenaObjectsTail) arenaObjectsTail->next = o;
+			else arenaObjects = o;
+			arenaObjectsTail = o;
+			auto sp = (size_t*)(o + 1);
+			*sp = (size_t)(arenaCur - (char*)sp);
+			auto p = (MemHeader_MPObject*)(sp + 1);
+			p->versionNumber = (++versionNumber) | ((uint64_t)arenaIndex << 56);
+			p->mempool = this;
+			p->refCount = 1;
+			p->typeId = TypeId<T>::value;
+			p->tsFlags = 0;
+			return (T*)(p + 1);
+		}
+
+		inline void FreeArenaChunks()
+		{
+			for (auto c = arenaChunks; c;)
+			{
+				auto next = c->next;
+				std::free(c);
+				c = next;
+			}
+			arenaChunks = nullptr;
+		}
+
+		/***********************************************************************************/
+		// 缓存回收
+		/***********************************************************************************/
+
+		// 回收 idx 分级的缓存块( 直接 malloc 的分级最多 free maxBlocks 块, span 分级回收空 span ). 返回回收字节数
+		inline size_t TrimClass(size_t idx, size_t maxBlocks = (size_t)-1, bool includeCarving = false)
+		{
+			auto& sc = spanClasses[idx];
+			size_t rtv = 0;
+			if (sc.spanSize)
+			{
+				rtv = SweepSpans(idx, maxBlocks, includeCarving);
+			}
+			else if (sc.cached)													// 未使用的下标没有分级尺寸
+			{
+				void* p;
+				auto siz = CalcClassSize(idx);
+				while (maxBlocks-- && ptrstacks[idx].TryPop(p))
+				{
+					std::free(p);
+					--sc.cached;
+					rtv += siz;
+				}
+			}
+			if (sc.lowCached > sc.cached) sc.lowCached = sc.cached;
+			return rtv;
+		}
+
+		// 将所有缓存块归还系统( 仍有在用块的 span 除外 ). 返回回收字节数
+		inline size_t Trim()
+		{
+#ifdef XX_MEMPOOL_THREAD_SAFE
+			DrainReturns();
+#endif
+			ClearRecycle();
+			size_t rtv = 0;
+			for (size_t i = 0; i < numClasses; ++i)
+			{
+				rtv += TrimClass(i, (size_t)-1, true);
+				spanClasses[i].keepCached = 0;
+			}
+			if (!arenaDepth) FreeArenaChunks();
+			return rtv;
+		}
+
+		// 缓存块总字节数
+		inline size_t CachedBytes() const
+		{
+			size_t rtv = 0;
+			for (size_t i = 0; i < numClasses; ++i)
+			{
+				if (spanClasses[i].cached) rtv += spanClasses[i].cached * CalcClassSize(i);
+			}
+			return rtv;
+		}
+
+		// 按高水位衰减策略回收超出预算的缓存块. 建议定时调用. 返回回收字节数
+		inline size_t TrimTick()
+		{
+#ifdef XX_MEMPOOL_THREAD_SAFE
+			DrainReturns();
+#endif
+			auto cachedBytes = CachedBytes();
+			size_t rtv = 0;
+			for (size_t i = numClasses; i-- > 0;)									// 大块优先
+			{
+				auto& sc = spanClasses[i];
+				auto used = sc.cached - sc.lowCached;
+				auto decayed = sc.keepCached * trimDecayPercent / 100;
+				sc.keepCached = used > decayed ? used : decayed;
+				if (cachedBytes > trimBudgetBytes && sc.cached > sc.keepCached)
+				{
+					auto n = TrimClass(i, sc.cached - sc.keepCached);
+					cachedBytes = n < cachedBytes ? cachedBytes - n : 0;
+					rtv += n;
+				}
+				sc.lowCached = sc.cached;
+			}
+			return rtv;
+		}
 
-	MemPool::Register< T, PT >();
-	MemPool::Register< T, PT >();
-	MemPool::Register< T, PT >();
-	...
+		/***********************************************************************************/
+		// 预热 与 对象回收
+		/***********************************************************************************/
 
-	MemPool mp;
-	auto o = mp.Create<T>(.....);
+		// 令 idx 分级的 stack 至少缓存 n 块. span 分级从 span 中连续切出. 返回实际缓存块数
+		inline size_t ReserveBlocks(size_t idx, size_t n)
+		{
+			auto& sc = spanClasses[idx];
+			auto& stack = ptrstacks[idx];
+			auto siz = CalcClassSize(idx);
+			while (sc.cached < n)
+			{
+				if (sc.spanSize)
+				{
+					auto s = sc.carving;
+					if (!s || s->carved == sc.blocksPerSpan)
+					{
+						s = NewSpan(idx);
+						if (!s) break;
+					}
+					auto c = MIN((size_t)(sc.blocksPerSpan - s->carved), n - sc.cached);
+					s->carved += (uint32_t)c;
+					auto p = (char*)s + spanHeaderSize + siz * s->carved;
+					for (size_t i = 0; i < c; ++i) stack.Push(p -= siz);		// 倒序压入, 取出时按地址顺序
+					sc.cached += c;
+				}
+				else
+				{
+					auto p = std::malloc(siz);
+					if (!p) break;
+					stack.Push(p);
+					++sc.cached;
+				}
+			}
+			return sc.cached;
+		}
 
-	*/
+		// 为 Create<T> 预热 n 块内存. 只能由所属线程调用
+		template<typename T>
+		inline size_t Reserve(size_t n)
+		{
+			static_assert(std::is_base_of<MPObject, T>::value, "the T must be inerit of MPObject.");
+			size_t siz = sizeof(T) + sizeof(MemHeader_MPObject);
+			return ReserveBlocks(CalcIndex(siz), n);
+		}
+
+		// 为 Alloc( siz ) 预热 n 块内存( 大块内存不缓存, 返回 0 ). 只能由所属线程调用
+		inline size_t Reserve(size_t siz, size_t n)
+		{
+			siz += sizeof(MemHeader_VersionNumber);
+			if (siz > largeAllocSize) return 0;
+			return ReserveBlocks(CalcIndex(siz), n);
+		}
 
+		XX_HAS_FUNC(HasReset_checker, Reset, void(T::*)());
 
-	struct BBuffer;
+		// 为 T 开启回收链表, 最多存 capacity 个( 0 表示关闭并析构已存的对象 ). T 须有 typeId
+		template<typename T>
+		inline void EnableRecycle(uint32_t capacity)
+		{
+			static_assert(std::is_base_of<MPObject, T>::value, "the T must be inerit of MPObject.");
+			static_assert(TypeId<T>::value, "the T must have a TypeId.");
+			if (!recyclers)
+			{
+				recyclers = (Recycler*)std::calloc(1 << sizeof(uint16_t) * 8, sizeof(Recycler));
+				if (!recyclers) throw - 1;
+			}
+			auto& r = recyclers[TypeId<T>::value];
+			r.capacity = capacity;
+			r.reset = [](MPObject* p)
+			{
+				return ResetObject<T>((T*)p, std::integral_constant<bool, HasReset_checker<T>::value>());
+			};
+			if (!capacity) ClearRecycle(TypeId<T>::value);
+		}
 
-	// 整套库的核心内存分配组件. 按 2^N 尺寸划分内存分配行为, 将 free 的指针放入 stack 缓存复用
-	// 对于分配出来的内存, 自增 版本号 将填充在 指针 -8 区( Alloc ). 用于判断指针是否已失效
-	// MPObject 对象使用 Create / Release 来创建和析构
-	struct MemPool
-	{
-		// 单链表. 指向下一指针的内存区域避开版本号区域不写
-		struct PtrStack
+		template<typename T>
+		inline static bool ResetObject(T* p, std::true_type)
 		{
-			void* header = nullptr;
-#ifndef NDEBUG
-			uint32_t count = 0;
-#endif
+			p->Reset();
+			return true;
+		}
 
-			inline bool TryPop(void*& output)
+		template<typename T>
+		inline static bool ResetObject(T* p, std::false_type)
+		{
+			p->~T();
+			try
 			{
-				if (!header) return false;
-				output = header;
-				header = *(void**)((char*)header + sizeof(MemHeader_VersionNumber));
-#ifndef NDEBUG
-				--count;
+				new (p) T();
+			}
+			catch (...)
+			{
+				return false;
+			}
+			return true;
+		}
+
+		// Release 到 0 时尝试将对象重置并挂入回收链表. 返回 false 表示不回收
+		inline bool TryRecycle(MPObject* p)
+		{
+			auto& r = recyclers[p->typeId()];
+			if (r.count >= r.capacity) return false;
+			auto h = &p->memHeader();
+			auto idx = h->ptrStackIndex();
+			if (idx >= arenaIndex) return false;
+#ifdef XX_MEMPOOL_THREAD_SAFE
+			if (std::this_thread::get_id() != ownerThreadId) return false;
+#endif
+#ifdef XX_MEMPOOL_STATS
+			StatObject(p->typeId(), idx, -1);
 #endif
+			h->versionNumber = (uint64_t)idx << 56;							// 令 MPtr 失效, 保留下标
+			if (!r.reset(p))
+			{
+				h->versionNumber = 0;
+				StackPush(h, idx);
 				return true;
 			}
+			h->mempool = (MemPool*)r.header;
+			r.header = h;
+			++r.count;
+			return true;
+		}
 
-			inline void Push(void* const& v)
+		// 从 T 的回收链表取出一个对象( 已重置, 版本号 引用计数 重新填充 ). 没有则返回空
+		template<typename T>
+		inline T* PopRecycled() noexcept
+		{
+			if (XX_LIKELY(!recyclers) || arenaDepth) return nullptr;			// arena 生效时不取, 以免 scope 之外的对象混入
+			auto& r = recyclers[TypeId<T>::value];
+			auto h = r.header;
+			if (!h) return nullptr;
+			r.header = (MemHeader_MPObject*)h->mempool;
+			--r.count;
+			h->mempool = this;
+			h->versionNumber |= ++versionNumber;
+			h->refCount = InitRefCount<T>();
+			h->tsFlags = 0;
+#ifdef XX_MEMPOOL_STATS
+			StatObject(h->typeId, h->ptrStackIndex(), 1);
+#endif
+			return (T*)(h + 1);
+		}
+
+		// 析构回收 typeId 回收链表中的对象. typeId 为 0 表示全部
+		inline void ClearRecycle(uint16_t typeId = 0)
+		{
+			if (!recyclers) return;
+			size_t n;
+			do																	// 析构过程中可能有成员对象挂入前面的链表, 全部清理时需重复扫描
 			{
-				*(void**)((char*)v + sizeof(MemHeader_VersionNumber)) = header;
-				header = v;
-#ifndef NDEBUG
-				++count;
+				n = 0;
+				for (size_t i = typeId; i < (typeId ? typeId + 1u : 1u << sizeof(uint16_t) * 8); ++i)
+				{
+					auto& r = recyclers[i];
+					while (auto h = r.header)
+					{
+						r.header = (MemHeader_MPObject*)h->mempool;
+						--r.count;
+						h->mempool = this;
+						auto idx = h->ptrStackIndex();
+						h->versionNumber = 0;
+						((MPObject*)(h + 1))->~MPObject();
+						StackPush(h, idx);
+						++n;
+					}
+				}
+			} while (n && !typeId);
+		}
+
+		/***********************************************************************************/
+		// 句柄表
+		/***********************************************************************************/
+
+		// 对象地址在 handleMap 中的起始探测位置
+		inline size_t HandleMapHome(MPObject* p) const
+		{
+			return (size_t)(((uint64_t)(size_t)p * 0x9E3779B97F4A7C15ull) >> (64 - handleMapBits));
+		}
+
+		// 返回 p 在 handleMap 中的位置( 须已持有句柄 )
+		inline size_t FindHandleMapPos(MPObject* p) const
+		{
+			auto mask = ((size_t)1 << handleMapBits) - 1;
+			auto i = HandleMapHome(p);
+			while (handleSlots[handleMap[i] - 1].pointer != p) i = (i + 1) & mask;
+			return i;
+		}
+
+		inline void InsertHandleMap(MPObject* p, uint32_t slotIndex)
+		{
+			auto mask = ((size_t)1 << handleMapBits) - 1;
+			auto i = HandleMapHome(p);
+			while (handleMap[i]) i = (i + 1) & mask;
+			handleMap[i] = slotIndex + 1;
+		}
+
+		// handleMap 扩容一倍并重新插入
+		inline bool GrowHandleMap()
+		{
+			auto bits = handleMapBits ? handleMapBits + 1 : 6;
+			auto m = (uint32_t*)std::calloc((size_t)1 << bits, sizeof(uint32_t));
+			if (!m) return false;
+			auto old = handleMap;
+			auto oldLen = handleMapBits ? (size_t)1 << handleMapBits : 0;
+			handleMap = m;
+			handleMapBits = bits;
+			for (size_t i = 0; i < oldLen; ++i)
+			{
+				if (old[i]) InsertHandleMap(handleSlots[old[i] - 1].pointer, old[i] - 1);
+			}
+			std::free(old);
+			return true;
+		}
+
+		// 为 p 分配句柄( 已有则直接返回 ). 失败返回 0. 只能由所属线程调用
+		inline uint32_t MakeHandle(MPObject* p)
+		{
+			assert(p && p->refCount() < MemHeader_MPObject::sharedFlag && p->memHeader().ptrStackIndex() < arenaIndex);	// Dock, 共享对象, arena 对象不可持有句柄
+#ifdef XX_MEMPOOL_THREAD_SAFE
+			assert(std::this_thread::get_id() == ownerThreadId);
 #endif
+			if (p->refCount() & MemHeader_MPObject::handleFlag) return handleSlots[handleMap[FindHandleMapPos(p)] - 1].handle;
+			if (((size_t)numHandles + 1) * 2 > ((size_t)1 << handleMapBits) && !GrowHandleMap()) return 0;
+
+			uint32_t i;
+			if (handleFreeHead != (uint32_t)-1)
+			{
+				i = handleFreeHead;
+				handleFreeHead = (uint32_t)handleSlots[i].nextFree;
+				if (handleFreeHead == (uint32_t)-1) handleFreeTail = (uint32_t)-1;
 			}
-		};
+			else
+			{
+				if (handleSlotsLen == handleSlotsCap)
+				{
+					if (handleSlotsCap > handleIndexMask) return 0;						// 槽位下标用完
+					auto cap = handleSlotsCap ? handleSlotsCap * 2 : 64;
+					auto ss = (HandleSlot*)std::realloc(handleSlots, sizeof(HandleSlot) * cap);
+					if (!ss) return 0;
+					handleSlots = ss;
+					handleSlotsCap = cap;
+				}
+				i = handleSlotsLen++;
+				handleSlots[i].handle = (1u << handleIndexBits) | i;
+			}
+			auto& s = handleSlots[i];
+			s.pointer = p;
+			s.typeId = p->typeId();
+			InsertHandleMap(p, i);
+			++numHandles;
+			p->refCount() |= MemHeader_MPObject::handleFlag;
+			return s.handle;
+		}
 
-		// 数组长度涵盖所有 2^n 对齐分配长度规则
-		std::array<PtrStack, sizeof(size_t) * 8> ptrstacks;
+		// 根据句柄取对象. 无效则返回空. 只访问句柄表
+		inline MPObject* FromHandle(uint32_t h) const
+		{
+			auto i = h & handleIndexMask;
+			if (i >= handleSlotsLen) return nullptr;
+			auto& s = handleSlots[i];
+			return s.handle == h ? s.pointer : nullptr;
+		}
 
-		// 自增版本号( 每次创建时先 ++ 再填充 )
-		uint64_t versionNumber = 0;
+		// 根据句柄取对象并检查类型. 无效或类型不符则返回空. 只访问句柄表
+		template<typename T>
+		inline T* FromHandle(uint32_t h) const
+		{
+			auto i = h & handleIndexMask;
+			if (i >= handleSlotsLen) return nullptr;
+			auto& s = handleSlots[i];
+			return s.handle == h && IsBaseOf(TypeId<T>::value, s.typeId) ? (T*)s.pointer : nullptr;
+		}
 
+		// 回收 p 的句柄( 没有则忽略 ), 之前发出的句柄全部失效. 对象析构时自动调用
+		inline void RemoveHandle(MPObject* p)
+		{
+			if (!(p->refCount() & MemHeader_MPObject::handleFlag)) return;
+#ifdef XX_MEMPOOL_THREAD_SAFE
+			assert(std::this_thread::get_id() == ownerThreadId);
+#endif
+			p->refCount() &= ~MemHeader_MPObject::handleFlag;
 
-		MemPool(MemPool const&) = delete;
-		MemPool& operator=(MemPool const &) = delete;
-		MemPool() {}
-		~MemPool()
+			// 从 handleMap 中删除( 线性探测的 后移补位 )
+			auto mask = ((size_t)1 << handleMapBits) - 1;
+			auto i = FindHandleMapPos(p);
+			auto slotIndex = handleMap[i] - 1;
+			for (auto j = (i + 1) & mask; handleMap[j]; j = (j + 1) & mask)
+			{
+				auto k = HandleMapHome(handleSlots[handleMap[j] - 1].pointer);
+				if (i <= j ? (k <= i || k > j) : (k <= i && k > j))
+				{
+					handleMap[i] = handleMap[j];
+					i = j;
+				}
+			}
+			handleMap[i] = 0;
+
+			// 槽位 代数 +1( 回绕时跳过 0 )后挂到空闲链表尾
+			auto& s = handleSlots[slotIndex];
+			auto g = (s.handle >> handleIndexBits) + 1;
+			if (g >> (32 - handleIndexBits)) g = 1;
+			s.handle = (g << handleIndexBits) | slotIndex;
+			s.nextFree = (uint32_t)-1;
+			if (handleFreeTail == (uint32_t)-1) handleFreeHead = slotIndex;
+			else handleSlots[handleFreeTail].nextFree = slotIndex;
+			handleFreeTail = slotIndex;
+			--numHandles;
+		}
+
+#ifdef XX_MEMPOOL_THREAD_SAFE
+		// 将 idx 对应的跨线程归还链表的内存块一次性取回 stack. 返回是否取到. 只能由所属线程调用
+		inline bool DrainReturns(size_t idx)
 		{
-			// 池内存回收
-			void* p;
-			for (auto& stack : ptrstacks)
+			assert(std::this_thread::get_id() == ownerThreadId);
+			auto& r = returns[idx];
+			if (!r.load(std::memory_order_relaxed)) return false;
+			auto p = r.exchange(nullptr, std::memory_order_acquire);
+			while (p)
 			{
-				while (stack.TryPop(p)) std::free(p);
+				auto next = *(void**)((char*)p + sizeof(MemHeader_VersionNumber));
+				StackPush(p, idx);
+				p = next;
 			}
+			return true;
+		}
+
+		// 取回所有跨线程归还的内存块( 可于空闲时调用, 以免归还链表积压 )
+		inline void DrainReturns()
+		{
+			for (size_t i = 0; i < returns.size(); ++i) DrainReturns(i);
 		}
+#endif
 
 		/***********************************************************************************/
 		// 内存分配( malloc / free 系列. 主要供一些容器类的代码使用 )
@@ -90,16 +1344,21 @@ namespace xx
 
 
 		// 该操作将会在头部区域填充 MemHeader_VersionNumber 并跳过, 返回偏移后的指针
-		// 最大化内存利用率的 size 计算: Round2n(capacity * sizeof(T) + sizeof(MemHeader_VersionNumber)) - sizeof(MemHeader_VersionNumber)
+		// 最大化内存利用率的 size 计算: CalcUsableSize(capacity * sizeof(T))
 		inline void* Alloc(size_t siz)
 		{
 			assert(siz);
 			siz += sizeof(MemHeader_VersionNumber);								// 空出放置 MemHeader_VersionNumber 的地儿
-			auto idx = Calc2n(siz);
-			if (siz > (size_t(1) << idx)) siz = size_t(1) << ++idx;
-
-			void* p;
-			if (!ptrstacks[idx].TryPop(p)) p = std::malloc(siz);
+			if (XX_UNLIKELY(arenaDepth)) return ArenaAllocBlock(siz);
+			if (siz > largeAllocSize) return AllocLarge(siz);
+#ifdef XX_MEMPOOL_FRAG_STATS
+			auto reqSiz = siz;
+#endif
+			auto idx = CalcIndex(siz);
+#ifdef XX_MEMPOOL_FRAG_STATS
+			RecordFragStat(idx, reqSiz, siz);
+#endif
+			auto p = PopBlock(idx, siz);
 
 			auto h = (MemHeader_VersionNumber*)p;								// 指到内存头
 			h->versionNumber = ++versionNumber;
@@ -111,9 +1370,16 @@ namespace xx
 		{
 			if (!p) return;
 			auto h = (MemHeader_VersionNumber*)p - 1;							// 指到内存头
-			assert(h->versionNumber && h->ptrStackIndex() < ptrstacks.size());	// 理论上讲 free 的时候其版本号不应该是 0. 否则就涉嫌重复 Free
-			ptrstacks[h->ptrStackIndex()].Push(h);								// 入池
+			assert(h->versionNumber && (h->ptrStackIndex() < ptrstacks.size() || h->ptrStackIndex() >= arenaIndex));	// 理论上讲 free 的时候其版本号不应该是 0. 否则就涉嫌重复 Free
+			auto idx = h->ptrStackIndex();
+			if (XX_UNLIKELY(idx >= arenaIndex))
+			{
+				if (idx == largeIndex) FreeLarge(h);							// 大块内存直接归还系统
+				else h->versionNumber = 0;										// arena 内存于 scope 结束时统一回收
+				return;
+			}
 			h->versionNumber = 0;												// 清空版本号
+			PushBlock(h, idx);													// 入池
 		}
 
 		// dataLen 表示要复制多少字节数到新的内存. 并不代表 p 的原始长度
@@ -127,8 +1393,37 @@ namespace xx
 			if (!p) return Alloc(newSize);
 
 			auto h = (MemHeader_VersionNumber*)p - 1;
-			assert(h->versionNumber && h->ptrStackIndex() < ptrstacks.size());
-			auto oldSize = (size_t(1) << h->ptrStackIndex()) - sizeof(MemHeader_VersionNumber);
+			assert(h->versionNumber && (h->ptrStackIndex() < ptrstacks.size() || h->ptrStackIndex() >= arenaIndex));
+			if (h->ptrStackIndex() == arenaIndex)								// arena 内存: 最后切出的块可就地扩容
+			{
+				auto sp = (size_t*)h - 1;
+				auto oldSize = *sp - sizeof(size_t) - sizeof(MemHeader_VersionNumber);
+				if (oldSize >= newSize) return p;
+				auto growLen = ((newSize - oldSize + 7) & ~(size_t)7);
+				if ((char*)sp + *sp == arenaCur && arenaCur + growLen <= arenaEnd)
+				{
+					arenaCur += growLen;
+					*sp += growLen;
+					return p;
+				}
+				auto np = Alloc(newSize);
+				memcpy(np, p, MIN(oldSize, dataLen));
+				Free(p);
+				return np;
+			}
+			if (h->ptrStackIndex() == largeIndex)								// 大块内存就地扩容
+			{
+				auto lp = (size_t*)h - 1;
+				auto oldLen = *lp;
+				if (oldLen - largeHeaderSize >= newSize) return p;
+				auto newLen = CalcLargeMapSize(newSize + sizeof(MemHeader_VersionNumber));
+				auto np = (size_t*)RemapLarge(lp, oldLen, newLen, largeHeaderSize + MIN(oldLen - largeHeaderSize, dataLen));
+				if (!np) return nullptr;
+				*np = newLen;
+				LargeAdd(numLargeBytes, newLen - oldLen);
+				return (char*)np + largeHeaderSize;
+			}
+			auto oldSize = CalcClassSize(h->ptrStackIndex()) - sizeof(MemHeader_VersionNumber);
 			if (oldSize >= newSize) return p;
 
 			auto np = Alloc(newSize);
@@ -141,37 +1436,63 @@ namespace xx
 		// 内存分配( Create / Release 系列 ). 仅针对派生自 MPObject 的对象
 		/***********************************************************************************/
 
-		// 该操作将会在头部填充 MemHeader_MPObject
-		template<typename T, typename ...Args>
-		T* Create(Args &&... args) noexcept
+		// 分配 T 所需内存并填充 MemHeader_MPObject, 返回 T 的地址( 尚未构造 ). Create 与反序列化 creator 共用
+		template<typename T>
+		inline T* AllocMPObject() noexcept
 		{
-			static_assert(std::is_base_of<MPObject, T>::value, "the T must be inerit of MPObject.");
-
-			// 下列代码 复制自 Alloc 函数小改
-			auto siz = sizeof(T) + sizeof(MemHeader_MPObject);
-			auto idx = Calc2n(siz);
-			if (siz > (size_t(1) << idx)) siz = size_t(1) << ++idx;
-
-			void* rtv;
-			if (!ptrstacks[idx].TryPop(rtv)) rtv = malloc(siz);
+			if (XX_UNLIKELY(arenaDepth)) return ArenaAllocMPObject<T>();
+			size_t siz = sizeof(T) + sizeof(MemHeader_MPObject);
+			auto idx = CalcIndex(siz);
+#ifdef XX_MEMPOOL_FRAG_STATS
+			RecordFragStat(idx, sizeof(T) + sizeof(MemHeader_MPObject), siz);
+#endif
+			auto rtv = PopBlock(idx, siz);
 			if (!rtv) return nullptr;
 
 			auto p = (MemHeader_MPObject*)rtv;
 			p->versionNumber = (++versionNumber) | ((uint64_t)idx << 56);
 			p->mempool = this;
-			p->refCount = 1;
+			p->refCount = InitRefCount<T>();
 			p->typeId = TypeId<T>::value;
 			p->tsFlags = 0;
+#ifdef XX_MEMPOOL_STATS
+			StatObject(p->typeId, idx, 1);
+#endif
+			return (T*)(p + 1);
+		}
+
+		// 回收 AllocMPObject 分配的内存( 用于构造失败时 )
+		inline void FreeMPObject(void* t) noexcept
+		{
+			auto p = (MemHeader_MPObject*)t - 1;
+			auto idx = p->ptrStackIndex();
+			p->versionNumber = 0;												// 清空版本号
+			if (idx == arenaIndex) return;										// arena 内存于 scope 结束时统一回收
+#ifdef XX_MEMPOOL_STATS
+			StatObject(p->typeId, idx, -1);
+#endif
+			PushBlock(p, idx);													// 入池
+		}
+
+		// 该操作将会在头部填充 MemHeader_MPObject
+		template<typename T, typename ...Args>
+		T* Create(Args &&... args) noexcept
+		{
+			static_assert(std::is_base_of<MPObject, T>::value, "the T must be inerit of MPObject.");
 
-			auto t = (T*)(p + 1);
+			if (!sizeof...(Args))												// 无参创建时优先取回收链表中的对象
+			{
+				if (auto t = PopRecycled<T>()) return t;
+			}
+			auto t = AllocMPObject<T>();
+			if (!t) return nullptr;
 			try
 			{
 				new (t) T(std::forward<Args>(args)...);
 			}
 			catch (...)
 			{
-				ptrstacks[idx].Push(p);											// 入池
-				p->versionNumber = 0;											// 清空版本号
+				FreeMPObject(t);
 				return nullptr;
 			}
 			return t;
@@ -197,11 +1518,63 @@ namespace xx
 		}
 
 
+#ifdef XX_MEMPOOL_THREAD_SAFE
+		// 将 p 设为共享对象. 须由当前持有者在发布给其他线程之前调用. arena 对象不可共享
+		inline static void Share(MPObject* p) noexcept
+		{
+			assert(p && p->refCount() && p->refCount() < MemHeader_MPObject::handleFlag && p->memHeader().ptrStackIndex() < arenaIndex);
+			p->refCount() |= MemHeader_MPObject::sharedFlag;
+		}
+#endif
+
+		// 新建对象的 refCount( SharedType 直接带上共享标记 )
+		template<typename T>
+		inline static constexpr uint32_t InitRefCount()
+		{
+#ifdef XX_MEMPOOL_THREAD_SAFE
+			return SharedType_v<T> ? (1 | MemHeader_MPObject::sharedFlag) : 1;
+#else
+			return 1;
+#endif
+		}
+
+		// 带标记位( Dock / 共享 / 持有句柄 )的对象的减持. 返回 true 表示这是最后一次减持: 标记已去掉, 计数置 1 交由 Release 后续流程析构
+		inline bool ReleaseFlagged(MPObject* p, uint32_t rc) noexcept
+		{
+			if (rc > 0x7FFFFFFF) return false;									// 用 Dock 包裹则不执行 Release 操作
+#ifdef XX_MEMPOOL_THREAD_SAFE
+			if (rc & MemHeader_MPObject::sharedFlag)							// 共享对象: 原子减持, 减到 0 的线程照常析构回收
+			{
+				auto n = p->atomicRefCount().fetch_sub(1, std::memory_order_acq_rel) & MemHeader_MPObject::refCountMask;
+				assert(n);
+				if (n != 1) return false;
+			}
+			else
+#endif
+			{
+				assert(rc & MemHeader_MPObject::refCountMask);
+				if ((rc & MemHeader_MPObject::refCountMask) != 1)
+				{
+					--p->refCount();
+					return false;
+				}
+				if (rc & MemHeader_MPObject::handleFlag) RemoveHandle(p);		// 回收句柄表槽位
+			}
+			p->refCount() = 1;
+			return true;
+		}
+
 		// 释放由 Create 创建的类
 		inline void Release(MPObject* p) noexcept
 		{
-			if (!p || p->refCount() > 0x7FFFFFFF) return;						// 如果空指针 或是用 Dock 包裹则不执行 Release 操作
-			assert(p->versionNumber());											// 版本号不应该是 0,
+			if (!p) return;
+			auto rc = p->LoadRefCount();
+			if (XX_UNLIKELY(rc >= MemHeader_MPObject::handleFlag) && !ReleaseFlagged(p, rc)) return;
+			if (XX_UNLIKELY(!p->versionNumber()))								// 版本号不应该是 0. 除非是 arena scope 结束时已被强制析构的对象
+			{
+				assert(arenaDestroying);
+				return;
+			}
 #ifndef NDEBUG
 			if (enableRefCountAssert)
 			{
@@ -209,10 +1582,15 @@ namespace xx
 			}
 #endif
 			if (--p->refCount()) return;
+			if (XX_UNLIKELY(recyclers != nullptr) && TryRecycle(p)) return;	// 开启了回收的类型: 重置后挂入回收链表
 			auto stackIdx = p->memHeader().ptrStackIndex();						// 提前清空版本号以提供析构过程中针对当前对象的 Ensure() 返回空
+#ifdef XX_MEMPOOL_STATS
+			if (stackIdx != arenaIndex) StatObject(p->typeId(), stackIdx, -1);
+#endif
 			p->memHeader().versionNumber = 0;
 			p->~MPObject();
-			ptrstacks[stackIdx].Push((MemHeader_MPObject*)p - 1);				// 入池
+			if (XX_UNLIKELY(stackIdx == arenaIndex)) return;					// arena 内存于 scope 结束时统一回收
+			PushBlock((MemHeader_MPObject*)p - 1, stackIdx);					// 入池
 		}
 
 
@@ -285,19 +1663,92 @@ namespace xx
 			return _creators;
 		}
 
-		// 注册类型的父子关系. 顺便生成创建函数. MPObject 不需要注册. T 需要提供相应构造函数 for 反序列化
+		// 存 typeId 作为 root 序列化时是否不做指针去重( 由 Register 按 NoPtrDedup<T> 填充 )
+		inline static std::array<bool, 1 << sizeof(uint16_t) * 8>& noPtrDedups()
+		{
+			static std::array<bool, 1 << sizeof(uint16_t) * 8> _noPtrDedups;
+			return _noPtrDedups;
+		}
+
+		// 注册类型的父子关系( 并标记 typeRanges 待重建 ). 顺便生成创建函数. MPObject 不需要注册. T 需要提供相应构造函数 for 反序列化
 		template<typename T, typename PT>
 		static void Register();							// 实现在 xx_buffer.h 尾部
 
 
-		// 根据 typeid 判断父子关系
-		inline static bool IsBaseOf(uint32_t baseTypeId, uint32_t typeId)
+		// 类型树的 DFS 区间编号: 子孙的 begin 均落在祖先的 [begin, end) 之内
+		struct TypeRange
+		{
+			uint32_t begin;
+			uint32_t end;
+		};
+
+		// 存 typeId 对应的区间. 由 BuildTypeRanges 重建. 未能从根到达的( 父子关系成环 ) 为 { 0, 0 }
+		inline static std::array<TypeRange, 1 << sizeof(uint16_t) * 8>& typeRanges()
+		{
+			static std::array<TypeRange, 1 << sizeof(uint16_t) * 8> _typeRanges;
+			return _typeRanges;
+		}
+
+		// typeRanges 是否待重建. Register 只置位, 避免注册 n 个类型重建 n 次
+		inline static bool& typeRangesDirty()
+		{
+			static bool _typeRangesDirty = false;
+			return _typeRangesDirty;
+		}
+
+		// 根据 pids 重建 typeRanges. 根为 0 以及 父为自己的类型( 未注册的 typeId 父为 0, 即 0 的子 ). O(typeId 总数)
+		inline static void BuildTypeRanges()
 		{
-			for (; typeId != baseTypeId; typeId = pids()[typeId])
+			auto& ps = pids();
+			auto& rs = typeRanges();
+			const uint32_t n = (uint32_t)ps.size(), none = (uint32_t)-1;
+			auto buf = (uint32_t*)std::malloc(sizeof(uint32_t) * n * 3);
+			if (!buf) throw - 1;
+			auto firsts = buf, nexts = buf + n, stack = buf + n * 2;			// 首子 / 下一个兄弟 / DFS 栈
+			for (uint32_t t = 0; t < n; ++t) firsts[t] = none;
+			for (uint32_t t = n; --t > 0;)										// 倒序挂, 令兄弟按 typeId 升序
 			{
-				if (!typeId || typeId == pids()[typeId]) return false;
+				if (ps[t] == t) continue;
+				nexts[t] = firsts[ps[t]];
+				firsts[ps[t]] = t;
 			}
-			return true;
+			rs.fill(TypeRange{ 0, 0 });
+			uint32_t counter = 1;												// 从 1 开始, 令 { 0, 0 } 不包含任何类型
+			for (uint32_t r = 0; r < n; ++r)
+			{
+				if (r && ps[r] != r) continue;
+				uint32_t top = 0;
+				stack[top++] = r;
+				rs[r].begin = counter++;
+				while (top)
+				{
+					auto u = stack[top - 1];
+					auto c = firsts[u];
+					if (c != none)
+					{
+						firsts[u] = nexts[c];											// 消耗掉该子, 兼作迭代位置
+						rs[c].begin = counter++;
+						stack[top++] = c;
+					}
+					else
+					{
+						rs[u].end = counter;
+						--top;
+					}
+				}
+			}
+			std::free(buf);
+			typeRangesDirty() = false;
+		}
+
+		// 根据 typeid 判断父子关系( 判断 typeId 的区间起点是否落在 baseTypeId 的区间内 ). Register 之后首次调用时重建 typeRanges
+		inline static bool IsBaseOf(uint32_t baseTypeId, uint32_t typeId)
+		{
+			if (typeId == baseTypeId) return true;
+			if (XX_UNLIKELY(typeRangesDirty())) BuildTypeRanges();
+			auto& rs = typeRanges();
+			auto& b = rs[baseTypeId];
+			return rs[typeId].begin - b.begin < b.end - b.begin;
 		}
 
 		// 根据 类型 判断父子关系
@@ -328,6 +1779,61 @@ namespace xx
 	};
 
 
+	// arena 作用域. 生存期间 mp 的 Alloc / Create 均从 arena 分配, 析构时整体回收. mp 为空则不起作用
+	struct ArenaScope
+	{
+		MemPool* mp;
+		MemPool::ArenaMark mark;
+
+		explicit ArenaScope(MemPool* mp)
+			: mp(mp)
+		{
+			if (mp) mark = mp->BeginArena();
+		}
+		explicit ArenaScope(MemPool& mp)
+			: ArenaScope(&mp)
+		{
+		}
+		~ArenaScope()
+		{
+			if (mp) mp->EndArena(mark);
+		}
+		ArenaScope(ArenaScope const&) = delete;
+		ArenaScope& operator=(ArenaScope const&) = delete;
+	};
+
+
+	// MPtr 的紧凑替代品: 32 位句柄, 有效性判断只访问 MemPool 的句柄表. 适合大量存放于容器, 包, timer 中
+	template<typename T>
+	struct Handle
+	{
+		uint32_t value = 0;
+
+		Handle() {}
+		explicit Handle(uint32_t value) : value(value) {}
+		Handle(MemPool& mp, T* p) : value(p ? mp.MakeHandle(p) : 0) {}
+
+		T* Ensure(MemPool& mp) const
+		{
+			return mp.FromHandle<T>(value);
+		}
+		bool operator==(Handle const& o) const
+		{
+			return value == o.value;
+		}
+		bool operator!=(Handle const& o) const
+		{
+			return value != o.value;
+		}
+	};
+
+	template<typename T>
+	struct MemmoveSupport<Handle<T>>
+	{
+		static const bool value = true;
+	};
+
+
 	/***********************************************************************************/
 	// 一些函数要用到 MemPool 的功能故实现写在这里
 	/***********************************************************************************/
@@ -359,39 +1865,3 @@ namespace xx
 #include "xx_string.h"
 #include "xx_bbuffer.h"
 
-
-
-
-/*
-
-// todo: 对于线程安全的改造, 只是这样还不得行. 还要令 versionNumber 变为 atomic 类型( mempool 中的 与 内存头 中的 )
-// 这样的话就不方便用一个变量来运行时切换, 似乎只有用宏来切换
-
-// 线程安全的单链表
-struct SafePtrStack
-{
-	std::atomic<void*> header = nullptr;
-
-	inline bool TryPop(void*& output)
-	{
-		if (!header) return false;
-		for (;;)
-		{
-			output = header;
-			if (header.compare_exchange_weak(output, *(void**)((char*)output + sizeof(MemHeader_VersionNumber)))) break;
-		}
-		return true;
-	}
-
-	inline void Push(void* const& v)
-	{
-		auto& next = *(void**)((char*)v + sizeof(MemHeader_VersionNumber));
-		for (;;)
-		{
-			next = header;
-			if (header.compare_exchange_weak(next, v)) break;
-		}
-	}
-};
-
-*/
@@ -1,12 +1,18 @@
 ﻿#pragma once
 #include "xx_mptr.h"
 #include "xx_ptr.h"
+#ifdef XX_MEMPOOL_THREAD_SAFE
+#include <atomic>
+#endif
 
 namespace xx
 {
 	struct String;
 	struct BBuffer;
 
+	// CalcBBufferSize 未实现时的返回值. 累加结果 >= 它即视为长度未知
+	constexpr uint64_t BBufferSizeUnknown = 1ull << 40;
+
 	// 支持 MemPool 的类都应该从该基类派生
 	struct MPObject
 	{
@@ -15,6 +21,13 @@ namespace xx
 		// 加持
 		inline void AddRef()
 		{
+#ifdef XX_MEMPOOL_THREAD_SAFE
+			if (XX_UNLIKELY(IsShared()))
+			{
+				atomicRefCount().fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+#endif
 			assert(refCount() != 0xFFFFFFFF);		// 防止出现值类型被加持
 			++refCount();
 		}
@@ -64,6 +77,15 @@ namespace xx
 			return 0;
 		};
 
+		/*
+		return this->BaseType::CalcBBufferSize() + BBuffer::CalcWriteSize(.............);
+		*/
+		// 返回 ToBBuffer 写入长度的上限, 供 WriteRoot 一次性 Reserve
+		inline virtual uint64_t CalcBBufferSize() const
+		{
+			return BBufferSizeUnknown;
+		};
+
 		// 减持 或 析构 + 回收变野( 代码的实现在 xx_mempoolbase.h 的尾部 )
 		void Release() noexcept;
 
@@ -82,6 +104,23 @@ namespace xx
 
 		inline uint16_t const& typeId() const { return memHeader().typeId; }
 
+#ifdef XX_MEMPOOL_THREAD_SAFE
+		// 共享对象的引用计数会被多个线程同时修改, 故一律以原子方式访问
+		inline std::atomic<uint32_t>& atomicRefCount() const { return *(std::atomic<uint32_t>*)&memHeader().refCount; }
+
+		// 读引用计数( 含标记位 )
+		inline uint32_t LoadRefCount() const { return atomicRefCount().load(std::memory_order_relaxed); }
+
+		// 是否为共享对象( 见 MemPool::Share )
+		inline bool IsShared() const
+		{
+			return (atomicRefCount().load(std::memory_order_relaxed) & 0xC0000000u) == MemHeader_MPObject::sharedFlag;
+		}
+#else
+		// 读引用计数( 含标记位 )
+		inline uint32_t LoadRefCount() const { return refCount(); }
+#endif
+
 		inline uint16_t& tsFlags() { return memHeader().tsFlags; }
 		inline uint16_t& tsFlags() const { return memHeader().tsFlags; }
 
@@ -147,6 +186,17 @@ namespace xx
 	constexpr bool IsMPObject_v = IsMPObject<T>::value;
 
 
+	// SharedType: 标记该类型的对象创建后即为共享对象( 见 MemPool::Share. 仅线程安全模式下有效 )
+
+	template<typename T>
+	struct SharedType
+	{
+		static const bool value = false;
+	};
+	template<typename T>
+	constexpr bool SharedType_v = SharedType<T>::value;
+
+
 	// 扫类型列表中是否含有 MPObject* 或 MPtr<MPObject> 类型
 	template<typename ...Types>
 	struct ExistsMPObject
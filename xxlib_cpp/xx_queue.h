@@ -89,7 +89,7 @@ namespace xx
 	Queue<T>::Queue(uint32_t capacity)
 	{
 		if (capacity < 8) capacity = 8;
-		auto bufByteLen = Round2n(capacity * sizeof(T) + sizeof(MemHeader_VersionNumber)) - sizeof(MemHeader_VersionNumber);
+		auto bufByteLen = MemPool::CalcUsableSize(capacity * sizeof(T));
 		buf = (T*)mempool().Alloc((uint32_t)bufByteLen);
 		bufLen = uint32_t(bufByteLen / sizeof(T));
 	}
@@ -262,7 +262,7 @@ namespace xx
 		assert(capacity > 0);
 		if (capacity <= bufLen) return;
 
-		auto newBufByteLen = Round2n(capacity * sizeof(T) + sizeof(MemHeader_VersionNumber)) - sizeof(MemHeader_VersionNumber);
+		auto newBufByteLen = MemPool::CalcUsableSize(capacity * sizeof(T));
 		auto newBuf = (T*)mempool().Alloc((uint32_t)newBufByteLen);
 		auto newBufLen = uint32_t(newBufByteLen / sizeof(T));
 
@@ -433,6 +433,86 @@ namespace xx
 		std::cout << s->C_str() << std::flush;
 	}
 
+#ifdef XX_MEMPOOL_FRAG_STATS
+	inline void MemPool::FragStatsToString(String& s) const
+	{
+		uint64_t totalRequest = 0, totalClass = 0, totalPow2 = 0;
+		s.Append("classSize\tcount\trequestBytes\tclassBytes\tpow2Bytes\tfragment%\tpow2Fragment%\n");
+		for (size_t i = 0; i < fragStats.size(); ++i)
+		{
+			auto& fs = fragStats[i];
+			if (!fs.count) continue;
+			s.Append(CalcClassSize(i), "\t", fs.count, "\t", fs.requestBytes, "\t", fs.classBytes, "\t", fs.pow2Bytes, "\t"
+				, (double)(fs.classBytes - fs.requestBytes) * 100 / fs.classBytes, "\t"
+				, (double)(fs.pow2Bytes - fs.requestBytes) * 100 / fs.pow2Bytes, "\n");
+			totalRequest += fs.requestBytes;
+			totalClass += fs.classBytes;
+			totalPow2 += fs.pow2Bytes;
+		}
+		if (!totalClass) return;
+		s.Append("total\t\t", totalRequest, "\t", totalClass, "\t", totalPow2, "\t"
+			, (double)(totalClass - totalRequest) * 100 / totalClass, "\t"
+			, (double)(totalPow2 - totalRequest) * 100 / totalPow2, "\n");
+	}
+#endif
+
+#ifdef XX_MEMPOOL_STATS
+	inline void MemPool::GetStats(List<ClassStat>& outClassStats, List<TypeStat>& outTypeStats) const
+	{
+		outClassStats.Clear();
+		for (auto& cs : classStats)
+		{
+			if (cs.allocs || cs.live) outClassStats.Add(cs);
+		}
+		outTypeStats.Clear();
+		for (uint32_t i = 0; i < (1 << sizeof(uint16_t) * 8); ++i)
+		{
+			auto& tc = typeCounters[i];
+			if (!tc.live) continue;
+			auto&& ts = outTypeStats.Emplace();
+			ts.typeId = (uint16_t)i;
+			ts.live = tc.live;
+			ts.bytes = tc.bytes;
+		}
+	}
+
+	template<>
+	struct StrFunc<MemPool::ClassStat, void>
+	{
+		static inline uint32_t Calc(MemPool::ClassStat const &)
+		{
+			return 160 + 7 * 20;
+		}
+		static inline uint32_t WriteTo(char *dstBuf, MemPool::ClassStat const &in)
+		{
+			return StrWriteTo(dstBuf
+				, "{ \"type\" : \"ClassStat\", \"classSize\" : ", in.classSize
+				, ", \"allocs\" : ", in.allocs
+				, ", \"frees\" : ", in.frees
+				, ", \"hits\" : ", in.hits
+				, ", \"misses\" : ", in.misses
+				, ", \"live\" : ", in.live
+				, ", \"peak\" : ", in.peak, " }");
+		}
+	};
+
+	template<>
+	struct StrFunc<MemPool::TypeStat, void>
+	{
+		static inline uint32_t Calc(MemPool::TypeStat const &)
+		{
+			return 80 + 3 * 20;
+		}
+		static inline uint32_t WriteTo(char *dstBuf, MemPool::TypeStat const &in)
+		{
+			return StrWriteTo(dstBuf
+				, "{ \"type\" : \"TypeStat\", \"typeId\" : ", in.typeId
+				, ", \"live\" : ", in.live
+				, ", \"bytes\" : ", in.bytes, " }");
+		}
+	};
+#endif
+
 
 	template<typename T, uint32_t reservedHeaderLen>
 	void List<T, reservedHeaderLen>::ToString(String &str) const
@@ -5,6 +5,17 @@
 #include <assert.h>
 #include <memory>
 #include <functional>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <future>
+#include <csignal>
+
+// libuv 于 unix 下对单个 stream 同步地依次 alloc, read, read_cb, 同一 loop 的 peer 可共用一个接收缓冲区.
+// windows 下 libuv 会预先 alloc 并挂起 overlapped WSARecv( 活动 stream 少于 50 个时 ), 多个 peer 的读会同时写入各自的缓冲区, 不能共用
+#ifndef _WIN32
+#define XX_UV_SHARED_RECEIVE_BUFFER
+#endif
 
 namespace xx
 {
@@ -15,16 +26,29 @@ namespace xx
 	struct UVClientPeer;
 	struct UVTimer;
 	struct UVAsync;
+	struct UVCluster;
 
-	struct UV : MPObject											// 该类可能只能创建 1 份实例
+	// 每个线程最多跑 1 份实例. 多核见 UVCluster
+	// 注意: unix 下构造时会调用 IgnoreSigPipe() 将整个进程的 SIGPIPE 置为忽略( 写已断开的连接时由写操作返回 EPIPE, 而不是杀掉进程 ).
+	// 宿主程序若要自行处理 SIGPIPE, 可定义 XX_UV_KEEP_SIGPIPE 关掉该行为, 但须自行确保 SIGPIPE 不会令进程退出
+	struct UV : MPObject
 	{
 		List_v<UVListener*> listeners;
 		List_v<UVClientPeer*> clientPeers;
 		List_v<UVTimer*> timers;
 		List_v<UVAsync*> asyncs;
+		List_v<UVPeer*> flushPeers;									// cork 的 peer 留待本轮末再发的. 于 uv_check( I/O 回调处理完 )及 uv_prepare( 将要等待 I/O 前 )时统一发
+		bool reusePort = false;										// 为真则之后创建的 listener 开 SO_REUSEPORT( 多个 loop 可监听同一端口, 由内核分派连接 )
+		UVCluster* cluster = nullptr;								// 所属 UVCluster( 非经其创建的为空 )
+		uint32_t clusterIndex = 0;									// 于 cluster->loops 中的下标
+#ifdef XX_UV_SHARED_RECEIVE_BUFFER
+		BBuffer_v bbReceive;										// 所有 peer 共用的接收缓冲区. libuv 分配后立即同步读取并回调, 同一时刻只会有一个 peer 在用
+#endif
+		BBuffer_v bbReceiveUnpack;									// 所有 peer 共用的解压缓冲区( 同上, 只在 OnReceivePackage 期间有效 )
 
 		UV();
 		~UV();
+		static void IgnoreSigPipe();								// 将进程的 SIGPIPE 置为忽略( windows 下无此信号, 什么也不做 )
 		int EnableIdle();
 		void DisableIdle();
 		void Run();
@@ -42,7 +66,12 @@ namespace xx
 		// uv's
 		uv_loop_t loop;
 		uv_idle_t idler;
+		uv_prepare_t preparer;
+		uv_check_t checker;
+		void FlushPeers();											// 内部函数, 发出 flushPeers 留待的数据
 		static void IdleCB(uv_idle_t* handle);
+		static void PrepareCB(uv_prepare_t* handle);
+		static void CheckCB(uv_check_t* handle);
 	};
 
 	struct UVListener : MPObject									// 当前为 ipv4, ip 为 0.0.0.0
@@ -68,6 +97,14 @@ namespace xx
 		Closed
 	};
 
+	// 包头格式( 包头之后为数据 )
+	enum class UVPackageHeaders : uint8_t
+	{
+		UInt16,														// 2 字节定长( 小尾 ). 数据最长 65535
+		UInt32,														// 4 字节定长( 小尾 )
+		VarUInt32													// 7bit 变长编码, 1 ~ 5 字节
+	};
+
 	// 这个并不直接拿来用
 	struct UVPeer : MPObject										// 一些基础数据结构
 	{
@@ -75,35 +112,59 @@ namespace xx
 		~UVPeer();
 
 		UV* uv;
-		BBuffer_v bbReceive;										// for ReadCB & OnReceive
-		BBuffer_v bbReceiveLeft;									// 积攒 OnReceive 处理时剩下的数据
-		BBuffer_v bbReceivePackage;									// for OnReceivePackage 传参, 引用 bbReceive 或 bbReceiveLeft 的内存
+		BBuffer* bbReceive = nullptr;								// for ReadCB & OnReceive. 指向 uv->bbReceive( 共用时 ) 或 bbReceiveOwn( 见 XX_UV_SHARED_RECEIVE_BUFFER )
+		BBuffer_v bbReceiveLeft;									// 积攒 OnReceive 处理时剩下的不完整包. 按包长分配, 没有剩余数据时即释放
+		BBuffer_v bbReceivePackage;									// for OnReceivePackage 传参, 引用 bbReceive 或 bbReceiveLeft 或 uv->bbReceiveUnpack 的内存
 
 		BBQueue_v sendBufs;											// 待发送数据队列. 所有 Send 操作都是将数据压入这里, 再取适当长度的一段来发送
 		List_v<uv_buf_t> writeBufs;									// 复用的 uv 写操作 多段数据参数
 
-		bool sending = false;										// 发送操作标记. 当前设计中只同时发一段数据, 成功回调时才继续发下一段
+		uint32_t numWritings = 0;									// 正在发( 已 uv_write 未回调 )的段数. 最多 maxWritings 段同时发, 回调时继续发
+		uint32_t writingsHead = 0;									// 最早发出的那段的 writers 下标( 回调按发出顺序发生 )
+		uint32_t sendLen = 65536;									// 每段( 一次 uv_try_write / uv_write )最多发的字节数
+		bool cork = false;											// 为真则 Send 只入队, 留待本轮末( 见 uv->flushPeers )合并成一次发出. 适合一次处理要发多个小包的场合
+		uint32_t corkMaxLatency = 0;								// cork 时生效. 非 0 则 Send 时若最早留待的数据已等待超过该值( 微秒 )即立即发, 不等到本轮末. 供个别对延迟敏感的 peer 用
+		uint64_t corkSince = 0;										// cork 时最早留待数据的时间( uv_hrtime, 纳秒. corkMaxLatency 非 0 时才记录 )
+		uint32_t uv_flushPeers_index = (uint32_t)-1;				// 于 uv->flushPeers 中的下标. -1 表示不在其中
+		MemPool* tmpMemPool = nullptr;								// 非空则 OnReceive 期间 bbReceivePackage 用它创建反序列化对象, 并套 ArenaScope 于 OnReceive 返回时整体回收
 		UVPeerStates state;											// 连接状态( server peer 初始为 Connected, client peer 为 Disconnected )
-
-		virtual void OnReceive();									// 默认实现为读取包( 2 byte长度 + 数据 ), 并于凑齐完整包后 call OnReceivePackage
-		virtual void OnReceivePackage(BBuffer& bb) = 0;				// OnReceive 凑齐一个包时将产生该调用
+		bool compress = false;										// 包数据前带 1 字节压缩标记( 见 BBuffer::WritePackageCompressible ). 两端须一致, 通常于握手包协商后同时开启. 局域网可不开
+		uint32_t compressThreshold = 256;							// compress 时包数据长度达到该值才尝试 LZ4 压缩
+		UVPackageHeaders packageHeader = UVPackageHeaders::UInt16;	// 包头格式. 两端须一致
+		uint32_t maxPackageLen = 1024 * 1024 * 16;					// 收发的包数据长度上限. 收到超长的包头即断开, 发送超长的包返回失败
+		uint32_t recvHeaderLen = 0;									// bbReceiveLeft 中不完整包的包头长度. 0 表示包头还没收全
+		uint32_t recvPackageLen = 0;								// bbReceiveLeft 中不完整包的数据长度( 包头收全后有效 )
+
+		virtual void OnReceive();									// 默认实现为按 packageHeader 读取包, 并于凑齐完整包后 call OnReceivePackage
+		virtual void OnReceivePackage(BBuffer& bb) = 0;				// OnReceive 凑齐一个包时将产生该调用. 反序列化出的 StringView / BytesView 只在此调用期间有效. 可先 bb.PeekRootTypeId 分派, 不需要的包不必解
 		virtual void OnDisconnect() = 0;							// 断开事件
 
 		BBuffer* GetSendBB(int const& capacity = 0);				// 获取或创建一个发送用的 BBuffer( 里面可能已经有部分数据 ), 不要自己持有, 填完传给 Send( 不管是否断开 )
-		int Send(BBuffer* const& bb);								// 将数据"移入"待发送队列, 可能立即发送, 立即返回是否成功( 0 表示成功 )( 失败原因可能是待发数据过多 )
+		int Send(BBuffer* const& bb);								// 将数据"移入"待发送队列, 可能立即发送, 立即返回是否成功( 0 表示成功 )( 失败原因可能是待发数据过多 ). 分段写模式的 bb 各段直接作为多段数据发出
 		virtual int Disconnect(bool const& immediately = true);		// 断开( 接着会 Release ). immediately 为否就走 shutdown 模式( 延迟杀, 能尽可能确保数据发出去 )
 
+		int Flush();												// 立即发出 cork 留待本轮末的数据( 如某包须马上发出 )
+
 		int SetNoDelay(bool const& enable);							// 开关 tcp 延迟发送以积攒数据的功能
 		int SetKeepAlive(bool const& enable, uint32_t const& delay);// 设置 tcp 保持活跃的时长
 
 		String_v tmpStr;
 		String& GetPeerName();
 
-		int Send();													// 内部函数, 开始发送 sendBufs 里的东西
+		int Send();													// 内部函数, 开始发送 sendBufs 里的东西. 没有正在发的则先 uv_try_write, 写不完的再 uv_write
+		int ReceivePackage(char* buf, uint32_t len);				// 内部函数, 按需解压后 call OnReceivePackage. 返回非 0 表示数据非法
+		int ReadPackageHeader(char const* buf, uint32_t const& len, uint32_t& pkgLen) const;	// 内部函数, 按 packageHeader 读包头. 成功返回包头长度, 数据不足返回 0, 非法或超长返回负数
+		void BeginPackage(BBuffer& bb) const;						// 按 packageHeader 及 compress 开始写一个包
+		bool EndPackage(BBuffer& bb) const;							// 按 packageHeader 及 compress 结束写一个包. 超长返回 false( 已回滚 )
 		void Clear();												// 内部函数, 于断开之后清理收发相关缓存
+		void DelayFlush();											// 内部函数, 加入 uv->flushPeers( 如果不在其中 )
+		void CancelFlush();											// 内部函数, 从 uv->flushPeers 移除( 如果在其中 )
 
 		// 方便使用的一些扩展( 当前并不直接映射到 C# )
 		List_v<MPObject*> recvPkgs;									// 可于 OnReceivePackage 时用 bb.ReadPackages(*recvPkgs) 来填充它. 须用 bb.ReleasePackages 释放.
+#ifndef XX_UV_SHARED_RECEIVE_BUFFER
+		BBuffer_v bbReceiveOwn;										// 不能共用接收缓冲区的平台上各 peer 自带一个
+#endif
 		void ReleaseRecvPkgs();										// 主动回收 recvPkgs 的数据
 	protected:
 		template<typename T>
@@ -119,11 +180,14 @@ namespace xx
 		int SendPackages(TS const& ... pkgs);						// 语法糖, 等同于写多行的 Send 针对每个参数. 会发出 pkgs 个数个 [head] + [data]
 		template<typename ...TS>
 		int SendCombine(TS const& ... pkgs);						// 会在物理上将多个包合并成 1 个 [head] + [data] 中的 [data] 发出
+		int SendPackageData(char const* const& buf, uint32_t const& len);	// 将已序列化的包数据( 不含包头 )加包头原样发出. 用于转发 OnReceivePackage 的 bb 而不反序列化
 
 		// uv's
 		uv_tcp_t stream;
 		uv_shutdown_t sreq;
-		uv_write_t writer;
+		static const uint32_t maxWritings = 4;
+		uv_write_t writers[maxWritings];							// 环形使用, 从 writingsHead 起 numWritings 个正在发
+		uint32_t writerBufIndexs[maxWritings];						// 各段发出时 sendBufs 的 bufIndex. 回调成功后据此 ReleasePopped
 
 		static void AllocCB(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf);
 		static void CloseCB(uv_handle_t* stream);
@@ -195,6 +259,54 @@ namespace xx
 		static void AsyncCB(uv_async_t* handle);
 	};
 
+	// 多线程多 loop 服务器. 每个 loop 独占一个线程, 有各自的 MemPool 和 UV, loop 间不共享任何对象( 故无锁 )
+	// 各 loop 于 init 中创建 listener, 因已开 SO_REUSEPORT 可监听同一端口, 由内核将连接分散到各 loop
+	// 跨 loop 通信只能经 Post( 线程安全 ). 需要系统支持 SO_REUSEPORT( Linux 3.9+, BSD, macOS ), 否则第 2 个 listener 会 bind 失败
+	struct UVCluster
+	{
+		typedef std::function<void(UV& uv)> FuncType;
+		struct Loop
+		{
+			UV* uv = nullptr;										// 运行期间有效, 只可在该 loop 的线程中访问
+			UVAsync* poster = nullptr;								// 运行期间非空. 受 mtx 保护
+			std::thread thread;
+			std::mutex mtx;
+			std::vector<FuncType> funcs;							// 待执行的投递函数. 受 mtx 保护
+		};
+		std::vector<std::unique_ptr<Loop>> loops;
+
+		UVCluster() = default;
+		UVCluster(UVCluster const&) = delete;
+		UVCluster& operator=(UVCluster const&) = delete;
+		~UVCluster();												// 停止并等待所有线程退出
+
+		// 启动 numLoops 个线程( 0 表示 CPU 核数 ), 各线程建好 UV 后在其上 call init( 通常用于 CreateListener ), 再 Run
+		// init 返回非 0 表示失败, 此时停掉所有 loop 并返回该值. pinThreads 为真则第 i 个线程绑到第 i % 核数 个 CPU
+		int Start(uint32_t numLoops, std::function<int(UV& uv)> const& init, bool const& pinThreads = true);
+		int Post(uint32_t const& loopIndex, FuncType&& f);			// 投递 f 到指定 loop 的线程执行( 线程安全 ). loop 未运行则返回非 0
+		void Stop();												// 通知所有 loop 退出 Run( 线程安全 ). 之后未执行的投递函数将被丢弃
+		void Join();												// 等待所有线程退出( 不可在 loop 线程中调用 )
+		static int PinCurrentThread(uint32_t const& cpuIndex);		// 将当前线程绑到指定 CPU. 不支持的平台返回非 0
+
+		void LoopProcess(uint32_t const& loopIndex, std::function<int(UV& uv)> const& init, bool const& pinThreads, std::promise<int>& ready);	// 内部函数, 线程函数
+	};
+
+	// 供 UVCluster::Post 唤醒 loop 并执行投递函数
+	struct UVClusterPoster : UVAsync
+	{
+		UVCluster::Loop* loop;
+
+		UVClusterPoster(UV* uv, UVCluster::Loop* loop);
+		virtual void OnFire() override;
+	};
+
+	// 定时调用 mempool().TrimTick(), 将超出预算的缓存内存归还系统
+	struct UVMemPoolTrimmer : UVTimer
+	{
+		UVMemPoolTrimmer(UV* uv, uint64_t const& intervalMS = 1000);
+		virtual void OnFire() override;
+	};
+
 	// 用来解决 uv_buf_t 跨平台时的成员顺序结构不一致的复制 / 赋值 问题
 	template<>
 	struct BufMaker<uv_buf_t, void>
@@ -7,10 +7,24 @@ namespace xx
 		, clientPeers(mempool())
 		, timers(mempool())
 		, asyncs(mempool())
+		, flushPeers(mempool())
+#ifdef XX_UV_SHARED_RECEIVE_BUFFER
+		, bbReceive(mempool())
+#endif
+		, bbReceiveUnpack(mempool())
 	{
 		//loop = uv_default_loop();
+#ifndef XX_UV_KEEP_SIGPIPE
+		IgnoreSigPipe();											// 写已断开的连接默认会令进程收到 SIGPIPE 而退出. 忽略之, 由写操作返回 EPIPE
+#endif
 		if (auto r = uv_loop_init(&loop)) throw r;
 		uv_idle_init(&loop, &idler);
+		uv_prepare_init(&loop, &preparer);
+		uv_prepare_start(&preparer, PrepareCB);
+		uv_unref((uv_handle_t*)&preparer);							// 不因它而令 Run 不退出
+		uv_check_init(&loop, &checker);
+		uv_check_start(&checker, CheckCB);
+		uv_unref((uv_handle_t*)&checker);
 	}
 
 	inline UV::~UV()
@@ -39,9 +53,18 @@ namespace xx
 		}
 		clientPeers->Clear();
 
+		uv_close((uv_handle_t*)&preparer, nullptr);
+		uv_close((uv_handle_t*)&checker, nullptr);
 		uv_loop_close(&loop);
 	}
 
+	inline void UV::IgnoreSigPipe()
+	{
+#ifndef _WIN32
+		signal(SIGPIPE, SIG_IGN);
+#endif
+	}
+
 	inline int UV::EnableIdle()
 	{
 		return uv_idle_start(&idler, IdleCB);
@@ -100,6 +123,32 @@ namespace xx
 		self->OnIdle();
 	}
 
+	inline void UV::PrepareCB(uv_prepare_t* handle)
+	{
+		auto self = container_of(handle, UV, preparer);
+		self->FlushPeers();											// timer, async 等回调里 Send 的, 在等待 I/O 前发出
+	}
+
+	inline void UV::CheckCB(uv_check_t* handle)
+	{
+		auto self = container_of(handle, UV, checker);
+		self->FlushPeers();											// I/O 回调里 Send 的, 在本轮处理完 I/O 后发出
+	}
+
+	inline void UV::FlushPeers()
+	{
+		while (flushPeers->dataLen)
+		{
+			auto p = flushPeers->Top();
+			flushPeers->Pop();
+			p->uv_flushPeers_index = (uint32_t)-1;
+			if (!p->numWritings && p->Send())
+			{
+				p->Disconnect();
+			}
+		}
+	}
+
 
 
 
@@ -112,6 +161,24 @@ namespace xx
 		sockaddr_in addr;
 		uv_ip4_addr("0.0.0.0", port, &addr);
 
+#ifdef SO_REUSEPORT
+		if (uv->reusePort)
+		{
+			// 先建 socket 以便在 bind 前设置选项
+			if (auto rtv = uv_tcp_init_ex(&uv->loop, &tcpServer, AF_INET))
+			{
+				throw rtv;
+			}
+			uv_os_fd_t fd;
+			int on = 1;
+			if (uv_fileno((uv_handle_t*)&tcpServer, &fd) || setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)))
+			{
+				uv_close((uv_handle_t*)&tcpServer, nullptr);	// rollback
+				throw - 1;
+			}
+		}
+		else
+#endif
 		if (auto rtv = uv_tcp_init(&uv->loop, &tcpServer))
 		{
 			throw rtv;
@@ -158,14 +225,19 @@ namespace xx
 
 
 	inline UVPeer::UVPeer()
-		: bbReceive(mempool())
-		, bbReceiveLeft(mempool())
+		: bbReceiveLeft(mempool())
 		, bbReceivePackage(mempool())
 		, sendBufs(mempool())
 		, writeBufs(mempool())
 		, tmpStr(mempool())
 		, recvPkgs(mempool())
+#ifndef XX_UV_SHARED_RECEIVE_BUFFER
+		, bbReceiveOwn(mempool())
+#endif
 	{
+#ifndef XX_UV_SHARED_RECEIVE_BUFFER
+		bbReceive = bbReceiveOwn;
+#endif
 	}
 
 	inline UVPeer::~UVPeer()
@@ -175,6 +247,7 @@ namespace xx
 		{
 			uv_close((uv_handle_t*)&stream, nullptr);
 		}
+		CancelFlush();
 
 		bbReceivePackage->buf = nullptr;
 		bbReceivePackage->bufLen = 0;
@@ -187,12 +260,27 @@ namespace xx
 	inline void UVPeer::AllocCB(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf)
 	{
 		auto self = container_of(handle, UVPeer, stream);
-		if (suggested_size > self->bbReceive->bufLen)
+
+		// 正在收的大包还差不少于 suggested_size 字节: 直接收进 bbReceiveLeft 的剩余空间( 不会读到下一个包 ), 省掉一次复制
+		// 每次仍只给 suggested_size 字节, 读满时 libuv 会接着读, 给太多反而每次都读不满而回到 poll
+		if (self->recvHeaderLen)
 		{
-			self->bbReceive->Reserve((uint32_t)suggested_size);
+			auto& left = *self->bbReceiveLeft;
+			if (self->recvHeaderLen + self->recvPackageLen - left.dataLen >= suggested_size)
+			{
+				buf->base = left.buf + left.dataLen;
+				buf->len = suggested_size;
+				return;
+			}
+		}
+
+		auto& bb = *self->bbReceive;
+		if (suggested_size > bb.bufLen)
+		{
+			bb.Reserve((uint32_t)suggested_size);
 		}
-		buf->base = self->bbReceive->buf;
-		buf->len = self->bbReceive->bufLen;
+		buf->base = bb.buf;
+		buf->len = bb.bufLen;
 	}
 
 	inline void UVPeer::ShutdownCB(uv_shutdown_t* req, int status)
@@ -229,16 +317,36 @@ namespace xx
 			/* Everything OK, but nothing read. */
 			return;
 		}
-		assert(buf->base == self->bbReceive->buf && buf->len == self->bbReceive->bufLen);
-		self->bbReceive->dataLen = (uint32_t)nread;
+		if (buf->base == self->bbReceive->buf)
+		{
+			self->bbReceive->dataLen = (uint32_t)nread;
+		}
+		else
+		{
+			// 直接收进了 bbReceiveLeft( 见 AllocCB ). bbReceive 置空, OnReceive 时将只检查包是否已凑齐
+			assert(buf->base == self->bbReceiveLeft->buf + self->bbReceiveLeft->dataLen);
+			self->bbReceiveLeft->dataLen += (uint32_t)nread;
+			self->bbReceive->dataLen = 0;
+		}
 		self->bbReceive->offset = 0;
+		self->bbReceivePackage->readMemPool = self->tmpMemPool;
+		ArenaScope as(self->tmpMemPool);
 		self->OnReceive();
+
+		// 不完整包都处理完了就释放, 使空闲连接不占接收缓存
+		if (!self->bbReceiveLeft->dataLen && self->bbReceiveLeft->buf)
+		{
+			self->bbReceiveLeft->Clear(true);
+		}
 	}
 
 	inline void UVPeer::SendCB(uv_write_t *req, int status)
 	{
-		auto self = container_of(req, UVPeer, writer);
-		self->sending = false;
+		auto self = (UVPeer*)req->data;
+		assert(req == &self->writers[self->writingsHead]);
+		auto bufIndex = self->writerBufIndexs[self->writingsHead];
+		self->writingsHead = (self->writingsHead + 1) % maxWritings;
+		--self->numWritings;
 		if (status)
 		{
 			//std::cout << "Send error " << uv_strerror(status) << std::endl;
@@ -246,133 +354,229 @@ namespace xx
 		}
 		else
 		{
-			self->Send();  // 继续发, 直到发光	// todo: 如果返回错误, 存 last error?
+			self->sendBufs->ReleasePopped(bufIndex);
+			if (self->Send()) self->Disconnect();	// 继续发, 直到发光
 		}
 	}
 
 	inline void UVPeer::OnReceive()
 	{
-		// 先实现定长 2 字节包头的版本
+		auto& bb = *bbReceive;
+		auto& left = *bbReceiveLeft;
 
-		// 如果 bbReceiveLeft 没数据, 则直接在 bbReceive 上进行包完整性判断. 
-		// 如果内含完整包, 不断触发 OnReceivePackage 处理之, 最后将剩下的数据移到 bbReceiveLeft
-		if (!bbReceiveLeft->dataLen)
+		// 如果 bbReceiveLeft 有不完整的包, 先从 bbReceive 补齐它
+		if (left.dataLen)
 		{
-			// 开始处理
-		LabBegin:
-			uint16_t dataLen = 0;
+			// 包头不完整则逐字节补( 包头最多 5 字节 ), 直到能读出包头
+			while (!recvHeaderLen)
+			{
+				auto rtv = ReadPackageHeader(left.buf, left.dataLen, recvPackageLen);
+				if (rtv < 0)
+				{
+					Disconnect();
+					return;
+				}
+				if (rtv)
+				{
+					recvHeaderLen = rtv;
+					left.Reserve(recvHeaderLen + recvPackageLen);		// 按整包长度一次分配到位
+					break;
+				}
+				if (bb.offset == bb.dataLen) return;
+				left.Write(bb.buf[bb.offset++]);
+			}
 
-			// 判断头长度. 如果不够长, 将剩余数据追加到 bbReceiveLeft 后退出
-			if (bbReceive->dataLen < bbReceive->offset + sizeof(dataLen))
+			// 补数据区. 不够就全部追加后退出
+			auto need = recvHeaderLen + recvPackageLen - left.dataLen;
+			if (bb.dataLen - bb.offset < need)
 			{
-				bbReceiveLeft->Write(bbReceive->buf[bbReceive->offset++]);		// 这里只可能是1字节
+				left.WriteBuf(bb.buf + bb.offset, bb.dataLen - bb.offset);
 				return;
 			}
+			left.WriteBuf(bb.buf + bb.offset, need);
+			bb.offset += need;
 
-			// 读出头
-			dataLen = bbReceive->buf[bbReceive->offset] + (bbReceive->buf[bbReceive->offset + 1] << 8);
-			bbReceive->offset += 2;
-
-			// 如果数据区长度足够, 来一发 OnReceivePackage 并重复解析头 + 数据的过程
-			if (bbReceive->offset + dataLen <= bbReceive->dataLen)
+			// 凑齐了, 来一发 OnReceivePackage 后清数据, 继续处理 bbReceive 中剩下的
+			if (ReceivePackage(left.buf + recvHeaderLen, recvPackageLen))
 			{
-				bbReceivePackage->buf = bbReceive->buf + bbReceive->offset;
-				bbReceivePackage->bufLen = dataLen;
-				bbReceivePackage->dataLen = dataLen;
-				bbReceivePackage->offset = 0;
-
-				OnReceivePackage(*bbReceivePackage);
+				Disconnect();
+				return;
+			}
+			left.dataLen = 0;
+			recvHeaderLen = 0;
+		}
 
-				// 跳过已处理过的数据段并继续解析流程
-				bbReceive->offset += dataLen;
-				if (bbReceive->dataLen > bbReceive->offset) goto LabBegin;
+		// 直接在 bbReceive 上解析. 完整的包原地 call OnReceivePackage, 最后的不完整包移到 bbReceiveLeft
+		while (bb.offset < bb.dataLen)
+		{
+			uint32_t pkgLen = 0;
+			auto rtv = ReadPackageHeader(bb.buf + bb.offset, bb.dataLen - bb.offset, pkgLen);
+			if (rtv < 0)
+			{
+				Disconnect();
+				return;
 			}
-			// 否则将剩余数据追加到 bbReceiveLeft 后退出
-			else
+			if (!rtv || bb.dataLen - bb.offset - rtv < pkgLen)
 			{
-				bbReceiveLeft->WriteBuf(bbReceive->buf + bbReceive->offset, bbReceive->dataLen - bbReceive->offset);
+				if (rtv)
+				{
+					recvHeaderLen = rtv;
+					recvPackageLen = pkgLen;
+					left.Reserve(rtv + pkgLen);
+				}
+				left.WriteBuf(bb.buf + bb.offset, bb.dataLen - bb.offset);
+				return;
+			}
+			if (ReceivePackage(bb.buf + bb.offset + rtv, pkgLen))
+			{
+				Disconnect();
+				return;
 			}
+			bb.offset += rtv + pkgLen;
 		}
-		// 如果 bbReceiveLeft 有数据, 则试从 bbReceive 补齐一个包的数据
-		// 触发 OnReceivePackage 后清数据, 跳到 bbReceiveLeft 没数据的流程
-		else
+	}
+
+	inline int UVPeer::ReadPackageHeader(char const* buf, uint32_t const& len, uint32_t& pkgLen) const
+	{
+		int rtv;
+		switch (packageHeader)
 		{
-			bbReceiveLeft->offset = 0;
-			uint16_t dataLen = 0;
+		case UVPackageHeaders::UInt16:
+			rtv = BBuffer::ReadPackageHeader(buf, len, pkgLen, (uint16_t*)nullptr);
+			break;
+		case UVPackageHeaders::UInt32:
+			rtv = BBuffer::ReadPackageHeader(buf, len, pkgLen, (uint32_t*)nullptr);
+			break;
+		default:
+			rtv = BBuffer::ReadPackageHeader(buf, len, pkgLen, (VarPackageSize*)nullptr);
+		}
+		if (rtv > 0 && pkgLen > maxPackageLen) return -1;
+		return rtv;
+	}
 
-			// 判断头长度. 如果不够长, 看看能不能补足
-			if (bbReceiveLeft->offset + sizeof(dataLen) > bbReceiveLeft->dataLen)
-			{
-				// 还差多少凑齐包头
-				auto left = bbReceiveLeft->offset + sizeof(dataLen) - bbReceiveLeft->dataLen;
+	inline void UVPeer::BeginPackage(BBuffer& bb) const
+	{
+		switch (packageHeader)
+		{
+		case UVPackageHeaders::UInt16:
+			if (compress) bb.BeginWritePackageCompressible<uint16_t>();
+			else bb.BeginWritePackage<uint16_t>();
+			break;
+		case UVPackageHeaders::UInt32:
+			if (compress) bb.BeginWritePackageCompressible<uint32_t>();
+			else bb.BeginWritePackage<uint32_t>();
+			break;
+		default:
+			if (compress) bb.BeginWritePackageCompressible<VarPackageSize>();
+			else bb.BeginWritePackage<VarPackageSize>();
+		}
+	}
 
-				// 如果剩余数据长度无法补足, 追加刚收到的数据后退出
-				if (bbReceive->offset + left > bbReceive->dataLen)
-				{
-					bbReceiveLeft->Write(bbReceive->buf[bbReceive->offset]);	// 这里只可能差1字节补足包头( 下同 )
-					return;
-				}
-				else
-				{
-					bbReceiveLeft->Write(bbReceive->buf[bbReceive->offset++]);
-				}
-			}
+	inline bool UVPeer::EndPackage(BBuffer& bb) const
+	{
+		switch (packageHeader)
+		{
+		case UVPackageHeaders::UInt16:
+			return compress ? bb.EndWritePackageCompressible<uint16_t>(compressThreshold, maxPackageLen) : bb.EndWritePackage<uint16_t>(maxPackageLen);
+		case UVPackageHeaders::UInt32:
+			return compress ? bb.EndWritePackageCompressible<uint32_t>(compressThreshold, maxPackageLen) : bb.EndWritePackage<uint32_t>(maxPackageLen);
+		default:
+			return compress ? bb.EndWritePackageCompressible<VarPackageSize>(compressThreshold, maxPackageLen) : bb.EndWritePackage<VarPackageSize>(maxPackageLen);
+		}
+	}
 
-			// 读包头, 得到长度
-			dataLen = bbReceiveLeft->buf[bbReceiveLeft->offset] + (bbReceiveLeft->buf[bbReceiveLeft->offset + 1] << 8);
-			bbReceiveLeft->offset += 2;
+	inline int UVPeer::ReceivePackage(char* buf, uint32_t len)
+	{
+		if (compress)
+		{
+			if (auto rtv = BBuffer::ReadPackageCompressible(buf, len, *uv->bbReceiveUnpack, maxPackageLen)) return rtv;
+		}
+		bbReceivePackage->buf = buf;
+		bbReceivePackage->bufLen = len;
+		bbReceivePackage->dataLen = len;
+		bbReceivePackage->offset = 0;
 
-			// 判断数据区长度. 如果不够长, 看看能不能补足
-			if (bbReceiveLeft->offset + dataLen > bbReceiveLeft->dataLen)
-			{
-				// 还差多少凑齐数据区
-				auto left = bbReceiveLeft->offset + dataLen - bbReceiveLeft->dataLen;
+		OnReceivePackage(*bbReceivePackage);
+		return 0;
+	}
 
-				// 如果剩余数据长度无法补足, 移动剩余数据到头部后追加刚收到的数据后退出
-				if (bbReceive->offset + left > bbReceive->dataLen)
+	inline int UVPeer::Send()
+	{
+		if (state != UVPeerStates::Connected) return -1;
+		while (numWritings < maxWritings)
+		{
+			auto len = sendBufs->PopTo(*writeBufs, sendLen, false);
+			if (!len) break;
+			auto bufs = writeBufs->buf;
+			auto numBufs = writeBufs->dataLen;
+
+			// 没有正在发的: 先试着直接写. 内核缓冲区够就不必等回调
+			if (!numWritings)
+			{
+				auto r = uv_try_write((uv_stream_t*)&stream, bufs, numBufs);
+				if (r == (int)len)
 				{
-					bbReceiveLeft->WriteBuf(bbReceive->buf + bbReceive->offset, bbReceive->dataLen - bbReceive->offset);
-					return;
+					sendBufs->ReleasePopped(sendBufs->bufIndex);
+					continue;
 				}
-				// 否则只补齐当前包的数据
-				else
+				if (r < 0)
 				{
-					bbReceiveLeft->WriteBuf(bbReceive->buf + bbReceive->offset, left);
-					bbReceive->offset += left;
+					if (r != UV_EAGAIN && r != UV_ENOSYS) return r;
+					r = 0;
 				}
+				while (r >= (int)bufs->len)						// 跳过已写的部分, 剩下的走 uv_write
+				{
+					r -= (int)bufs->len;
+					++bufs;
+					--numBufs;
+				}
+				bufs->base += r;
+				bufs->len -= r;
 			}
 
-			// 数据区长度足够, 来一发 OnReceivePackage
-			bbReceivePackage->buf = bbReceiveLeft->buf + bbReceiveLeft->offset;
-			bbReceivePackage->bufLen = dataLen;
-			bbReceivePackage->dataLen = dataLen;
-			bbReceivePackage->offset = 0;
+			auto idx = (writingsHead + numWritings) % maxWritings;
+			writers[idx].data = this;
+			writerBufIndexs[idx] = sendBufs->bufIndex;
+			if (auto rtv = uv_write(&writers[idx], (uv_stream_t*)&stream, bufs, numBufs, SendCB)) return rtv;
+			++numWritings;
+		}
+		return 0;
+	}
 
-			OnReceivePackage(*bbReceivePackage);
+	inline void UVPeer::Clear()
+	{
+		bbReceiveLeft->Clear();
+		recvHeaderLen = 0;
+		sendBufs->Clear();
+		numWritings = 0;
+		writingsHead = 0;
+		CancelFlush();
+	}
 
-			// 清除 bbReceiveLeft 中的数据, 如果还有剩余数据, 跳到 bbReceive 处理代码段继续. 
-			bbReceiveLeft->dataLen = 0;
-			if (bbReceive->dataLen > bbReceive->offset) goto LabBegin;
+	inline void UVPeer::DelayFlush()
+	{
+		if (uv_flushPeers_index == (uint32_t)-1)
+		{
+			uv_flushPeers_index = uv->flushPeers->dataLen;
+			uv->flushPeers->Add(this);
 		}
 	}
 
-	inline int UVPeer::Send()
+	inline void UVPeer::CancelFlush()
 	{
-		assert(!sending);
-		if (state != UVPeerStates::Connected) return -1;
-		auto len = sendBufs->PopTo(*writeBufs, 65536);	// todo: 先写死. 这个值理论上讲可配
-		if (len)
+		if (uv_flushPeers_index != (uint32_t)-1)
 		{
-			if (auto rtv = uv_write(&writer, (uv_stream_t*)&stream, writeBufs->buf, writeBufs->dataLen, SendCB)) return rtv;
-			sending = true;
+			XX_LIST_SWAP_REMOVE(uv->flushPeers, this, uv_flushPeers_index);
+			uv_flushPeers_index = (uint32_t)-1;
 		}
-		return 0;
 	}
 
-	inline void UVPeer::Clear()
+	inline int UVPeer::Flush()
 	{
-		bbReceiveLeft->Clear();
-		sendBufs->Clear();
+		CancelFlush();
+		if (state != UVPeerStates::Connected) return -1;
+		if (numWritings) return 0;									// 回调时会接着发
+		return Send();
 	}
 
 	inline BBuffer* UVPeer::GetSendBB(int const& capacity)
@@ -384,18 +588,34 @@ namespace xx
 	{
 		sendBufs->Push(bb);			// 压入, 接管并移交上下文字典		//if (sendBufs->BytesCount() + bb.dataLen > sendBufLimit) return false;
 		if (state != UVPeerStates::Connected) return -1;
-		if (!sending) return Send();
+		if (cork)
+		{
+			if (numWritings) return 0;								// 有正在发的就先攒着, 回调时合并发
+			if (uv_flushPeers_index == (uint32_t)-1)
+			{
+				DelayFlush();
+				if (corkMaxLatency) corkSince = uv_hrtime();
+				return 0;
+			}
+			if (!corkMaxLatency || uv_hrtime() - corkSince < (uint64_t)corkMaxLatency * 1000) return 0;
+			return Flush();
+		}
+		if (numWritings < maxWritings) return Send();
 		return 0;
 	}
 
 	inline int UVPeer::Disconnect(bool const& immediately)
 	{
 		if (state == UVPeerStates::Disconnecting || state == UVPeerStates::Disconnected || state == UVPeerStates::Closed) return -1;
+		if (!immediately && uv_flushPeers_index != (uint32_t)-1)	// 先把 cork 留待的发出去, 以便 shutdown 等它们发完
+		{
+			Flush();
+		}
 		state = UVPeerStates::Disconnecting;
 
 		// todo: save reason ?
 		if (immediately														// 立即断开
-			|| !sending && ((uv_stream_t*)&stream)->write_queue_size == 0	// 没数据正在发
+			|| !numWritings && ((uv_stream_t*)&stream)->write_queue_size == 0	// 没数据正在发
 			|| uv_shutdown(&sreq, (uv_stream_t*)&stream, ShutdownCB))		// shutdown 失败
 		{
 			if (!uv_is_closing((uv_handle_t*)&stream))						// 非 正在关
@@ -449,8 +669,9 @@ namespace xx
 	int UVPeer::SendCore(T const& pkg)
 	{
 		auto bb = GetSendBB();
-		auto b = bb->WritePackage(pkg);
-		if (!b) return -1;
+		BeginPackage(*bb);
+		bb->WriteRoot(pkg);
+		if (!EndPackage(*bb)) return -1;
 		return Send(bb);
 	}
 	template<typename T, typename ...TS>
@@ -480,9 +701,18 @@ namespace xx
 	int UVPeer::SendCombine(TS const& ... pkgs)
 	{
 		auto bb = GetSendBB();
-		bb->BeginWritePackage();
+		BeginPackage(*bb);
 		SendCombineCore(*bb, pkgs...);
-		if (bb->EndWritePackage()) return -1;
+		if (!EndPackage(*bb)) return -1;
+		return Send(bb);
+	}
+
+	inline int UVPeer::SendPackageData(char const* const& buf, uint32_t const& len)
+	{
+		auto bb = GetSendBB();
+		BeginPackage(*bb);
+		bb->WriteBuf(buf, len);
+		if (!EndPackage(*bb)) return -1;
 		return Send(bb);
 	}
 
@@ -496,6 +726,9 @@ namespace xx
 	{
 		state = UVPeerStates::Connected;
 		this->uv = listener->uv;
+#ifdef XX_UV_SHARED_RECEIVE_BUFFER
+		bbReceive = uv->bbReceive;
+#endif
 		this->listener = listener;
 		if (auto rtv = uv_tcp_init(&uv->loop, (uv_tcp_t*)&stream))
 		{
@@ -531,6 +764,9 @@ namespace xx
 	{
 		state = UVPeerStates::Closed;
 		this->uv = uv;
+#ifdef XX_UV_SHARED_RECEIVE_BUFFER
+		bbReceive = uv->bbReceive;
+#endif
 		uv_clientPeers_index = uv->clientPeers->dataLen;
 		uv->clientPeers->Add(this);
 	}
@@ -636,6 +872,22 @@ namespace xx
 
 
 
+	inline UVMemPoolTrimmer::UVMemPoolTrimmer(UV* uv, uint64_t const& intervalMS)
+		: UVTimer(uv)
+	{
+		if (auto rtv = Start(intervalMS, intervalMS))
+		{
+			throw rtv;
+		}
+	}
+
+	inline void UVMemPoolTrimmer::OnFire()
+	{
+		mempool().TrimTick();
+	}
+
+
+
 
 
 
@@ -668,4 +920,133 @@ namespace xx
 		auto self = container_of(handle, UVAsync, async_req);
 		self->OnFire();
 	}
+
+
+
+
+
+	inline UVClusterPoster::UVClusterPoster(UV* uv, UVCluster::Loop* loop)
+		: UVAsync(uv)
+		, loop(loop)
+	{
+	}
+
+	inline void UVClusterPoster::OnFire()
+	{
+		std::vector<UVCluster::FuncType> funcs;
+		{
+			std::lock_guard<std::mutex> lock(loop->mtx);
+			std::swap(funcs, loop->funcs);
+		}
+		for (auto& f : funcs)
+		{
+			f(*uv);
+		}
+	}
+
+	inline UVCluster::~UVCluster()
+	{
+		Stop();
+		Join();
+	}
+
+	inline int UVCluster::Start(uint32_t numLoops, std::function<int(UV& uv)> const& init, bool const& pinThreads)
+	{
+		if (loops.size()) return -1;
+		if (!numLoops) numLoops = std::thread::hardware_concurrency();
+		if (!numLoops) numLoops = 1;
+
+		// 先建好全部 Loop 再逐个启动并等其 init 完成( 线程运行期间 loops 不可变 ). 有失败的就全停掉
+		for (uint32_t i = 0; i < numLoops; ++i)
+		{
+			loops.emplace_back(new Loop());
+		}
+		for (uint32_t i = 0; i < numLoops; ++i)
+		{
+			std::promise<int> ready;
+			auto f = ready.get_future();
+			loops[i]->thread = std::thread([this, i, &init, pinThreads, &ready] { LoopProcess(i, init, pinThreads, ready); });
+			if (auto rtv = f.get())
+			{
+				Stop();
+				Join();
+				return rtv;
+			}
+		}
+		return 0;
+	}
+
+	inline void UVCluster::LoopProcess(uint32_t const& loopIndex, std::function<int(UV& uv)> const& init, bool const& pinThreads, std::promise<int>& ready)
+	{
+		if (pinThreads) PinCurrentThread(loopIndex);
+		auto loop = loops[loopIndex].get();
+		MemPool mp;
+		{
+			UV_v uv(mp);
+			uv->reusePort = true;
+			uv->cluster = this;
+			uv->clusterIndex = loopIndex;
+			auto poster = uv->CreateAsync<UVClusterPoster>(loop);
+			auto rtv = poster ? init(*uv) : -1;
+			if (!rtv)
+			{
+				std::lock_guard<std::mutex> lock(loop->mtx);
+				loop->uv = uv;
+				loop->poster = poster;
+			}
+			ready.set_value(rtv);							// 之后 init 及 ready 将失效
+			if (rtv) return;
+
+			uv->Run();
+
+			std::lock_guard<std::mutex> lock(loop->mtx);
+			loop->poster = nullptr;
+			loop->uv = nullptr;
+			loop->funcs.clear();
+		}
+	}
+
+	inline int UVCluster::Post(uint32_t const& loopIndex, FuncType&& f)
+	{
+		if (loopIndex >= loops.size()) return -1;
+		auto& loop = *loops[loopIndex];
+		std::lock_guard<std::mutex> lock(loop.mtx);
+		if (!loop.poster) return -2;
+		loop.funcs.push_back(std::move(f));
+		loop.poster->Fire();
+		return 0;
+	}
+
+	inline void UVCluster::Stop()
+	{
+		for (uint32_t i = 0; i < loops.size(); ++i)
+		{
+			Post(i, [](UV& uv) { uv.Stop(); });
+		}
+	}
+
+	inline void UVCluster::Join()
+	{
+		for (auto& loop : loops)
+		{
+			if (loop->thread.joinable()) loop->thread.join();
+		}
+		loops.clear();
+	}
+
+	inline int UVCluster::PinCurrentThread(uint32_t const& cpuIndex)
+	{
+		auto n = std::thread::hardware_concurrency();
+		if (!n) return -1;
+#ifdef _WIN32
+		return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << (cpuIndex % n)) ? 0 : -2;
+#elif defined(__linux__)
+		cpu_set_t cs;
+		CPU_ZERO(&cs);
+		CPU_SET(cpuIndex % n, &cs);
+		return pthread_setaffinity_np(pthread_self(), sizeof(cs), &cs);
+#else
+		return -3;
+#endif
+	}
 }
@@ -272,6 +272,42 @@ namespace xx
         }
         #endregion
 
+        #region fixed( 定长原始内存格式, little endian. 用于 [Memcpy] 结构体, 对应 c++ 的 memcpy )
+        public void WriteFixed(ulong v, int siz)
+        {
+            if (dataLen + siz > buf.Length)
+            {
+                Reserve(dataLen + siz);
+            }
+            for (int i = 0; i < siz; ++i)
+            {
+                buf[dataLen++] = (byte)v;
+                v >>= 8;
+            }
+        }
+        public ulong ReadFixed(int siz)
+        {
+            ulong v = 0;
+            for (int i = 0; i < siz; ++i)
+            {
+                v |= (ulong)buf[offset++] << (i * 8);
+            }
+            return v;
+        }
+        public void WriteFixed(double v)
+        {
+            WriteFixed((ulong)BitConverter.DoubleToInt64Bits(v), 8);
+        }
+        public void ReadFixed(ref double v)
+        {
+            v = BitConverter.Int64BitsToDouble((long)ReadFixed(8));
+        }
+        public void WritePadding(int siz)
+        {
+            WriteFixed(0, siz);
+        }
+        #endregion
+
         #region string
         public void WriteCore(string v)
         {
@@ -433,17 +469,43 @@ namespace xx
             idxStore.Clear();
         }
 
-        // 一波流, 写入一套引用类的根
+        // 一波流, 写入一套引用类的根. 根类型注册为不去重的( 树形包 ), 按不带引用的编码规则写
         public void WriteRoot<T>(T v) where T : IBBuffer
         {
+            if (v != null && typeIdNoPtrDedups[v.GetPackageId()])
+            {
+                var bak = ptrStore;
+                ptrStore = null;
+                Write(v);
+                ptrStore = bak;
+                return;
+            }
             BeginWrite();
             Write(v);
             EndWrite();
         }
 
-        // 一波流, 读出一套引用类
+        // 一波流, 读出一套引用类. 预读根的类型编号, 与 WriteRoot 对应
         public void ReadRoot<T>(ref T v) where T : IBBuffer
         {
+            var bak = offset;
+            ushort typeId = 0;
+            Read(ref typeId);
+            offset = bak;
+            if (typeIdNoPtrDedups[typeId])
+            {
+                var bakStore = idxStore;
+                idxStore = null;
+                try
+                {
+                    Read(ref v);
+                }
+                finally
+                {
+                    idxStore = bakStore;
+                }
+                return;
+            }
             BeginRead();
             Read(ref v);
             EndRead();
@@ -1010,13 +1072,15 @@ namespace xx
         public delegate IBBuffer TypeIdCreatorFunc();
         public static TypeIdCreatorFunc[] typeIdCreatorMappings = new TypeIdCreatorFunc[ushort.MaxValue];
         public static Dict<Type, ushort> typeTypeIdMappings = new Dict<Type, ushort>();
+        public static bool[] typeIdNoPtrDedups = new bool[ushort.MaxValue + 1];     // 作为根收发时不做引用去重的类型( 树形包 )
 
-        public static void Register<T>(ushort typeId) where T : IBBuffer, new()
+        public static void Register<T>(ushort typeId, bool noPtrDedup = false) where T : IBBuffer, new()
         {
             var r = typeTypeIdMappings.Add(typeof(T), typeId);
             System.Diagnostics.Debug.Assert(r.success || typeTypeIdMappings.ValueAt(r.index) == typeId);
             TypeIdMaps<T>.typeId = typeId;
             typeIdCreatorMappings[typeId] = () => { return new T(); };
+            typeIdNoPtrDedups[typeId] = noPtrDedup;
         }
 
         public static IBBuffer CreateByTypeId(ushort typeId)